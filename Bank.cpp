@@ -0,0 +1,289 @@
+#include "Bank.hpp"
+#include <iostream>
+#include <sstream>
+#include <random>
+#include <cerrno>
+#include <cstring>
+#include <cassert>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// How many boards Bank_fill() generates looking for one in a shelf's range
+// of 3BV before giving up
+const int BANK_MAX_TRIES = 1000;
+
+// Holds the bank's lock, against other threads and other processes
+struct BankLock {
+  std::lock_guard<std::mutex> guard;
+  int fd;
+
+  explicit BankLock(Bank *bank) : guard(bank->mutex), fd(bank->fd) {
+    flock(fd, LOCK_EX);
+  }
+  ~BankLock() {
+    flock(fd, LOCK_UN);
+  }
+};
+
+// "Private" function declarations
+BankShelf * Bank_shelves(const Bank *bank);
+size_t Bank_board_size(const BankKind &kind);
+bool Bank_valid_kind(const BankKind &kind);
+bool Bank_generate(const BankKind &kind, Game *game, std::mt19937 &rng);
+
+bool Bank_parse_kind(const std::string &str, BankKind &kind) {
+  std::istringstream in(str);
+  char x;
+  char slash1;
+  char slash2;
+  kind = {0, 0, 0, 0, TOPOLOGY_RECT, -1, -1};
+  if (!(in >> kind.width >> x >> kind.height >> slash1 >> kind.num_treasures >> slash2
+           >> kind.num_traps) || x != 'x' || slash1 != '/' || slash2 != '/') {
+    return false;
+  }
+  std::string part;
+  while (std::getline(in, part, '/')) {
+    Topology topology;
+    int min_bbbv;
+    int max_bbbv;
+    char dash;
+    std::istringstream range(part);
+    if (part.empty()) {
+      continue; // before the first '/'
+    }
+    else if (Game_parse_topology(part, topology)) {
+      kind.topology = topology;
+    }
+    else if (range >> min_bbbv >> dash >> max_bbbv && dash == '-' && (range >> std::ws).eof()) {
+      kind.min_bbbv = min_bbbv;
+      kind.max_bbbv = max_bbbv;
+    }
+    else {
+      return false;
+    }
+  }
+  return Bank_valid_kind(kind);
+}
+
+std::string Bank_kind_name(const BankKind &kind) {
+  std::string name = std::to_string(kind.width) + "x" + std::to_string(kind.height) + "/"
+                   + std::to_string(kind.num_treasures) + "/" + std::to_string(kind.num_traps);
+  if (kind.topology != TOPOLOGY_RECT) {
+    name += "/" + Game_topology_name(static_cast<Topology>(kind.topology));
+  }
+  if (kind.min_bbbv >= 0) {
+    name += "/" + std::to_string(kind.min_bbbv) + "-" + std::to_string(kind.max_bbbv);
+  }
+  return name;
+}
+
+bool Bank_create(const std::string &filename, const std::vector<BankKind> &kinds, int capacity) {
+  BankHeader header = {};
+  std::memcpy(header.magic, BANK_MAGIC, sizeof(header.magic));
+  header.version = BANK_VERSION;
+  header.num_shelves = kinds.size();
+  std::vector<BankShelf> shelves;
+  uint64_t offset = sizeof(BankHeader) + kinds.size() * sizeof(BankShelf);
+  for(const BankKind &kind : kinds) {
+    assert(Bank_valid_kind(kind));
+    shelves.push_back({kind, static_cast<uint32_t>(capacity), offset, 0, 0});
+    offset += capacity * Bank_board_size(kind);
+  }
+
+  // The slots are left as a hole in the file until boards are added.
+  int fd = open(filename.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644);
+  bool written = fd >= 0 && write(fd, &header, sizeof(header)) == sizeof(header);
+  for(const BankShelf &shelf : shelves) {
+    written = written && write(fd, &shelf, sizeof(shelf)) == sizeof(shelf);
+  }
+  written = written && ftruncate(fd, offset) == 0;
+  if (fd >= 0) {
+    written = close(fd) == 0 && written;
+  }
+  if (!written) {
+    std::cerr << "Could not create bank " << filename << ": " << std::strerror(errno) << std::endl;
+  }
+  return written;
+}
+
+bool Bank_open(Bank *bank, const std::string &filename) {
+  bank->filename = filename;
+  bank->fd = -1;
+  bank->data = nullptr;
+  bank->size = 0;
+  bank->refilling = false;
+  int fd = open(filename.c_str(), O_RDWR);
+  struct stat info;
+  if (fd < 0 || fstat(fd, &info) != 0) {
+    std::cerr << "Could not open bank " << filename << ": " << std::strerror(errno) << std::endl;
+    if (fd >= 0) {
+      close(fd);
+    }
+    return false;
+  }
+  size_t size = info.st_size;
+  void *memory = size >= sizeof(BankHeader)
+               ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+  if (memory == MAP_FAILED) {
+    std::cerr << "Could not map bank " << filename << std::endl;
+    close(fd);
+    return false;
+  }
+
+  // Check that everything the shelves point to is in the file
+  const BankHeader *header = static_cast<const BankHeader *>(memory);
+  bool valid = std::memcmp(header->magic, BANK_MAGIC, sizeof(header->magic)) == 0 &&
+               header->version == BANK_VERSION &&
+               sizeof(BankHeader) + header->num_shelves * sizeof(BankShelf) <= size;
+  for(uint32_t i = 0; valid && i < header->num_shelves; ++i) {
+    const BankShelf &shelf = reinterpret_cast<const BankShelf *>(header + 1)[i];
+    valid = Bank_valid_kind(shelf.kind) && shelf.capacity > 0 &&
+            shelf.offset + shelf.capacity * Bank_board_size(shelf.kind) <= size;
+  }
+  if (!valid) {
+    std::cerr << filename << " is not a bank" << std::endl;
+    munmap(memory, size);
+    close(fd);
+    return false;
+  }
+  bank->fd = fd;
+  bank->data = static_cast<unsigned char *>(memory);
+  bank->size = size;
+  return true;
+}
+
+void Bank_close(Bank *bank) {
+  if (bank->refill_thread.joinable()) {
+    bank->refill_thread.join();
+  }
+  if (bank->fd >= 0) {
+    munmap(bank->data, bank->size);
+    close(bank->fd);
+    bank->fd = -1;
+    bank->data = nullptr;
+  }
+}
+
+int Bank_num_shelves(const Bank *bank) {
+  return reinterpret_cast<const BankHeader *>(bank->data)->num_shelves;
+}
+
+const BankShelf * Bank_shelf(const Bank *bank, int shelf) {
+  assert(0 <= shelf && shelf < Bank_num_shelves(bank));
+  return &Bank_shelves(bank)[shelf];
+}
+
+int Bank_find(const Bank *bank, const BankKind &kind) {
+  for(int i = 0; i < Bank_num_shelves(bank); ++i) {
+    const BankKind &shelf = Bank_shelves(bank)[i].kind;
+    if (shelf.width == kind.width && shelf.height == kind.height &&
+        shelf.num_treasures == kind.num_treasures && shelf.num_traps == kind.num_traps &&
+        shelf.topology == kind.topology &&
+        (kind.min_bbbv < 0 || (shelf.min_bbbv == kind.min_bbbv &&
+                               shelf.max_bbbv == kind.max_bbbv))) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+bool Bank_take(Bank *bank, int shelf_index, Game *game) {
+  BankShelf *shelf = &Bank_shelves(bank)[shelf_index];
+  BankLock lock(bank);
+  if (shelf->head == shelf->tail) {
+    return false;
+  }
+  const BankKind &kind = shelf->kind;
+  size_t slot = shelf->head % shelf->capacity;
+  Game_init_packed(game, kind.width, kind.height, static_cast<Topology>(kind.topology),
+                   bank->data + shelf->offset + slot * Bank_board_size(kind));
+  ++shelf->head;
+  return true;
+}
+
+int Bank_fill(Bank *bank, int shelf_index, int max_boards) {
+  BankShelf *shelf = &Bank_shelves(bank)[shelf_index];
+  BankKind kind = shelf->kind; // never changes, so it can be read unlocked
+  std::random_device device;
+  std::mt19937 rng(device());
+  Game game;
+  std::vector<unsigned char> board(Bank_board_size(kind));
+  int num_added = 0;
+  while (num_added < max_boards) {
+    {
+      BankLock lock(bank);
+      if (shelf->tail - shelf->head >= shelf->capacity) {
+        break;
+      }
+    }
+    if (!Bank_generate(kind, &game, rng)) {
+      std::cerr << "Could not find a board of kind " << Bank_kind_name(kind) << std::endl;
+      break;
+    }
+    Game_pack_board(&game, board.data());
+
+    // Someone else may have filled the shelf in the meantime
+    BankLock lock(bank);
+    if (shelf->tail - shelf->head >= shelf->capacity) {
+      break;
+    }
+    size_t slot = shelf->tail % shelf->capacity;
+    std::memcpy(bank->data + shelf->offset + slot * board.size(), board.data(), board.size());
+    ++shelf->tail;
+    ++num_added;
+  }
+  return num_added;
+}
+
+void Bank_refill_async(Bank *bank, int shelf) {
+  if (bank->refilling) {
+    return;
+  }
+  if (bank->refill_thread.joinable()) {
+    bank->refill_thread.join();
+  }
+  bank->refilling = true;
+  bank->refill_thread = std::thread([bank, shelf] {
+    Bank_fill(bank, shelf, Bank_shelf(bank, shelf)->capacity);
+    bank->refilling = false;
+  });
+}
+
+BankShelf * Bank_shelves(const Bank *bank) {
+  return reinterpret_cast<BankShelf *>(bank->data + sizeof(BankHeader));
+}
+
+size_t Bank_board_size(const BankKind &kind) {
+  return static_cast<size_t>(kind.width) * kind.height;
+}
+
+// EFFECTS: Returns whether Game_init() accepts the kind's board, and its
+//          range of 3BV is either given or left out.
+bool Bank_valid_kind(const BankKind &kind) {
+  return kind.width > 0 && kind.height > 0 && kind.num_treasures > 0 && kind.num_traps >= 0 &&
+         kind.num_treasures + kind.num_traps < static_cast<long long>(kind.width) * kind.height / 2 &&
+         (kind.topology == TOPOLOGY_RECT || kind.topology == TOPOLOGY_HEX ||
+          (kind.topology == TOPOLOGY_TORUS && kind.width >= 3 && kind.height >= 3)) &&
+         (kind.min_bbbv < 0 ? kind.max_bbbv < 0 : kind.min_bbbv <= kind.max_bbbv);
+}
+
+// EFFECTS: Initializes game with a random board of the kind, and returns
+//          true, or returns false if none of BANK_MAX_TRIES boards had 3BV
+//          in the kind's range.
+bool Bank_generate(const BankKind &kind, Game *game, std::mt19937 &rng) {
+  for(int tries = 0; tries < BANK_MAX_TRIES; ++tries) {
+    Game_init_seeded(game, rng(), kind.width, kind.height, kind.num_treasures, kind.num_traps,
+                     static_cast<Topology>(kind.topology));
+    if (kind.min_bbbv < 0) {
+      return true;
+    }
+    int bbbv = Game_difficulty(game).bbbv;
+    if (kind.min_bbbv <= bbbv && bbbv <= kind.max_bbbv) {
+      return true;
+    }
+  }
+  return false;
+}
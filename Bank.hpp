@@ -0,0 +1,123 @@
+#ifndef BANK_HPP
+#define BANK_HPP
+
+#include "Game.hpp"
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <atomic>
+
+// A bank of pre-generated boards, so that a game can start without waiting
+// for its board to be generated and numbered. Boards are made ahead of time
+// by pirate-bank.exe, and each game takes one and starts refilling the bank
+// in the background.
+//
+// The bank is one file, mapped into memory. It starts with a BankHeader and
+// num_shelves BankShelfs, followed by each shelf's slots. A shelf holds
+// boards of one kind (see BankKind) in a ring: boards head up to tail are
+// ready, board n in slot n % capacity, each stored as Game_pack_board()
+// writes it. Taking a board is O(1) to find, and loading it needs no
+// generating or numbering.
+//
+// Boards are taken and added while holding an exclusive flock() on the
+// file, so several games (and pirate-bank.exe) can share a bank. Boards are
+// generated outside the lock. Numbers are stored in the byte order of the
+// machine, so a bank can't be moved between machines of different kinds.
+
+const char BANK_MAGIC[8] = "PIRBANK";
+const uint32_t BANK_VERSION = 1;
+
+// A kind of board: every board on a shelf is of the shelf's kind
+struct BankKind {
+  int32_t width;
+  int32_t height;
+  int32_t num_treasures;
+  int32_t num_traps;
+  int32_t topology;
+  int32_t min_bbbv; // the range of the boards' 3BV (see Game_difficulty())
+  int32_t max_bbbv;
+};
+
+struct BankShelf {
+  BankKind kind;
+  uint32_t capacity; // number of slots
+  uint64_t offset;   // of slot 0, from the start of the file
+  uint64_t head;     // number of boards ever taken
+  uint64_t tail;     // number of boards ever added
+};
+
+struct BankHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t num_shelves;
+};
+
+static_assert(sizeof(BankShelf) == 56 && sizeof(BankHeader) == 16,
+              "the bank file layout must not depend on the compiler");
+
+struct Bank {
+  std::string filename;
+  int fd; // -1 if not open
+  unsigned char *data;
+  size_t size;
+  std::mutex mutex; // flock() doesn't keep out threads sharing the file
+  std::thread refill_thread;
+  std::atomic<bool> refilling;
+};
+
+// EFFECTS: Parses a kind of board written as
+//            <width>x<height>/<treasures>/<traps>[/<topology>][/<min>-<max>]
+//          where min-max is the range of 3BV (any 3BV if left out). Returns
+//          false if it's not a valid kind.
+bool Bank_parse_kind(const std::string &str, BankKind &kind);
+
+// EFFECTS: Returns the kind written as Bank_parse_kind() reads it.
+std::string Bank_kind_name(const BankKind &kind);
+
+// REQUIRES: capacity > 0, and every kind is valid
+// EFFECTS: Creates an empty bank file with a shelf of capacity boards for
+//          each kind. Returns false (with a message on cerr) if it can't.
+bool Bank_create(const std::string &filename, const std::vector<BankKind> &kinds, int capacity);
+
+// EFFECTS: Maps an existing bank file. Returns false (with a message on
+//          cerr) if it can't be opened or isn't a bank.
+bool Bank_open(Bank *bank, const std::string &filename);
+
+// EFFECTS: Waits for any refill in progress and unmaps the bank.
+void Bank_close(Bank *bank);
+
+// REQUIRES: bank is open
+// EFFECTS: Returns the number of shelves.
+int Bank_num_shelves(const Bank *bank);
+
+// REQUIRES: bank is open, 0 <= shelf < Bank_num_shelves(bank)
+// EFFECTS: Returns the shelf, as it was when last read.
+const BankShelf * Bank_shelf(const Bank *bank, int shelf);
+
+// REQUIRES: bank is open
+// EFFECTS: Returns the first shelf with boards of the given size, items
+//          and topology, and if kind.min_bbbv >= 0, the same range of 3BV,
+//          or -1 if there is none.
+int Bank_find(const Bank *bank, const BankKind &kind);
+
+// REQUIRES: bank is open, 0 <= shelf < Bank_num_shelves(bank)
+// EFFECTS: If the shelf has a board ready, takes it, initializes game with
+//          it and returns true. Otherwise, returns false.
+bool Bank_take(Bank *bank, int shelf, Game *game);
+
+// REQUIRES: bank is open, 0 <= shelf < Bank_num_shelves(bank)
+// EFFECTS: Generates boards of the shelf's kind and adds them until the
+//          shelf is full or max_boards have been added, and returns the
+//          number added. Gives up early if boards in the shelf's range of
+//          3BV are too rare to find.
+int Bank_fill(Bank *bank, int shelf, int max_boards);
+
+// REQUIRES: bank is open, 0 <= shelf < Bank_num_shelves(bank)
+// EFFECTS: Starts filling the shelf in the background, unless a refill is
+//          already in progress. Bank_close() waits for it to finish.
+void Bank_refill_async(Bank *bank, int shelf);
+
+#endif
@@ -0,0 +1,372 @@
+#include "BigBoard.hpp"
+#include <iostream>
+#include <fstream>
+#include <random>
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// A neighbor's offset (dx, dy), from the tables in Game.hpp
+typedef int NeighborOffset[2];
+
+// "Private" function declarations
+const NeighborOffset * BigBoard_neighbor_offsets(Topology topology, int y, int &num_neighbors);
+bool BigBoard_neighbor(int width, int height, bool torus, int x, int y,
+                       const NeighborOffset &offset, int &nx, int &ny);
+int64_t BigBoard_tiles_high(int height);
+size_t BigBoard_file_size(int width, int height);
+size_t BigBoard_offset(const BigBoard *board, int x, int y);
+bool BigBoard_open_cell(BigBoard *board, int x, int y);
+
+bool BigBoard_generate(const std::string &filename, unsigned seed, int width, int height,
+                       int64_t num_treasures, int64_t num_traps, Topology topology) {
+  assert(width > 0 && height > 0 && num_treasures > 0 && num_traps >= 0);
+  assert(num_treasures + num_traps < static_cast<int64_t>(width) * height / 2);
+  assert(topology != TOPOLOGY_TORUS || (width >= 3 && height >= 3));
+  const int T = BIG_BOARD_TILE_SIZE;
+  int64_t tiles_high = BigBoard_tiles_high(height);
+  int num_stripes = (width + T - 1) / T;
+
+  // Items are placed by selection sampling: each cell in turn gets a
+  // treasure or a trap with the chance that leaves every placement of the
+  // remaining items equally likely. Stripes can then be placed one at a
+  // time, in any order, and the board is the same as if placed at once.
+  std::mt19937_64 generator(seed);
+  int64_t cells_left = static_cast<int64_t>(width) * height;
+  int64_t treasures_left = num_treasures;
+  int64_t traps_left = num_traps;
+  // Each stripe's items are kept column by column.
+  auto place_stripe = [&](int stripe, std::vector<unsigned char> &items) {
+    items.assign(static_cast<size_t>(T) * height, EMPTY);
+    int columns = std::min(T, width - stripe * T);
+    for(size_t i = 0; i < static_cast<size_t>(columns) * height; ++i) {
+      int64_t pick = std::uniform_int_distribution<int64_t>(0, cells_left - 1)(generator);
+      if (pick < treasures_left) {
+        items[i] = TREASURE;
+        --treasures_left;
+      }
+      else if (pick < treasures_left + traps_left) {
+        items[i] = TRAP;
+        --traps_left;
+      }
+      --cells_left;
+    }
+  };
+
+  // The window holds the stripes before, at and after the one being
+  // written. A torus also needs its first and last stripes to number its
+  // last and first ones, so its last stripe is placed first and kept.
+  std::vector<unsigned char> window[3];
+  int window_stripe[3] = {-1, -1, -1};
+  std::vector<unsigned char> first;
+  std::vector<unsigned char> last;
+  bool wraps = topology == TOPOLOGY_TORUS && num_stripes > 1;
+  if (wraps) {
+    place_stripe(num_stripes - 1, last);
+  }
+  place_stripe(0, window[2]);
+  window_stripe[2] = 0;
+  auto column = [&](int x) -> const unsigned char * {
+    int stripe = x / T;
+    size_t start = static_cast<size_t>(x - stripe * T) * height;
+    for(int i = 0; i < 3; ++i) {
+      if (window_stripe[i] == stripe) {
+        return window[i].data() + start;
+      }
+    }
+    assert(wraps && (stripe == 0 || stripe == num_stripes - 1));
+    return (stripe == 0 ? first : last).data() + start;
+  };
+
+  std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+  BigBoardHeader header = {};
+  std::memcpy(header.magic, BIG_BOARD_MAGIC, sizeof(header.magic));
+  header.version = BIG_BOARD_VERSION;
+  header.width = width;
+  header.height = height;
+  header.topology = topology;
+  header.num_treasures = num_treasures;
+  header.num_traps = num_traps;
+  std::vector<unsigned char> tiles(BIG_BOARD_TILE_BYTES);
+  std::memcpy(tiles.data(), &header, sizeof(header));
+  out.write(reinterpret_cast<const char *>(tiles.data()), tiles.size());
+
+  tiles.resize(tiles_high * BIG_BOARD_TILE_BYTES);
+  for(int stripe = 0; stripe < num_stripes && out; ++stripe) {
+    std::swap(window[0], window[1]);
+    std::swap(window[1], window[2]);
+    window_stripe[0] = window_stripe[1];
+    window_stripe[1] = window_stripe[2];
+    window_stripe[2] = -1;
+    if (stripe + 1 < num_stripes && !(wraps && stripe + 1 == num_stripes - 1)) {
+      place_stripe(stripe + 1, window[2]);
+      window_stripe[2] = stripe + 1;
+    }
+    if (wraps && stripe == 0) {
+      first = window[1];
+    }
+
+    // A stripe's column of tiles is contiguous in the file.
+    std::fill(tiles.begin(), tiles.end(), 0);
+    int x_end = std::min(width, (stripe + 1) * T);
+    for(int x = stripe * T; x < x_end; ++x) {
+      const unsigned char *items = column(x);
+      for(int y = 0; y < height; ++y) {
+        int num_neighbors;
+        const NeighborOffset *offsets = BigBoard_neighbor_offsets(topology, y, num_neighbors);
+        int count = 0;
+        for(int i = 0; i < num_neighbors; ++i) {
+          int nx;
+          int ny;
+          if (BigBoard_neighbor(width, height, topology == TOPOLOGY_TORUS, x, y, offsets[i],
+                                nx, ny) &&
+              column(nx)[ny] == TRAP) {
+            ++count;
+          }
+        }
+        tiles[(y / T) * BIG_BOARD_TILE_BYTES + (x % T) * T + y % T]
+          = BigBoard_cell_byte(static_cast<Item>(items[y]), HIDDEN, count);
+      }
+    }
+    out.write(reinterpret_cast<const char *>(tiles.data()), tiles.size());
+  }
+  assert(!out || (treasures_left == 0 && traps_left == 0));
+  out.close();
+  if (!out) {
+    std::cerr << "Could not write big board " << filename << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool BigBoard_open(BigBoard *board, const std::string &filename) {
+  board->fd = -1;
+  board->data = nullptr;
+  board->changes.clear();
+  int fd = open(filename.c_str(), O_RDWR);
+  struct stat info;
+  if (fd < 0 || fstat(fd, &info) != 0) {
+    std::cerr << "Could not open big board " << filename << ": " << std::strerror(errno)
+              << std::endl;
+    if (fd >= 0) {
+      close(fd);
+    }
+    return false;
+  }
+  size_t size = info.st_size;
+  void *memory = size >= BIG_BOARD_TILE_BYTES
+               ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+  if (memory == MAP_FAILED) {
+    std::cerr << "Could not map big board " << filename << std::endl;
+    close(fd);
+    return false;
+  }
+  const BigBoardHeader *header = static_cast<const BigBoardHeader *>(memory);
+  if (std::memcmp(header->magic, BIG_BOARD_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != BIG_BOARD_VERSION || header->width <= 0 || header->height <= 0 ||
+      header->topology < TOPOLOGY_RECT || header->topology > TOPOLOGY_HEX ||
+      BigBoard_file_size(header->width, header->height) > size) {
+    std::cerr << filename << " is not a big board" << std::endl;
+    munmap(memory, size);
+    close(fd);
+    return false;
+  }
+  // Moves touch a few tiles here and there, so reading ahead would mostly
+  // read pages that are never used.
+  madvise(memory, size, MADV_RANDOM);
+  board->fd = fd;
+  board->data = static_cast<unsigned char *>(memory);
+  board->size = size;
+  board->header = static_cast<BigBoardHeader *>(memory);
+  board->tiles_high = BigBoard_tiles_high(header->height);
+  return true;
+}
+
+void BigBoard_close(BigBoard *board) {
+  if (board->fd >= 0) {
+    munmap(board->data, board->size);
+    close(board->fd);
+    board->fd = -1;
+    board->data = nullptr;
+    board->header = nullptr;
+  }
+}
+
+int BigBoard_width(const BigBoard *board) {
+  return board->header->width;
+}
+
+int BigBoard_height(const BigBoard *board) {
+  return board->header->height;
+}
+
+Topology BigBoard_topology(const BigBoard *board) {
+  return static_cast<Topology>(board->header->topology);
+}
+
+int64_t BigBoard_num_treasures(const BigBoard *board) {
+  return board->header->num_treasures;
+}
+
+int64_t BigBoard_num_traps(const BigBoard *board) {
+  return board->header->num_traps;
+}
+
+int64_t BigBoard_num_treasures_found(const BigBoard *board) {
+  return board->header->num_treasures_found;
+}
+
+int64_t BigBoard_num_traps_found(const BigBoard *board) {
+  return board->header->num_traps_found;
+}
+
+int64_t BigBoard_num_revealed(const BigBoard *board) {
+  return board->header->num_revealed;
+}
+
+int64_t BigBoard_num_flags(const BigBoard *board) {
+  return board->header->num_flags;
+}
+
+bool BigBoard_in_bounds(const BigBoard *board, int x, int y) {
+  return 0 <= x && x < BigBoard_width(board) && 0 <= y && y < BigBoard_height(board);
+}
+
+bool BigBoard_is_over(const BigBoard *board) {
+  return board->header->num_traps_found > 0 ||
+         board->header->num_treasures_found == board->header->num_treasures;
+}
+
+Cell BigBoard_cell(const BigBoard *board, int x, int y) {
+  assert(BigBoard_in_bounds(board, x, y));
+  unsigned char byte = board->data[BigBoard_offset(board, x, y)];
+  return {x, y, static_cast<Item>(byte >> 4 & 3), static_cast<CellState>(byte >> 6), false,
+          byte & 0xf};
+}
+
+void BigBoard_reveal(BigBoard *board, int x, int y) {
+  assert(BigBoard_in_bounds(board, x, y));
+  board->changes.clear();
+  if (BigBoard_cell(board, x, y).state == REVEALED || !BigBoard_open_cell(board, x, y)) {
+    return;
+  }
+  // Reveal the cell's opening, as Game_reveal() does. Each cell on the
+  // stack has no adjacent traps, and its neighbors are still to be opened.
+  int width = BigBoard_width(board);
+  int height = BigBoard_height(board);
+  Topology topology = BigBoard_topology(board);
+  bool torus = topology == TOPOLOGY_TORUS;
+  std::vector<std::pair<int, int>> stack;
+  stack.emplace_back(x, y);
+  while (!stack.empty()) {
+    std::pair<int, int> current = stack.back();
+    stack.pop_back();
+    int num_neighbors;
+    const NeighborOffset *offsets = BigBoard_neighbor_offsets(topology, current.second,
+                                                              num_neighbors);
+    for(int i = 0; i < num_neighbors; ++i) {
+      int nx;
+      int ny;
+      if (BigBoard_neighbor(width, height, torus, current.first, current.second, offsets[i],
+                            nx, ny)) {
+        Cell neighbor = BigBoard_cell(board, nx, ny);
+        if (neighbor.state != REVEALED && neighbor.item != TRAP &&
+            BigBoard_open_cell(board, nx, ny)) {
+          stack.emplace_back(nx, ny);
+        }
+      }
+    }
+  }
+  // The cell clicked, then the rest of its opening in order of x and y
+  std::sort(board->changes.begin() + 1, board->changes.end());
+}
+
+void BigBoard_toggle_flag(BigBoard *board, int x, int y) {
+  assert(BigBoard_in_bounds(board, x, y));
+  board->changes.clear();
+  unsigned char &byte = board->data[BigBoard_offset(board, x, y)];
+  Cell cell = BigBoard_cell(board, x, y);
+  if (cell.state == HIDDEN) {
+    byte = BigBoard_cell_byte(cell.item, FLAG, cell.num_adjacent_traps);
+    ++board->header->num_flags;
+    board->changes.emplace_back(x, y);
+  }
+  else if (cell.state == FLAG) {
+    byte = BigBoard_cell_byte(cell.item, HIDDEN, cell.num_adjacent_traps);
+    --board->header->num_flags;
+    board->changes.emplace_back(x, y);
+  }
+  // else do nothing if it's REVEALED
+}
+
+const std::vector<std::pair<int, int>> & BigBoard_changes(const BigBoard *board) {
+  return board->changes;
+}
+
+// EFFECTS: Returns the offsets of the neighbors of a cell in row y, the
+//          same ones Game uses, and sets num_neighbors to their number.
+const NeighborOffset * BigBoard_neighbor_offsets(Topology topology, int y, int &num_neighbors) {
+  if (topology == TOPOLOGY_HEX) {
+    num_neighbors = GAME_HEX_NUM_NEIGHBORS;
+    return GAME_HEX_OFFSETS[y % 2];
+  }
+  num_neighbors = GAME_RECT_NUM_NEIGHBORS;
+  return GAME_RECT_OFFSETS;
+}
+
+// EFFECTS: If the cell at offset from (x,y) is on the board, sets nx, ny to
+//          it and returns true. A torus wraps around at its edges.
+bool BigBoard_neighbor(int width, int height, bool torus, int x, int y,
+                       const NeighborOffset &offset, int &nx, int &ny) {
+  nx = x + offset[0];
+  ny = y + offset[1];
+  if (torus) {
+    nx = (nx + width) % width;
+    ny = (ny + height) % height;
+  }
+  return 0 <= nx && nx < width && 0 <= ny && ny < height;
+}
+
+int64_t BigBoard_tiles_high(int height) {
+  return (height + BIG_BOARD_TILE_SIZE - 1) / BIG_BOARD_TILE_SIZE;
+}
+
+size_t BigBoard_file_size(int width, int height) {
+  int64_t tiles_wide = (width + BIG_BOARD_TILE_SIZE - 1) / BIG_BOARD_TILE_SIZE;
+  return (1 + tiles_wide * BigBoard_tiles_high(height)) * BIG_BOARD_TILE_BYTES;
+}
+
+// EFFECTS: Returns where the cell at (x,y) is stored in the file.
+size_t BigBoard_offset(const BigBoard *board, int x, int y) {
+  const int T = BIG_BOARD_TILE_SIZE;
+  int64_t tile = (x / T) * board->tiles_high + y / T;
+  return (1 + tile) * BIG_BOARD_TILE_BYTES + (x % T) * T + y % T;
+}
+
+// REQUIRES: the cell at (x,y) is not REVEALED
+// EFFECTS: Reveals the cell and updates the counts. Returns true if it has
+//          no adjacent traps and isn't a trap, so its neighbors should be
+//          revealed too.
+bool BigBoard_open_cell(BigBoard *board, int x, int y) {
+  BigBoardHeader *header = board->header;
+  Cell cell = BigBoard_cell(board, x, y);
+  assert(cell.state != REVEALED);
+  if (cell.state == FLAG) {
+    --header->num_flags;
+  }
+  board->data[BigBoard_offset(board, x, y)]
+    = BigBoard_cell_byte(cell.item, REVEALED, cell.num_adjacent_traps);
+  ++header->num_revealed;
+  board->changes.emplace_back(x, y);
+  if (cell.item == TRAP) {
+    ++header->num_traps_found;
+    return false;
+  }
+  header->num_treasures_found += cell.item == TREASURE;
+  return cell.num_adjacent_traps == 0;
+}
@@ -0,0 +1,123 @@
+#ifndef BIG_BOARD_HPP
+#define BIG_BOARD_HPP
+
+#include "Game.hpp"
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <utility>
+
+// A board too big to fit in memory, played in place in a file. The file is
+// written by BigBoard_generate() in one pass without ever holding the whole
+// board, then mapped by BigBoard_open(), so the operating system pages in
+// only the parts of the board that are played and writes the moves back to
+// the file. A game on a big board is therefore always saved, and is resumed
+// by opening the file again.
+//
+// The file is a BigBoardHeader padded to BIG_BOARD_TILE_BYTES, then the
+// board in square tiles of BIG_BOARD_TILE_SIZE cells a side, one byte per
+// cell (see BigBoard_cell_byte()). A tile is one page, and a column of
+// tiles is contiguous, so the cells near each other on the board are near
+// each other in the file, and a reveal touches few pages. Tiles are stored
+// column of tiles by column of tiles, and the cells within a tile column by
+// column. The tiles along the right and bottom edges are padded to full
+// size. Numbers are stored in the byte order of the machine.
+
+const char BIG_BOARD_MAGIC[8] = "PIRBIG";
+const uint32_t BIG_BOARD_VERSION = 1;
+const int BIG_BOARD_TILE_SIZE = 64;
+const size_t BIG_BOARD_TILE_BYTES = BIG_BOARD_TILE_SIZE * BIG_BOARD_TILE_SIZE;
+
+struct BigBoardHeader {
+  char magic[8];
+  uint32_t version;
+  int32_t width;
+  int32_t height;
+  int32_t topology;
+  int64_t num_treasures;
+  int64_t num_traps;
+  int64_t num_treasures_found;
+  int64_t num_traps_found;
+  int64_t num_revealed;
+  int64_t num_flags;
+};
+
+static_assert(sizeof(BigBoardHeader) == 72 && sizeof(BigBoardHeader) <= BIG_BOARD_TILE_BYTES,
+              "the big board file layout must not depend on the compiler");
+
+struct BigBoard {
+  int fd; // -1 if not open
+  unsigned char *data;
+  size_t size;
+  BigBoardHeader *header; // at the start of data
+  int64_t tiles_high;     // number of tiles in a column of tiles
+
+  // Positions of the cells whose state was changed by the last move, as in
+  // Game_changes()
+  std::vector<std::pair<int, int>> changes;
+};
+
+// EFFECTS: Returns the byte a cell is stored as: its number of adjacent
+//          traps in the low four bits, its item in the next two, and its
+//          state in the top two, the same byte Game_pack_board() writes.
+inline unsigned char BigBoard_cell_byte(Item item, CellState state, int num_adjacent_traps) {
+  return num_adjacent_traps | item << 4 | state << 6;
+}
+
+// REQUIRES: as for Game_init(), except that width * height may be larger
+//           than INT_MAX
+// EFFECTS: Writes a new big board to filename, with the items placed by a
+//          generator seeded with seed. The board is made in stripes one
+//          tile wide, holding only the stripe being written and the ones
+//          on either side of it, so it takes memory in proportion to the
+//          height of the board rather than its area. Returns false (with a
+//          message on cerr) if the file can't be written.
+bool BigBoard_generate(const std::string &filename, unsigned seed, int width, int height,
+                       int64_t num_treasures, int64_t num_traps,
+                       Topology topology = TOPOLOGY_RECT);
+
+// EFFECTS: Maps a big board file to play on it. Returns false (with a
+//          message on cerr) if it can't be opened or isn't a big board.
+bool BigBoard_open(BigBoard *board, const std::string &filename);
+
+// EFFECTS: Unmaps the board, leaving its file as the game was left.
+void BigBoard_close(BigBoard *board);
+
+// REQUIRES: board is open, for all of the functions below
+
+int BigBoard_width(const BigBoard *board);
+int BigBoard_height(const BigBoard *board);
+Topology BigBoard_topology(const BigBoard *board);
+int64_t BigBoard_num_treasures(const BigBoard *board);
+int64_t BigBoard_num_traps(const BigBoard *board);
+int64_t BigBoard_num_treasures_found(const BigBoard *board);
+int64_t BigBoard_num_traps_found(const BigBoard *board);
+int64_t BigBoard_num_revealed(const BigBoard *board);
+int64_t BigBoard_num_flags(const BigBoard *board);
+
+// EFFECTS: Returns true if (x,y) is the position of a cell on the board.
+bool BigBoard_in_bounds(const BigBoard *board, int x, int y);
+
+// EFFECTS: Returns true if a TRAP has been revealed or if all TREASUREs
+//          have been revealed.
+bool BigBoard_is_over(const BigBoard *board);
+
+// REQUIRES: (x,y) is in bounds
+// EFFECTS: Returns a copy of the cell at (x,y).
+Cell BigBoard_cell(const BigBoard *board, int x, int y);
+
+// REQUIRES: (x,y) is in bounds
+// EFFECTS: Reveals the cell at (x,y) by the same rules as Game_reveal(),
+//          and records the changes in the same order. The changes are kept
+//          in memory, so revealing an opening costs about 16 bytes a cell.
+void BigBoard_reveal(BigBoard *board, int x, int y);
+
+// REQUIRES: (x,y) is in bounds
+// EFFECTS: Flags or unflags the cell at (x,y), as Game_toggle_flag() does.
+void BigBoard_toggle_flag(BigBoard *board, int x, int y);
+
+// EFFECTS: Returns the positions of the cells changed by the last move.
+const std::vector<std::pair<int, int>> & BigBoard_changes(const BigBoard *board);
+
+#endif
@@ -0,0 +1,32 @@
+#include "ColumnLabel.hpp"
+#include <cassert>
+#include <cctype>
+#include <climits>
+
+std::string ColumnLabel_format(int x) {
+  assert(x >= 0);
+  // Labels count in "bijective" base 26, where A-Z stand for digits 1-26.
+  std::string label;
+  for(int n = x + 1; n > 0; n = (n - 1) / 26) {
+    label.insert(label.begin(), static_cast<char>('A' + (n - 1) % 26));
+  }
+  return label;
+}
+
+int ColumnLabel_parse(const std::string &label) {
+  if (label.empty()) {
+    return -1;
+  }
+  long long n = 0;
+  for(char c : label) {
+    c = std::toupper(static_cast<unsigned char>(c));
+    if (c < 'A' || 'Z' < c) {
+      return -1;
+    }
+    n = n * 26 + (c - 'A' + 1);
+    if (n > INT_MAX) {
+      return -1;
+    }
+  }
+  return n - 1;
+}
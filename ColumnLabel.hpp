@@ -0,0 +1,19 @@
+#ifndef COLUMN_LABEL_HPP
+#define COLUMN_LABEL_HPP
+
+#include <string>
+
+// Column labels, shared by the UIs that let players name columns with
+// letters the way a spreadsheet does. The game itself only knows columns by
+// number.
+
+// REQUIRES: x >= 0
+// EFFECTS: Returns the label players use for column x: A, B, ..., Z, then
+//          AA, AB, ..., AZ, BA, and so on.
+std::string ColumnLabel_format(int x);
+
+// EFFECTS: Returns the column with the given label (letters may be upper or
+//          lower case), or -1 if label is not a valid column label.
+int ColumnLabel_parse(const std::string &label);
+
+#endif
@@ -1,11 +1,20 @@
 #include "CommandUI.hpp"
+#include "ColumnLabel.hpp"
+#include "Stats.hpp"
+#include "Trace.hpp"
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <string>
 #include <cassert>
 #include <iomanip>
 #include <vector>
 #include <limits>
+#include <algorithm>
+#include <cstdio>
+#include <csignal>
+#include <unistd.h>
+#include <sys/ioctl.h>
 
 const std::string RESET_COLOR = "\033[0m";
 
@@ -19,106 +28,414 @@ const std::vector<std::string> colors = {
   "\033[31m", // red
   "\033[35m", // magenta
   "\033[35m", // magenta
+  "\u001b[48;5;88m", // red background
+  "\u001b[48;5;7m",  // gray background
 };
 
-void print_wide_digit(int n) {
+constexpr int COLOR_RESET = 0;
+constexpr int COLOR_TRAP = 9;
+constexpr int COLOR_HIDDEN = 10;
+
+// The text drawn for a cell and the color it is drawn in
+struct Glyph {
+  int color;
+  std::string text;
+};
+
+// "Private" function declarations
+std::vector<Glyph> make_glyph_table();
+int glyph_index(Item item, CellState state, int num_adjacent_traps);
+void CommandUI_read_view(CommandUI *ui, bool show_hidden);
+void CommandUI_update_board(CommandUI *ui);
+void CommandUI_fit_view(CommandUI *ui);
+void CommandUI_move_view(CommandUI *ui, int x, int y);
+int row_indent(const CommandUI *ui, int r);
+
+// Set by the SIGWINCH handler when the terminal is resized
+volatile std::sig_atomic_t terminal_resized = 0;
+
+// Every cell is drawn with one of these glyphs, looked up by glyph_index()
+const std::vector<Glyph> glyphs = make_glyph_table();
+
+std::string wide_digit(int n) {
   assert(0 <= n && n <= 9);
   char str[4] = "\uFF10";
   str[2] += n;
-  std::cout << str;
+  return str;
 }
 
-void print_wide_letter(char c) {
+std::string wide_letter(char c) {
   assert('A' <= c && c <= 'Z');
   char str[4] = "\uFF21";
   str[2] += (c - 'A');
-  std::cout << str;
+  return str;
 }
 
-void print_cell_item(const Cell *cell) {
-  if (cell->item == EMPTY) {
-    if (cell->num_adjacent_traps > 0) {
-      std::cout << colors[cell->num_adjacent_traps];
-      print_wide_digit(cell->num_adjacent_traps);
+Glyph cell_item_glyph(Item item, int num_adjacent_traps) {
+  if (item == EMPTY) {
+    if (num_adjacent_traps > 0) {
+      return {num_adjacent_traps, wide_digit(num_adjacent_traps)};
     }
     else {
-      std::cout << "  ";
+      return {COLOR_RESET, "  "};
     }
   }
-  else if (cell->item == TREASURE) {
-    std::cout << "💰";
+  else if (item == TREASURE) {
+    return {COLOR_RESET, "💰"};
   }
-  else if (cell->item == TRAP) {
-    std::cout << "\u001b[48;5;88m"; // red background
-    std::cout << "☠️ ";
+  else if (item == TRAP) {
+    return {COLOR_TRAP, "☠️ "};
   }
   else {
     assert(false);
+    return {};
   }
 }
 
-void print_cell(const Cell *cell, bool show_hidden) {
-  if (show_hidden || cell->state == REVEALED) {
-    print_cell_item(cell);
+Glyph cell_glyph(Item item, CellState state, int num_adjacent_traps) {
+  if (state == REVEALED) {
+    return cell_item_glyph(item, num_adjacent_traps);
   }
-  else if (cell->state == FLAG) {
-    std::cout << "\u001b[48;5;7m" << "🚩";
-    std::cout << colors[0];
+  else if (state == FLAG) {
+    return {COLOR_HIDDEN, "🚩"};
   }
-  else if (cell->state == HIDDEN) {
-    std::cout << "\u001b[48;5;7m" << "  ";
+  else if (state == HIDDEN) {
+    return {COLOR_HIDDEN, "  "};
   }
   else {
     assert(false);
+    return {};
   }
+}
+
+int glyph_index(Item item, CellState state, int num_adjacent_traps) {
+  return (state * 3 + item) * 9 + num_adjacent_traps;
+}
+
+std::vector<Glyph> make_glyph_table() {
+  std::vector<Glyph> table(3 * 3 * 9);
+  for(CellState state : {HIDDEN, REVEALED, FLAG}) {
+    for(Item item : {EMPTY, TREASURE, TRAP}) {
+      for(int n = 0; n <= 8; ++n) {
+        table[glyph_index(item, state, n)] = cell_glyph(item, state, n);
+      }
+    }
+  }
+  return table;
+}
+
+// EFFECTS: Appends the escape codes needed to switch the frame's current
+//          color to the given one. Nothing is appended if it's unchanged.
+void set_color(CommandUI *ui, int color) {
+  if (color == ui->frame_color) {
+    return;
+  }
+  // Colors may set the foreground or the background, so always reset first
+  // rather than layering one on top of the other.
+  if (ui->frame_color != COLOR_RESET) {
+    ui->frame += RESET_COLOR;
+  }
+  if (color != COLOR_RESET) {
+    ui->frame += colors[color];
+  }
+  ui->frame_color = color;
+}
+
+int cell_glyph_index(const Cell *cell, bool show_hidden) {
+  CellState state = show_hidden ? REVEALED : cell->state;
+  return glyph_index(cell->item, state, cell->num_adjacent_traps);
+}
+
+void print_glyph(CommandUI *ui, int index) {
+  const Glyph &glyph = glyphs[index];
+  set_color(ui, glyph.color);
+  ui->frame += glyph.text;
+}
+
+// EFFECTS: Appends the escape code that moves the cursor to the given
+//          (1-based) row and column of the terminal.
+void move_cursor(CommandUI *ui, int row, int col) {
+  char code[32];
+  snprintf(code, sizeof(code), "\033[%d;%dH", row, col);
+  ui->frame += code;
+}
 
-  // reset output color
-  std::cout << RESET_COLOR;
+void handle_resize(int) {
+  terminal_resized = 1;
 }
 
 void CommandUI_init(CommandUI *ui, Game *game) {
   ui->game = game;
+  ui->journal = nullptr;
+  ui->spectator = nullptr;
+  ui->frame_color = COLOR_RESET;
+  ui->ansi = false;
+  ui->repaint = true;
+
+  // Row labels are as wide as the largest row number, and column labels
+  // are stacked one letter per line.
+  ui->row_label_width = std::max<int>(2, std::to_string(Game_height(game) - 1).size());
+  ui->num_label_rows = ColumnLabel_format(Game_width(game) - 1).size();
+
+  // The view starts at the bottom left corner of the board.
+  ui->view_x = 0;
+  ui->view_y = 0;
+  ui->view_width = 0;
+  ui->view_height = 0;
+  CommandUI_fit_view(ui);
+}
+
+void CommandUI_enable_autosave(CommandUI *ui, Journal *journal) {
+  ui->journal = journal;
+}
+
+void CommandUI_enable_spectate(CommandUI *ui, Spectator *spectator) {
+  ui->spectator = spectator;
+}
+
+void CommandUI_enable_ansi(CommandUI *ui) {
+  ui->ansi = true;
+  ui->repaint = true;
+  ui->screen.assign(ui->view_width * ui->view_height, -1);
+  std::signal(SIGWINCH, handle_resize);
+}
+
+// EFFECTS: Sizes the view to show as much of the board as fits on the
+//          terminal, and keeps it within the bounds of the board. If stdout
+//          isn't a terminal, such as when it's piped to a file, the view is
+//          the whole board.
+void CommandUI_fit_view(CommandUI *ui) {
+  int width = Game_width(ui->game);
+  int height = Game_height(ui->game);
+  winsize size;
+  if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_row > 0 && size.ws_col > 0) {
+    // Leave room for the labels, status line, menu, prompt and a message.
+    width = std::clamp((size.ws_col - ui->row_label_width - 1 - row_indent(ui, 1)) / 2,
+                       1, width);
+    height = std::clamp(size.ws_row - ui->num_label_rows - 4, 1, height);
+  }
+  if (width != ui->view_width || height != ui->view_height) {
+    ui->view_width = width;
+    ui->view_height = height;
+    ui->repaint = true;
+    ui->view_glyphs.assign(width * height, -1);
+    if (ui->ansi) {
+      ui->screen.assign(width * height, -1);
+    }
+
+    // Reserve enough room for a view full of the longest glyphs, each with
+    // a color change, so rendering never has to grow the buffer.
+    size_t max_cell = 0;
+    for(const Glyph &glyph : glyphs) {
+      max_cell = std::max(max_cell, glyph.text.size());
+    }
+    max_cell += RESET_COLOR.size() + colors[COLOR_TRAP].size();
+    size_t max_row = ui->row_label_width + 1 + row_indent(ui, 1) + width * max_cell
+                   + RESET_COLOR.size() + 1;
+    ui->frame.reserve((height + ui->num_label_rows) * max_row + 512);
+  }
+  CommandUI_move_view(ui, ui->view_x, ui->view_y);
+}
+
+// EFFECTS: Moves the bottom left corner of the view to (x,y), or as close
+//          to it as possible while keeping the whole view on the board.
+void CommandUI_move_view(CommandUI *ui, int x, int y) {
+  x = std::clamp(x, 0, Game_width(ui->game) - ui->view_width);
+  y = std::clamp(y, 0, Game_height(ui->game) - ui->view_height);
+  if (x != ui->view_x || y != ui->view_y) {
+    ui->view_x = x;
+    ui->view_y = y;
+    ui->repaint = true; // every label and cell on screen changes
+  }
+}
+
+// EFFECTS: Scrolls the view as little as possible to bring (x,y) into it.
+void CommandUI_scroll_to(CommandUI *ui, int x, int y) {
+  int view_x = std::clamp(ui->view_x, x - ui->view_width + 1, x);
+  int view_y = std::clamp(ui->view_y, y - ui->view_height + 1, y);
+  CommandUI_move_view(ui, view_x, view_y);
+}
+
+void print_column_labels(CommandUI *ui) {
+  // Labels are right-aligned, so shorter ones start on lower lines.
+  for(int line = 0; line < ui->num_label_rows; ++line) {
+    ui->frame.append(ui->row_label_width + 1, ' ');
+    for(int c = ui->view_x; c < ui->view_x + ui->view_width; c++) {
+      std::string label = ColumnLabel_format(c);
+      int i = line - (ui->num_label_rows - label.size());
+      if (i >= 0) {
+        ui->frame += wide_letter(label[i]);
+      }
+      else {
+        ui->frame += "  ";
+      }
+    }
+    ui->frame += '\n';
+  }
+}
+
+// EFFECTS: Returns how many spaces row r is shifted right. On a hex board
+//          odd rows are shifted half a cell (cells are two columns wide).
+int row_indent(const CommandUI *ui, int r) {
+  return Game_topology(ui->game) == TOPOLOGY_HEX && r % 2 == 1;
+}
+
+void CommandUI_print_board(CommandUI* ui, bool show_hidden) {
+  STATS_TIME(STAT_UI_RENDER);
+  TRACE_SPAN("render");
+  if (terminal_resized) {
+    terminal_resized = 0;
+    ui->repaint = true;
+  }
+  CommandUI_fit_view(ui);
+  CommandUI_read_view(ui, show_hidden);
+  if (ui->ansi) {
+    if (!ui->repaint) {
+      CommandUI_update_board(ui);
+      return;
+    }
+    // clear the screen and start drawing from the top left
+    ui->frame += "\033[H\033[2J";
+    ui->repaint = false;
+  }
+
+  for(int r = ui->view_y + ui->view_height - 1; r >= ui->view_y; --r) {
+    char label[16];
+    snprintf(label, sizeof(label), "%*d ", ui->row_label_width, r);
+    ui->frame += label;
+    ui->frame.append(row_indent(ui, r), ' ');
+    const int *glyph = &ui->view_glyphs[(r - ui->view_y) * ui->view_width];
+    for(int i = 0; i < ui->view_width; i++) {
+      print_glyph(ui, glyph[i]);
+    }
+    // reset output color
+    set_color(ui, COLOR_RESET);
+    ui->frame += '\n';
+  }
+  if (ui->ansi) {
+    ui->screen = ui->view_glyphs;
+  }
+  print_column_labels(ui);
 }
 
-void CommandUI_print_board(const CommandUI* ui, bool show_hidden) {
-  Game *game = ui->game;
-  for(int r = game->height-1; r >= 0; --r) {
-    std::cout << std::setw(2) << r << " ";
-    for(int c = 0; c < game->width; c++) {
-      const Cell *cell = Game_cell(game, c, r);
-      print_cell(cell, show_hidden);
+// EFFECTS: Looks up the glyph of each cell in the view into
+//          ui->view_glyphs. Only the cells in the view are read, so the
+//          cost of a frame depends on the size of the terminal, not the
+//          board, and they're read down each column, in storage order.
+void CommandUI_read_view(CommandUI *ui, bool show_hidden) {
+  GameView view = Game_view(ui->game, ui->view_x, ui->view_y, ui->view_width, ui->view_height);
+  for(int i = 0; i < ui->view_width; i++) {
+    const Cell *cell = GameView_cell(&view, i, 0);
+    int *glyph = &ui->view_glyphs[i];
+    for(int j = 0; j < ui->view_height; j++, cell += view.y_stride, glyph += ui->view_width) {
+      *glyph = cell_glyph_index(cell, show_hidden);
     }
-    std::cout << std::endl;
   }
-  std::cout << "   ";
-  for(int c = 0; c < game->width; c++) {
-    print_wide_letter('A' + c);
+}
+
+// REQUIRES: ui is in ANSI mode, the view is already on the terminal, and
+//           ui->view_glyphs holds the view's glyphs for this frame
+// EFFECTS: Appends the cells whose glyphs differ from the ones on the
+//          terminal, each drawn in place, and leaves the cursor on the line
+//          below the board with the rest of the screen cleared.
+void CommandUI_update_board(CommandUI *ui) {
+  int top = ui->view_y + ui->view_height - 1;
+  for(int r = top; r >= ui->view_y; --r) {
+    int cursor_c = -1; // column the cursor is known to be at, if any
+    for(int c = ui->view_x; c < ui->view_x + ui->view_width; c++) {
+      int glyph = ui->view_glyphs[(r - ui->view_y) * ui->view_width + (c - ui->view_x)];
+      int &shown = ui->screen[(r - ui->view_y) * ui->view_width + (c - ui->view_x)];
+      if (glyph == shown) {
+        continue;
+      }
+      if (c != cursor_c) {
+        // the top row is on line 1, and cells start after the row label
+        move_cursor(ui, 1 + top - r,
+                    ui->row_label_width + 2 + row_indent(ui, r) + 2 * (c - ui->view_x));
+      }
+      print_glyph(ui, glyph);
+      shown = glyph;
+      // Terminals disagree on the width of the trap glyph, so don't assume
+      // where the cursor is after drawing one.
+      cursor_c = glyphs[glyph].color == COLOR_TRAP ? -1 : c + 1;
+    }
   }
-  std::cout << std::endl;
+  set_color(ui, COLOR_RESET);
+
+  // Skip the column labels, then clear whatever was printed below them.
+  move_cursor(ui, ui->view_height + ui->num_label_rows + 1, 1);
+  ui->frame += "\033[J";
 }
 
-void CommandUI_print_status(const CommandUI* ui) {
-  std::cout << Game_num_treasures_found(ui->game)
-            << "/" << Game_num_treasures(ui->game)
-            << " treasures found." << std::endl;
+void CommandUI_print_status(CommandUI* ui) {
+  ui->frame += std::to_string(Game_num_treasures_found(ui->game));
+  ui->frame += "/";
+  ui->frame += std::to_string(Game_num_treasures(ui->game));
+  ui->frame += " treasures found.";
+  if (ui->view_width < Game_width(ui->game) || ui->view_height < Game_height(ui->game)) {
+    ui->frame += " Viewing " + ColumnLabel_format(ui->view_x)
+               + "-" + ColumnLabel_format(ui->view_x + ui->view_width - 1)
+               + ", " + std::to_string(ui->view_y)
+               + "-" + std::to_string(ui->view_y + ui->view_height - 1) + ".";
+  }
+  ui->frame += "\n";
+  ui->frame += ui->message;
+  ui->message.clear();
+}
+
+// EFFECTS: Writes out everything rendered into the frame with a single
+//          write, then empties the frame for reuse.
+void CommandUI_flush(CommandUI *ui) {
+  STATS_TIME(STAT_UI_OUTPUT);
+  // Anything already sent to std::cout must come out first.
+  std::cout.flush();
+  const char *data = ui->frame.data();
+  size_t remaining = ui->frame.size();
+  while (remaining > 0) {
+    ssize_t written = write(STDOUT_FILENO, data, remaining);
+    if (written < 0) {
+      break;
+    }
+    data += written;
+    remaining -= written;
+  }
+  ui->frame.clear();
 }
 
 void handle_move_input(CommandUI *ui, std::string move) {
   std::string x_str;
   std::cin >> x_str;
-  int x = x_str[0] - 'A';
+  int x = ColumnLabel_parse(x_str);
   int y = -1;
   std::cin >> y;
   if (Game_in_bounds(ui->game, x, y)) {
+    if (move == "V") {
+      // center the view on (x,y)
+      CommandUI_move_view(ui, x - ui->view_width / 2, y - ui->view_height / 2);
+      return;
+    }
+    CommandUI_scroll_to(ui, x, y);
     if (move == "R") {
       Game_reveal(ui->game, x, y);
+      if (ui->spectator) {
+        Spectator_publish(ui->spectator, ui->game);
+      }
+      if (ui->journal) {
+        Journal_record(ui->journal, ui->game, JOURNAL_REVEAL, x, y);
+      }
     }
     else if (move == "F") {
       Game_toggle_flag(ui->game, x, y);
+      if (ui->spectator) {
+        Spectator_publish(ui->spectator, ui->game);
+      }
+      if (ui->journal) {
+        Journal_record(ui->journal, ui->game, JOURNAL_FLAG, x, y);
+      }
     }
   }
   else {
-    std::cout << "Out of bounds!" << std::endl;
+    ui->message += "Out of bounds!\n";
   }
 }
 
@@ -129,30 +446,49 @@ void handle_save_input(CommandUI *ui) {
   Game_save(ui->game, out);
 }
 
-void CommandUI_print_menu(const CommandUI *ui) {
-  std::cout << "Reveal/Flag = R/F <x> <y> | Save = S <filename> | Quit = q" << std::endl;
+void CommandUI_print_menu(CommandUI *ui) {
+  if (ui->ansi) {
+    ui->frame += "Reveal/Flag = R/F <x> <y> | View = V <x> <y> | Save = S <filename> | Redraw = L | Quit = q\n";
+  }
+  else {
+    ui->frame += "Reveal/Flag = R/F <x> <y> | View = V <x> <y> | Save = S <filename> | Quit = q\n";
+  }
+  if (Stats_enabled()) {
+    ui->frame += "Latency statistics = STATS\n";
+  }
+  ui->frame += "Enter move: ";
 }
 
 bool CommandUI_input(CommandUI *ui) {
-  std::cout << "Enter move: ";
   std::string move;
   std::cin >> move;
+  // The turn starts once the player has entered a move, so the time spent
+  // thinking isn't counted.
+  TRACE_SPAN("turn");
   if (move == "Q") {
     return false;
   }
   else if (move == "S") {
     handle_save_input(ui);
   }
-  else if (move == "R" || move == "F") {
+  else if (move == "R" || move == "F" || move == "V") {
     handle_move_input(ui, move);
   }
+  else if (move == "L") {
+    ui->repaint = true;
+  }
+  else if (move == "STATS") {
+    std::ostringstream stats;
+    Stats_print(stats);
+    ui->message += stats.str();
+  }
   else {
-    std::cout << "Invalid move!" << std::endl;
+    ui->message += "Invalid move!\n";
   }
 
   // If there was an input error, print a message, reset cin errors, and clear buffer.
   if (!std::cin) {
-    std::cout << "Invalid input!" << std::endl;
+    ui->message += "Invalid input!\n";
     std::cin.clear();
     std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
   }
@@ -164,18 +500,20 @@ void CommandUI_play(CommandUI *ui) {
     CommandUI_print_board(ui, false);
     CommandUI_print_status(ui);
     CommandUI_print_menu(ui);
+    CommandUI_flush(ui);
   }
   while (!Game_is_over(ui->game) && CommandUI_input(ui));
 
 
   CommandUI_print_board(ui, true);
   if (Game_num_treasures_found(ui->game) == Game_num_treasures(ui->game)) {
-    std::cout << "Yarrr! Ye found all " << Game_num_treasures(ui->game)
-              << " treasures."<< std::endl;
+    ui->frame += "Yarrr! Ye found all " + std::to_string(Game_num_treasures(ui->game))
+               + " treasures.\n";
   }
   else {
-    std::cout << "Avast! Ye hit a trap!" << std::endl;
-    std::cout << "Ye found " << Game_num_treasures_found(ui->game) << "/"
-              << Game_num_treasures(ui->game) << " treasures." << std::endl;
+    ui->frame += "Avast! Ye hit a trap!\n";
+    ui->frame += "Ye found " + std::to_string(Game_num_treasures_found(ui->game)) + "/"
+               + std::to_string(Game_num_treasures(ui->game)) + " treasures.\n";
   }
-}
\ No newline at end of file
+  CommandUI_flush(ui);
+}
@@ -2,15 +2,63 @@
 #define STREAM_UI_HPP
 
 #include "Game.hpp"
+#include "Journal.hpp"
+#include "Spectator.hpp"
 #include <iostream>
+#include <string>
+#include <vector>
 
 
 struct CommandUI {
   Game *game;
+  Journal *journal; // nullptr unless autosave is enabled
+  Spectator *spectator; // nullptr unless spectating is enabled
+
+  // Each screen is rendered into frame and written out all at once. The
+  // buffer is reused from turn to turn, so it's only allocated once.
+  std::string frame;
+  int frame_color; // color in effect at the end of frame
+
+  // Only the cells in the view are drawn. (view_x, view_y) is its bottom
+  // left corner, and it's sized to fit the terminal.
+  int view_x;
+  int view_y;
+  int view_width;
+  int view_height;
+  int row_label_width;
+  int num_label_rows;
+
+  // In ANSI mode, the board stays in place on the terminal and each frame
+  // only redraws the cells that changed since the previous one.
+  bool ansi;
+  bool repaint; // redraw the whole screen on the next frame
+  std::vector<int> screen; // glyph shown on the terminal for each cell in the view
+
+  // Glyph of each cell in the view for the frame being drawn, row by row
+  // like screen. It's read from the board column by column, the order the
+  // cells are stored in, and then written out a row at a time.
+  std::vector<int> view_glyphs;
+
+  // Replies to the last input, such as "Invalid move!", shown below the
+  // status on the next frame. They're kept out of std::cout so that an
+  // ANSI update doesn't clear them along with the old menu.
+  std::string message;
 };
 
 void CommandUI_init(CommandUI *ui, Game *game);
 
+// EFFECTS: Records every reveal and flag made through the UI in journal.
+void CommandUI_enable_autosave(CommandUI *ui, Journal *journal);
+
+// EFFECTS: Publishes every move made through the UI to spectator.
+void CommandUI_enable_spectate(CommandUI *ui, Spectator *spectator);
+
+// EFFECTS: Switches the UI to ANSI mode. After the first frame, only cells
+//          that change are redrawn, using cursor movement escape codes. The
+//          whole screen is repainted when the terminal is resized or when
+//          the player asks for it.
+void CommandUI_enable_ansi(CommandUI *ui);
+
 void CommandUI_play(CommandUI* ui);
 
 #endif
\ No newline at end of file
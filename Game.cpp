@@ -1,4 +1,6 @@
 #include "Game.hpp"
+#include "Stats.hpp"
+#include "Trace.hpp"
 #include <cassert>
 #include <string>
 #include <algorithm>
@@ -6,6 +8,9 @@
 #include <chrono>
 #include <thread>
 #include <iomanip>
+#include <climits>
+#include <cstddef>
+#include <numeric>
 
 
 //////////////////////////////////////////////////////////////////////////
@@ -13,12 +18,89 @@
 // internally and not available as part of the "public" Game interface, //
 // because they are not declared in the .hpp header file.               //
 //////////////////////////////////////////////////////////////////////////
-void place_items(Game *game, int n, Item item);
+// EFFECTS: Same as Game_init(), with next() giving the random numbers that
+//          place the items.
+//          If lazy, the cells are left to be numbered as they're needed.
+template <typename Random>
+void init_board(Game *game, int width, int height, int num_treasures, int num_traps,
+                Topology topology, bool lazy, Random next);
+
+template <typename Random>
+void place_items(Game *game, int n, Item item, Random &next);
 int count_items(Game *game, Item item);
 void check_invariants(Game *game);
 void number_cells(Game *game);
-int count_adjacent_items(Game *game, Cell *cell, Item item);
-std::vector<Cell *> Game_neighbors(Game* game, Cell *cell);
+
+// The num_adjacent_traps of cells not yet numbered
+const int UNNUMBERED = -2;
+
+// EFFECTS: Numbers every cell of the board not yet numbered.
+void number_board(const Game *game);
+
+// EFFECTS: Numbers the cell if it hasn't been yet. Memoizing the number
+//          doesn't change anything observable, so it's allowed on a const
+//          Game.
+void number_cell(const Game *game, const Cell *cell);
+
+template <typename Topology>
+void number_cell(Game *game, const Topology &topology, Cell *cell);
+
+// REQUIRES: -1 <= x <= width, -1 <= y <= height
+// EFFECTS: Returns the index in game->cells of the cell at (x,y), which
+//          may be on the border.
+ptrdiff_t cell_index(const Game *game, int x, int y);
+
+// EFFECTS: Makes game->cells a board of HIDDEN, EMPTY, unnumbered cells
+//          with its border around it.
+void init_cells(Game *game);
+
+// EFFECTS: Calls f with the policy (see below) of the game's topology.
+template <typename F>
+void with_topology(const Game *game, F f);
+
+template <typename Topology>
+void number_cells_in(Game *game, const Topology &topology);
+
+// REQUIRES: item != EMPTY (border cells are EMPTY)
+template <typename Topology>
+int count_adjacent_items(Game *game, const Topology &topology, Cell *cell, Item item);
+
+// REQUIRES: the cell was just opened by open_cell(), which returned true
+// EFFECTS: Reveals the cell's neighbors, and the neighbors of those with no
+//          adjacent traps, and so on.
+template <typename Topology>
+void reveal_neighbors(Game *game, const Topology &topology, Cell *cell);
+
+// EFFECTS: Marks the cell revealed and updates the counts. Returns true if
+//          its neighbors should be revealed next.
+bool open_cell(Game *game, Cell *cell);
+
+// EFFECTS: Returns true if revealing the cell reveals its neighbors: it's
+//          on the board, isn't a trap and has no adjacent traps.
+bool opens_neighbors(const Cell *cell);
+
+template <typename Topology>
+GameDifficulty difficulty_of(Game *game, const Topology &topology);
+
+// EFFECTS: Joins the sets of a and b in the union-find forest parent.
+//          Returns false if they were already the same set.
+bool unite(std::vector<int> &parent, int a, int b);
+
+template <typename Topology>
+void index_openings(Game *game, const Topology &topology);
+
+// EFFECTS: Calls f with each opening the cell is part of, once each. The
+//          openings must already be in game->opening_of.
+template <typename Topology, typename F>
+void for_each_opening(Game *game, const Topology &topology, Cell *cell, F f);
+
+// EFFECTS: Opens every cell of the indexed opening not yet revealed.
+void reveal_opening(Game *game, int opening);
+
+// EFFECTS: Sorts the positions by x and then y, using the game's scratch
+//          space for it.
+void sort_positions(Game *game, std::vector<std::pair<int, int>>::iterator begin,
+                    std::vector<std::pair<int, int>>::iterator end);
 
 // A private overload of the Game_cell() function that may be used when the
 // Game is not const-qualified and allows modification of cells via the returned
@@ -26,65 +108,276 @@ std::vector<Cell *> Game_neighbors(Game* game, Cell *cell);
 Cell * Game_cell(Game *game, int x, int y);
 
 
+////////////////////////////////////////////////////////////////////////
+// Board topologies. Each is a policy that turns a table of neighbor  //
+// offsets from Game.hpp into offsets in game->cells when it's made   //
+// for a game, and has a neighbor() function that applies one of      //
+// them. The functions that visit neighbors are templates on the      //
+// policy, so each topology gets its own specialized loops, and the   //
+// game's topology is only checked once per operation, by             //
+// with_topology().                                                   //
+//                                                                    //
+// Thanks to the border, a neighbor is just the cell at an offset,    //
+// with no bounds checks. A neighbor off the board is a border cell,  //
+// which is EMPTY and REVEALED, so it's never counted as a trap or    //
+// revealed.                                                          //
+//                                                                    //
+// Neighbors are listed in order of dx and then dy, which is the      //
+// order Game_reveal() opens them in.                                 //
+////////////////////////////////////////////////////////////////////////
+
+struct RectTopology {
+  static constexpr int NUM_NEIGHBORS = GAME_RECT_NUM_NEIGHBORS;
+  ptrdiff_t index_offsets[NUM_NEIGHBORS];
+
+  explicit RectTopology(const Game *game) {
+    for(int i = 0; i < NUM_NEIGHBORS; ++i) {
+      index_offsets[i] = cell_index(game, GAME_RECT_OFFSETS[i][0], GAME_RECT_OFFSETS[i][1])
+                       - cell_index(game, 0, 0);
+    }
+  }
+
+  // REQUIRES: cell is on the board
+  // EFFECTS: Returns neighbor i of the cell, which may be a border cell.
+  Cell * neighbor(Game *, Cell *cell, int i) const {
+    return cell + index_offsets[i];
+  }
+};
+
+struct TorusTopology {
+  static constexpr int NUM_NEIGHBORS = RectTopology::NUM_NEIGHBORS;
+  RectTopology rect;
+
+  explicit TorusTopology(const Game *game) : rect(game) { }
+
+  // Away from the edges, a torus is the same as a rect board. Neighbors
+  // off one edge wrap around to the opposite edge instead of the border.
+  Cell * neighbor(Game *game, Cell *cell, int i) const {
+    if (0 < cell->x && cell->x < game->width - 1 && 0 < cell->y && cell->y < game->height - 1) {
+      return rect.neighbor(game, cell, i);
+    }
+    int nx = cell->x + GAME_RECT_OFFSETS[i][0];
+    int ny = cell->y + GAME_RECT_OFFSETS[i][1];
+    nx += nx < 0 ? game->width : nx >= game->width ? -game->width : 0;
+    ny += ny < 0 ? game->height : ny >= game->height ? -game->height : 0;
+    return Game_cell(game, nx, ny);
+  }
+};
+
+struct HexTopology {
+  static constexpr int NUM_NEIGHBORS = GAME_HEX_NUM_NEIGHBORS;
+  ptrdiff_t index_offsets[2][NUM_NEIGHBORS]; // indexed by y % 2
+
+  explicit HexTopology(const Game *game) {
+    for(int row = 0; row < 2; ++row) {
+      for(int i = 0; i < NUM_NEIGHBORS; ++i) {
+        index_offsets[row][i] = cell_index(game, GAME_HEX_OFFSETS[row][i][0],
+                                           GAME_HEX_OFFSETS[row][i][1])
+                              - cell_index(game, 0, 0);
+      }
+    }
+  }
+
+  Cell * neighbor(Game *, Cell *cell, int i) const {
+    return cell + index_offsets[cell->y & 1][i];
+  }
+};
+
+template <typename F>
+void with_topology(const Game *game, F f) {
+  switch (game->topology) {
+  case TOPOLOGY_RECT:
+    f(RectTopology(game));
+    break;
+  case TOPOLOGY_TORUS:
+    f(TorusTopology(game));
+    break;
+  case TOPOLOGY_HEX:
+    f(HexTopology(game));
+    break;
+  }
+}
+
+
 /////////////////////////////////////////////////////////
 // Definitions (implementations) of Game ADT Functions //
 /////////////////////////////////////////////////////////
 
 
-void Game_init(Game* game, int width, int height, int num_treasures, int num_traps) {
+void Game_init(Game* game, int width, int height, int num_treasures, int num_traps,
+               Topology topology) {
+  init_board(game, width, height, num_treasures, num_traps, topology, false,
+             [] { return rand(); });
+}
+
+void Game_init_lazy(Game* game, int width, int height, int num_treasures, int num_traps,
+                    Topology topology) {
+  init_board(game, width, height, num_treasures, num_traps, topology, true,
+             [] { return rand(); });
+}
+
+void Game_init_seeded(Game* game, unsigned seed, int width, int height, int num_treasures,
+                      int num_traps, Topology topology) {
+  std::mt19937 generator(seed);
+  // Only the low 31 bits, like rand(), so both place items the same way
+  init_board(game, width, height, num_treasures, num_traps, topology, false,
+             [&generator] { return static_cast<int>(generator() >> 1); });
+}
+
+template <typename Random>
+void init_board(Game *game, int width, int height, int num_treasures, int num_traps,
+                Topology topology, bool lazy, Random next) {
+  STATS_TIME(STAT_GAME_INIT);
+  TRACE_SPAN("Game_init");
+  // Smaller tori would make some cells their own neighbors.
+  assert(topology != TOPOLOGY_TORUS || (width >= 3 && height >= 3));
   game->width = width;
   game->height = height;
-  game->cells = std::vector<std::vector<Cell>>(
-    width, std::vector<Cell>(height, Cell{})
-  );
-  for(int x = 0; x < width; x++) {
-    for(int y = 0; y < height; y++) {
-      *Game_cell(game, x, y) = {x, y, EMPTY, HIDDEN, false, 0};
-    }
-  }
+  game->topology = topology;
+  init_cells(game);
+  game->opening_of.clear();
+  game->opening_starts.clear();
+  game->opening_cells.clear();
 
   game->num_treasures = num_treasures;
   game->num_treasures_found = 0;
   game->num_traps = num_traps;
   game->num_traps_found = 0;
+  game->num_revealed = 0;
+  game->num_flags = 0;
+  game->changes.clear();
+
+  place_items(game, num_treasures, TREASURE, next);
+  place_items(game, num_traps, TRAP, next);
+  game->numbered = false;
+  if (!lazy) {
+    number_cells(game);
+  }
 
-  place_items(game, num_treasures, TREASURE);
-  place_items(game, num_traps, TRAP);
-  number_cells(game);
+  check_invariants(game);
+}
+
+void Game_init_packed(Game* game, int width, int height, Topology topology,
+                      const unsigned char *cells) {
+  STATS_TIME(STAT_GAME_INIT);
+  TRACE_SPAN("Game_init");
+  game->width = width;
+  game->height = height;
+  game->topology = topology;
+  init_cells(game);
+  game->opening_of.clear();
+  game->opening_starts.clear();
+  game->opening_cells.clear();
+  game->num_treasures = 0;
+  game->num_treasures_found = 0;
+  game->num_traps = 0;
+  game->num_traps_found = 0;
+  game->num_revealed = 0;
+  game->num_flags = 0;
+  game->changes.clear();
+  for(int x = 0; x < width; x++) {
+    for(int y = 0; y < height; y++) {
+      Cell *cell = Game_cell(game, x, y);
+      unsigned char byte = *cells++;
+      cell->state = static_cast<CellState>(byte >> 6);
+      cell->item = static_cast<Item>(byte >> 4 & 3);
+      cell->num_adjacent_traps = byte & 0xf;
+      bool revealed = cell->state == REVEALED;
+      if (cell->item == TREASURE) {
+        ++game->num_treasures;
+        game->num_treasures_found += revealed;
+      }
+      else if (cell->item == TRAP) {
+        ++game->num_traps;
+        game->num_traps_found += revealed;
+      }
+      game->num_revealed += revealed;
+      game->num_flags += cell->state == FLAG;
+    }
+  }
+  game->numbered = true;
 
   check_invariants(game);
 }
 
 void Game_init(Game *game, std::istream &is) {
+  STATS_TIME(STAT_GAME_LOAD);
+  TRACE_SPAN("Game_load");
   is >> game->width;
   is >> game->height;
-  game->cells = std::vector<std::vector<Cell>>(
-    game->width, std::vector<Cell>(game->height, Cell{})
-  );
+  // The topology follows the size, except for TOPOLOGY_RECT, which saved
+  // games from before there were topologies don't give.
+  std::string topology;
+  std::getline(is, topology);
+  topology.erase(0, topology.find_first_not_of(" \t"));
+  topology.erase(topology.find_last_not_of(" \t\r") + 1);
+  game->topology = TOPOLOGY_RECT;
+  if (!topology.empty() && !Game_parse_topology(topology, game->topology)) {
+    assert(false && "unknown topology");
+  }
+  init_cells(game);
+  game->opening_of.clear();
+  game->opening_starts.clear();
+  game->opening_cells.clear();
+
+  // Tally everything while reading, so no further passes over the board
+  // are needed afterward.
+  game->num_treasures = 0;
+  game->num_treasures_found = 0;
+  game->num_traps = 0;
+  game->num_traps_found = 0;
+  game->num_revealed = 0;
+  game->num_flags = 0;
+  game->changes.clear();
   for(int x = 0; x < game->width; ++x) {
     for(int y = 0; y < game->height; ++y) {
-      is >> *Game_cell(game, x, y);
+      Cell *cell = Game_cell(game, x, y);
+      is >> *cell;
+      bool revealed = cell->state == REVEALED;
+      if (cell->item == TREASURE) {
+        ++game->num_treasures;
+        game->num_treasures_found += revealed;
+      }
+      else if (cell->item == TRAP) {
+        ++game->num_traps;
+        game->num_traps_found += revealed;
+      }
+      game->num_revealed += revealed;
+      game->num_flags += cell->state == FLAG;
     }
   }
-
-  game->num_treasures = count_items(game, TREASURE);
-  game->num_treasures_found = 0;
-  game->num_traps = count_items(game, TRAP);
-  game->num_traps_found = 0;
+  game->numbered = true;
 
   check_invariants(game);
 }
 
 void Game_save(const Game *game, std::ostream &out) {
-  out << game->width << " " << game->height << std::endl;
+  STATS_TIME(STAT_GAME_SAVE);
+  TRACE_SPAN("Game_save");
+  out << game->width << " " << game->height;
+  if (game->topology != TOPOLOGY_RECT) {
+    out << " " << Game_topology_name(game->topology);
+  }
+  out << std::endl;
+  number_board(game);
   for(int x = 0; x < game->width; ++x) {
     for(int y = 0; y < game->height; ++y) {
-      out << game->cells[x][y] << " ";
+      out << *Game_cell(game, x, y) << " ";
     }
     out << std::endl;
   }
 }
 
+void Game_pack_board(const Game *game, unsigned char *cells) {
+  number_board(game);
+  for(int x = 0; x < game->width; x++) {
+    for(int y = 0; y < game->height; y++) {
+      const Cell *cell = Game_cell(game, x, y);
+      *cells++ = cell->state << 6 | cell->item << 4 | cell->num_adjacent_traps;
+    }
+  }
+}
+
 int Game_width(const Game *game) {
   return game->width;
 }
@@ -93,6 +386,31 @@ int Game_height(const Game *game) {
   return game->height;
 }
 
+Topology Game_topology(const Game *game) {
+  return game->topology;
+}
+
+std::string Game_topology_name(Topology topology) {
+  switch (topology) {
+  case TOPOLOGY_TORUS:
+    return "torus";
+  case TOPOLOGY_HEX:
+    return "hex";
+  default:
+    return "rect";
+  }
+}
+
+bool Game_parse_topology(const std::string &name, Topology &topology) {
+  for(Topology candidate : {TOPOLOGY_RECT, TOPOLOGY_TORUS, TOPOLOGY_HEX}) {
+    if (name == Game_topology_name(candidate)) {
+      topology = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
 int Game_num_treasures(const Game *game) {
   return game->num_treasures;
 }
@@ -109,6 +427,14 @@ int Game_num_traps_found(const Game *game) {
   return game->num_traps_found;
 }
 
+int Game_num_revealed(const Game *game) {
+  return game->num_revealed;
+}
+
+int Game_num_flags(const Game *game) {
+  return game->num_flags;
+}
+
 bool Game_in_bounds(const Game* game, int x, int y) {
   return 0 <= x && x < game->width && 0 <= y && y < game->height;
 }
@@ -119,84 +445,375 @@ bool Game_is_over(const Game *game) {
 
 Cell * Game_cell(Game* game, int x, int y) {
   assert(Game_in_bounds(game, x, y));
-  return &game->cells[x][y];
+  return &game->cells[cell_index(game, x, y)];
 }
 
 const Cell * Game_cell(const Game* game, int x, int y) {
   assert(Game_in_bounds(game, x, y));
-  return &game->cells[x][y];
+  const Cell *cell = &game->cells[cell_index(game, x, y)];
+  number_cell(game, cell);
+  return cell;
+}
+
+GameView Game_view(const Game *game, int x, int y, int width, int height) {
+  assert(width >= 0 && height >= 0);
+  assert(width == 0 || height == 0 ||
+         (Game_in_bounds(game, x, y) && Game_in_bounds(game, x + width - 1, y + height - 1)));
+  GameView view = {x, y, width, height, &game->cells[cell_index(game, x, y)],
+                   game->height + 2, 1};
+  if (!game->numbered) {
+    Game *board = const_cast<Game *>(game);
+    with_topology(game, [board, &view](auto topology) {
+      for(int i = 0; i < view.width; i++) {
+        for(int j = 0; j < view.height; j++) {
+          number_cell(board, topology, const_cast<Cell *>(GameView_cell(&view, i, j)));
+        }
+      }
+    });
+  }
+  return view;
 }
 
 void Game_reveal(Game* game, int x, int y) {
+  STATS_TIME(STAT_GAME_REVEAL);
+  TraceSpan span("Game_reveal");
+  // The invariants are checked once per move rather than at every step of
+  // the reveal, which would make large reveals quadratic.
   check_invariants(game);
-
+  game->changes.clear();
+  // Most reveals open a single numbered cell, and don't need the topology.
   Cell *cell = Game_cell(game, x, y);
+  if (cell->state != REVEALED && open_cell(game, cell)) {
+    if (!game->opening_of.empty()) {
+      reveal_opening(game, game->opening_of[cell - game->cells.data()]);
+    }
+    else {
+      with_topology(game, [game, cell](auto topology) {
+        reveal_neighbors(game, topology, cell);
+      });
+      // The search finds the opening in no particular order
+      sort_positions(game, game->changes.begin() + 1, game->changes.end());
+    }
+  }
+  check_invariants(game);
+  Trace_arg(&span, "cells", game->changes.size());
+}
 
-  // do nothing if already revealed
-  if (cell->state == REVEALED) {
-    return;
+template <typename Topology>
+void reveal_neighbors(Game *game, const Topology &topology, Cell *cell) {
+  // The flood fill is a depth-first search, like calling Game_reveal() on
+  // each neighbor in turn, but with an explicit stack so that large
+  // openings can't overflow the call stack. Each entry is a cell whose
+  // neighbors are being revealed, and the index of the next neighbor (in
+  // the topology's order) to look at.
+  std::vector<std::pair<Cell *, int>> &stack = game->reveal_stack;
+  stack.emplace_back(cell, 0);
+  while (!stack.empty()) {
+    Cell *current = stack.back().first;
+    int &next = stack.back().second;
+    Cell *neighbor = nullptr;
+    for(; next < Topology::NUM_NEIGHBORS && !neighbor; ++next) {
+      Cell *candidate = topology.neighbor(game, current, next);
+      // If an empty or treasure cell is revealed and has no adjacent
+      // traps, reveal all adjacent empty or treasure cells as well. (Border
+      // cells are already REVEALED.)
+      if (candidate->state != REVEALED && (candidate->item == EMPTY || candidate->item == TREASURE)) {
+        neighbor = candidate;
+      }
+    }
+    if (!neighbor) {
+      stack.pop_back();
+    }
+    else {
+      number_cell(game, topology, neighbor);
+      if (open_cell(game, neighbor)) {
+        stack.emplace_back(neighbor, 0);
+      }
+    }
   }
+}
 
+bool open_cell(Game *game, Cell *cell) {
+  number_cell(game, cell);
+  if (cell->state == FLAG) {
+    --game->num_flags;
+  }
   cell->state = REVEALED;
+  ++game->num_revealed;
+  game->changes.emplace_back(cell->x, cell->y);
 
   if (cell->item == TRAP) {
     ++game->num_traps_found;
-    return;
+    return false;
   }
   
   if (cell->item == TREASURE) {
     ++game->num_treasures_found;
-    if (Game_is_over(game)) {
-      return; // return early if we got all the treasures
+  }
+  return cell->num_adjacent_traps == 0;
+}
+
+void Game_index_openings(Game *game) {
+  // Cells are listed by int index, to keep the index small
+  assert(game->cells.size() <= INT_MAX);
+  number_board(game);
+  with_topology(game, [game](auto topology) {
+    index_openings(game, topology);
+  });
+}
+
+template <typename Topology>
+void index_openings(Game *game, const Topology &topology) {
+  // Label the cells that open their neighbors, one search per opening
+  game->opening_of.assign(game->cells.size(), -1);
+  int num_openings = 0;
+  std::vector<Cell *> stack;
+  for(int x = 0; x < game->width; x++) {
+    for(int y = 0; y < game->height; y++) {
+      Cell *cell = Game_cell(game, x, y);
+      if (!opens_neighbors(cell) || game->opening_of[cell - game->cells.data()] != -1) {
+        continue;
+      }
+      game->opening_of[cell - game->cells.data()] = num_openings;
+      stack.push_back(cell);
+      while (!stack.empty()) {
+        Cell *current = stack.back();
+        stack.pop_back();
+        for(int i = 0; i < Topology::NUM_NEIGHBORS; ++i) {
+          Cell *neighbor = topology.neighbor(game, current, i);
+          int &opening = game->opening_of[neighbor - game->cells.data()];
+          if (opening == -1 && opens_neighbors(neighbor)) {
+            opening = num_openings;
+            stack.push_back(neighbor);
+          }
+        }
+      }
+      ++num_openings;
+    }
+  }
+
+  // Then list the cells of each opening, counting them first. Going over
+  // the board in order lists them in order of x and then y.
+  game->opening_starts.assign(num_openings + 1, 0);
+  for(int x = 0; x < game->width; x++) {
+    for(int y = 0; y < game->height; y++) {
+      for_each_opening(game, topology, Game_cell(game, x, y), [game](int opening) {
+        ++game->opening_starts[opening + 1];
+      });
+    }
+  }
+  for(int i = 0; i < num_openings; ++i) {
+    game->opening_starts[i + 1] += game->opening_starts[i];
+  }
+  game->opening_cells.resize(game->opening_starts[num_openings]);
+  std::vector<int> next(game->opening_starts.begin(), game->opening_starts.end() - 1);
+  for(int x = 0; x < game->width; x++) {
+    for(int y = 0; y < game->height; y++) {
+      Cell *cell = Game_cell(game, x, y);
+      int index = cell - game->cells.data();
+      for_each_opening(game, topology, cell, [game, &next, index](int opening) {
+        game->opening_cells[next[opening]++] = index;
+      });
+    }
+  }
+}
+
+template <typename Topology, typename F>
+void for_each_opening(Game *game, const Topology &topology, Cell *cell, F f) {
+  int own = game->opening_of[cell - game->cells.data()];
+  if (own != -1) {
+    f(own);
+    return;
+  }
+  if (cell->item == TRAP) {
+    return;
+  }
+  // A numbered cell is part of the openings of its neighbors that open
+  // theirs, which may be more than one.
+  int found[Topology::NUM_NEIGHBORS];
+  int num_found = 0;
+  for(int i = 0; i < Topology::NUM_NEIGHBORS; ++i) {
+    int opening = game->opening_of[topology.neighbor(game, cell, i) - game->cells.data()];
+    if (opening != -1 && std::find(found, found + num_found, opening) == found + num_found) {
+      found[num_found++] = opening;
+      f(opening);
+    }
+  }
+}
+
+void reveal_opening(Game *game, int opening) {
+  for(int i = game->opening_starts[opening]; i < game->opening_starts[opening + 1]; ++i) {
+    Cell *cell = &game->cells[game->opening_cells[i]];
+    if (cell->state != REVEALED) {
+      open_cell(game, cell);
     }
   }
+}
+
+void sort_positions(Game *game, std::vector<std::pair<int, int>>::iterator begin,
+                    std::vector<std::pair<int, int>>::iterator end) {
+  if (end - begin < 2) {
+    return;
+  }
+  // A counting sort by y and then (keeping that order) by x, in time
+  // linear in the number of positions plus the ranges of x and y. An
+  // opening is connected, so on a rectangle or hex board the ranges are no
+  // bigger than the number of positions. On a torus an opening can wrap
+  // around an edge, and a few positions can span the whole board, so the
+  // ranges are only bounded by the width and height.
+  int min_x = begin->first;
+  int max_x = begin->first;
+  int min_y = begin->second;
+  int max_y = begin->second;
+  for(auto pos = begin; pos != end; ++pos) {
+    min_x = std::min(min_x, pos->first);
+    max_x = std::max(max_x, pos->first);
+    min_y = std::min(min_y, pos->second);
+    max_y = std::max(max_y, pos->second);
+  }
+  std::vector<std::pair<int, int>> &sorted_by_y = game->reveal_sorted;
+  std::vector<int> &starts = game->reveal_starts;
+  sorted_by_y.resize(end - begin);
+  starts.assign(max_y - min_y + 2, 0);
+  for(auto pos = begin; pos != end; ++pos) {
+    ++starts[pos->second - min_y + 1];
+  }
+  std::partial_sum(starts.begin(), starts.end(), starts.begin());
+  for(auto pos = begin; pos != end; ++pos) {
+    sorted_by_y[starts[pos->second - min_y]++] = *pos;
+  }
+  starts.assign(max_x - min_x + 2, 0);
+  for(const std::pair<int, int> &pos : sorted_by_y) {
+    ++starts[pos.first - min_x + 1];
+  }
+  std::partial_sum(starts.begin(), starts.end(), starts.begin());
+  for(const std::pair<int, int> &pos : sorted_by_y) {
+    begin[starts[pos.first - min_x]++] = pos;
+  }
+}
+
+bool opens_neighbors(const Cell *cell) {
+  // Border cells have -1 adjacent traps
+  return cell->item != TRAP && cell->num_adjacent_traps == 0;
+}
 
-  // If an empty or treasure cell is revealed and has no adjacent traps,
-  // reveal all adjacent empty or treasure cells as well.
-  if (cell->num_adjacent_traps == 0) {
-    for(Cell *neighbor : Game_neighbors(game, cell)) {
-      if (neighbor->state != REVEALED && (neighbor->item == EMPTY || neighbor->item == TREASURE)) {
-        Game_reveal(game, neighbor->x, neighbor->y);
+GameDifficulty Game_difficulty(const Game *game) {
+  GameDifficulty difficulty;
+  // The topologies work on non-const games, but nothing is modified here
+  // besides numbering cells not yet numbered.
+  number_board(game);
+  Game *board = const_cast<Game *>(game);
+  with_topology(game, [board, &difficulty](auto topology) {
+    difficulty = difficulty_of(board, topology);
+  });
+  return difficulty;
+}
+
+template <typename Topology>
+GameDifficulty difficulty_of(Game *game, const Topology &topology) {
+  // Cells that open their neighbors are joined to the ones next to them
+  // already passed, so each join of two sets merges two openings that had
+  // been counted separately.
+  std::vector<int> parent(game->cells.size());
+  int num_opening_cells = 0;
+  int num_joins = 0;
+  int num_isolated_numbers = 0;
+  for(int x = 0; x < game->width; x++) {
+    for(int y = 0; y < game->height; y++) {
+      Cell *cell = Game_cell(game, x, y);
+      int index = cell - game->cells.data();
+      if (opens_neighbors(cell)) {
+        ++num_opening_cells;
+        parent[index] = index;
+        for(int i = 0; i < Topology::NUM_NEIGHBORS; ++i) {
+          Cell *neighbor = topology.neighbor(game, cell, i);
+          int neighbor_index = neighbor - game->cells.data();
+          if (neighbor_index < index && opens_neighbors(neighbor)) {
+            num_joins += unite(parent, index, neighbor_index);
+          }
+        }
+      }
+      else if (cell->item != TRAP) {
+        bool isolated = true;
+        for(int i = 0; i < Topology::NUM_NEIGHBORS; ++i) {
+          isolated &= !opens_neighbors(topology.neighbor(game, cell, i));
+        }
+        num_isolated_numbers += isolated;
       }
     }
   }
-  
-  check_invariants(game);
+  int num_openings = num_opening_cells - num_joins;
+  return {num_openings + num_isolated_numbers, num_openings, num_isolated_numbers};
+}
+
+bool unite(std::vector<int> &parent, int a, int b) {
+  // Find the roots, halving the paths to them on the way
+  while (parent[a] != a) {
+    a = parent[a] = parent[parent[a]];
+  }
+  while (parent[b] != b) {
+    b = parent[b] = parent[parent[b]];
+  }
+  if (a == b) {
+    return false;
+  }
+  parent[std::max(a, b)] = std::min(a, b);
+  return true;
+}
+
+std::vector<GameDifficulty> Game_rate_seeds(const std::vector<unsigned> &seeds, int width,
+                                            int height, int num_treasures, int num_traps,
+                                            Topology topology, int num_threads) {
+  assert(num_threads > 0);
+  std::vector<GameDifficulty> ratings(seeds.size());
+  num_threads = std::max(1, std::min<int>(num_threads, seeds.size()));
+  // Each thread rates its own share of the seeds, in a Game of its own.
+  auto rate = [&](int t) {
+    Game game;
+    size_t end = seeds.size() * (t + 1) / num_threads;
+    for(size_t i = seeds.size() * t / num_threads; i < end; ++i) {
+      Game_init_seeded(&game, seeds[i], width, height, num_treasures, num_traps, topology);
+      ratings[i] = Game_difficulty(&game);
+    }
+  };
+  std::vector<std::thread> threads;
+  for(int t = 1; t < num_threads; ++t) {
+    threads.emplace_back(rate, t);
+  }
+  rate(0);
+  for(std::thread &thread : threads) {
+    thread.join();
+  }
+  return ratings;
 }
 
 void Game_toggle_flag(Game* game, int x, int y) {
+  STATS_TIME(STAT_GAME_TOGGLE_FLAG);
+  game->changes.clear();
   Cell *cell = Game_cell(game, x, y);
   if (cell->state == HIDDEN) {
     cell->state = FLAG;
+    ++game->num_flags;
+    game->changes.emplace_back(x, y);
   }
   else if (cell->state == FLAG) {
     cell->state = HIDDEN;
+    --game->num_flags;
+    game->changes.emplace_back(x, y);
   }
   // else do nothing if it's REVEALED
 }
 
-std::vector<Cell *> Game_neighbors(Game* game, Cell *cell) {
-  std::vector<Cell *> neighbors;
-  for(int dx = -1; dx <= 1; ++dx) {
-    for(int dy = -1; dy <= 1; ++dy) {
-      int nx = cell->x + dx;
-      int ny = cell->y + dy;
-      if (Game_in_bounds(game, nx, ny)) {
-        Cell *neighbor = Game_cell(game, nx, ny);
-        if (neighbor != cell) { // don't include self
-          neighbors.push_back(neighbor);
-        }
-      }
-    } 
-  }
-  return neighbors;
+const std::vector<std::pair<int, int>> & Game_changes(const Game *game) {
+  return game->changes;
 }
 
-void place_items(Game *game, int n, Item item) {
+template <typename Random>
+void place_items(Game *game, int n, Item item, Random &next) {
   int num_placed = 0;
   while(num_placed < n) {
-    int x = rand() % game->width;
-    int y = rand() % game->height;
+    int x = next() % game->width;
+    int y = next() % game->height;
     Cell *cell = Game_cell(game, x, y);
     if(cell->item == EMPTY) {
       cell->item = item;
@@ -206,42 +823,110 @@ void place_items(Game *game, int n, Item item) {
 }
 
 void number_cells(Game *game) {
+  with_topology(game, [game](auto topology) {
+    number_cells_in(game, topology);
+  });
+  game->numbered = true;
+}
+
+void number_board(const Game *game) {
+  if (!game->numbered) {
+    number_cells(const_cast<Game *>(game));
+  }
+}
+
+void number_cell(const Game *game, const Cell *cell) {
+  if (cell->num_adjacent_traps == UNNUMBERED) {
+    Game *board = const_cast<Game *>(game);
+    with_topology(game, [board, cell](auto topology) {
+      number_cell(board, topology, const_cast<Cell *>(cell));
+    });
+  }
+}
+
+template <typename Topology>
+void number_cell(Game *game, const Topology &topology, Cell *cell) {
+  if (cell->num_adjacent_traps == UNNUMBERED) {
+    cell->num_adjacent_traps = count_adjacent_items(game, topology, cell, TRAP);
+  }
+}
+
+template <typename Topology>
+void number_cells_in(Game *game, const Topology &topology) {
   for(int x = 0; x < game->width; x++) {
     for(int y = 0; y < game->height; y++) {
       Cell *cell = Game_cell(game, x, y);
-      int n_traps = count_adjacent_items(game, cell, TRAP);
-      assert(0 <= n_traps && n_traps <= 8);
+      int n_traps = count_adjacent_items(game, topology, cell, TRAP);
+      assert(0 <= n_traps && n_traps <= Topology::NUM_NEIGHBORS);
       cell->num_adjacent_traps = n_traps;
     }
   }
 }
 
-int count_adjacent_items(Game *game, Cell *cell, Item item) {
+template <typename Topology>
+int count_adjacent_items(Game *game, const Topology &topology, Cell *cell, Item item) {
   int count = 0;
-  for(const Cell *neighbor : Game_neighbors(game, cell)) {
-    if(neighbor->item == item) {
-      ++count;
-    }
+  for(int i = 0; i < Topology::NUM_NEIGHBORS; ++i) {
+    count += topology.neighbor(game, cell, i)->item == item;
   }
   return count;
 }
 
-void check_invariants(Game *game) {
-  assert(game->cells.size() == game->width);
-  for(int x = 0; x < game->width; x++) {
-    assert(game->cells[x].size() == game->height);
+ptrdiff_t cell_index(const Game *game, int x, int y) {
+  return static_cast<ptrdiff_t>(x + 1) * (game->height + 2) + y + 1;
+}
+
+void init_cells(Game *game) {
+  // The cells are appended in order of their index, so each is written
+  // only once.
+  game->cells.clear();
+  game->cells.reserve(static_cast<size_t>(game->width + 2) * (game->height + 2));
+  for(int x = -1; x <= game->width; x++) {
+    for(int y = -1; y <= game->height; y++) {
+      // Border cells are never counted as traps, revealed or opened
+      if (Game_in_bounds(game, x, y)) {
+        game->cells.push_back({x, y, EMPTY, HIDDEN, false, UNNUMBERED});
+      }
+      else {
+        game->cells.push_back({x, y, EMPTY, REVEALED, false, -1});
+      }
+    }
   }
-  assert(count_items(game, EMPTY) + count_items(game, TREASURE) + count_items(game, TRAP) == game->width * game->height);
-  
+}
+
+// Only the checks of the counts run on every move. Those that look at the
+// whole board are compiled in with -DPIRATE_CHECK_BOARD (`make CHECK=1`).
+void check_invariants(Game *game) {
+  assert(game->cells.size() == static_cast<size_t>(game->width + 2) * (game->height + 2));
+  #if !defined(NDEBUG) && defined(PIRATE_CHECK_BOARD)
+    for(int x = -1; x <= game->width; x++) {
+      for(int y : {-1, game->height}) {
+        const Cell &above_or_below = game->cells[cell_index(game, x, y)];
+        assert(above_or_below.item == EMPTY && above_or_below.state == REVEALED &&
+               above_or_below.num_adjacent_traps == -1);
+      }
+    }
+    for(int y = 0; y < game->height; y++) {
+      for(int x : {-1, game->width}) {
+        const Cell &beside = game->cells[cell_index(game, x, y)];
+        assert(beside.item == EMPTY && beside.state == REVEALED &&
+               beside.num_adjacent_traps == -1);
+      }
+    }
+    assert(count_items(game, EMPTY) + count_items(game, TREASURE) + count_items(game, TRAP) == game->width * game->height);
+    assert(count_items(game, TREASURE) == game->num_treasures);
+    assert(count_items(game, TRAP) == game->num_traps);
+    assert(count_items(game, EMPTY) == game->width * game->height - game->num_treasures - game->num_traps);
+  #endif
+
   assert(0 < game->num_treasures);
   assert(0 <= game->num_traps);
   assert(game->num_treasures + game->num_traps < game->width * game->height / 2);
-  assert(count_items(game, TREASURE) == game->num_treasures);
-  assert(count_items(game, TRAP) == game->num_traps);
-  assert(count_items(game, EMPTY) == game->width * game->height - game->num_treasures - game->num_traps);
 
   assert(0 <= game->num_treasures_found && game->num_treasures_found <= game->num_treasures);
   assert(0 <= game->num_traps_found && game->num_traps_found <= game->num_traps);
+  assert(0 <= game->num_revealed && game->num_revealed <= game->width * game->height);
+  assert(0 <= game->num_flags && game->num_flags <= game->width * game->height - game->num_revealed);
 }
 
 int count_items(Game *game, Item item) {
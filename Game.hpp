@@ -4,6 +4,8 @@
 #include <vector>
 #include <iostream>
 #include <utility>
+#include <string>
+#include <cstddef>
 
 enum Item {
   EMPTY = 0,
@@ -17,6 +19,30 @@ enum CellState {
   FLAG = 2
 };
 
+// The shape of the board, which decides which cells are neighbors
+enum Topology {
+  TOPOLOGY_RECT = 0,  // a rectangle, where cells have up to 8 neighbors
+  TOPOLOGY_TORUS = 1, // a rectangle whose opposite edges are joined, so
+                      // every cell has 8 neighbors
+  TOPOLOGY_HEX = 2,   // hexagons in rows, with the odd rows shifted half a
+                      // cell to the right, so cells have up to 6 neighbors
+};
+
+// The offsets (dx, dy) from a cell to its neighbors, in order of dx and then
+// dy. A torus has the same neighbors as a rect board, wrapping around at
+// the edges. On a hex board, the cells above and below an even row are to
+// the left (dx = -1 and 0), and for an odd row, to the right (dx = 0 and
+// 1), so its table is indexed by y % 2.
+const int GAME_RECT_NUM_NEIGHBORS = 8;
+const int GAME_RECT_OFFSETS[GAME_RECT_NUM_NEIGHBORS][2] = {
+  {-1, -1}, {-1, 0}, {-1, 1}, {0, -1}, {0, 1}, {1, -1}, {1, 0}, {1, 1},
+};
+const int GAME_HEX_NUM_NEIGHBORS = 6;
+const int GAME_HEX_OFFSETS[2][GAME_HEX_NUM_NEIGHBORS][2] = {
+  {{-1, -1}, {-1, 0}, {-1, 1}, {0, -1}, {0, 1}, {1, 0}},
+  {{-1, 0}, {0, -1}, {0, 1}, {1, -1}, {1, 0}, {1, 1}},
+};
+
 // "Plain Old Data" (POD)
 struct Cell {
   int x;
@@ -34,18 +60,92 @@ std::istream &operator>>(std::istream &out, Cell &cell);
 struct Game {
   int width;
   int height;
+  Topology topology;
   int num_treasures;
   int num_traps;
   int num_treasures_found;
   int num_traps_found;
+  int num_revealed;
+  int num_flags;
 
-  std::vector<std::vector<Cell>> cells;
-  // INVARIANT: cells.size() == width
-  // INVARIANT: cells[x].size() == height for any r
+  // The board, stored column by column with a border one cell wide all
+  // around it, so that every cell on the board has all its neighbors in
+  // memory at fixed offsets. The border is never part of the board: the
+  // functions below only take and return positions on the board.
+  std::vector<Cell> cells;
+  bool numbered;
+  // INVARIANT: cells.size() == (width + 2) * (height + 2)
+  // INVARIANT: the cell at (x,y) is cells[(x + 1) * (height + 2) + y + 1],
+  //            for -1 <= x <= width and -1 <= y <= height
+  // INVARIANT: the border cells are EMPTY and REVEALED, with
+  //            num_adjacent_traps == -1
+  // INVARIANT: cells on the board not yet numbered (see Game_init_lazy())
+  //            have num_adjacent_traps == -2, and there are none if numbered
   // INVARIANT: cells contains exactly num_treasures TREASUREs
   // INVARIANT: cells contains exactly num_traps TRAPs
+  // INVARIANT: num_treasures_found/num_traps_found are the number of
+  //            REVEALED TREASUREs/TRAPs in cells
+  // INVARIANT: num_revealed/num_flags are the number of cells in cells
+  //            with state REVEALED/FLAG
+
+  // Positions of the cells whose state was changed by the last move
+  std::vector<std::pair<int, int>> changes;
+
+  // Scratch space for Game_reveal(), kept so that its memory is reused
+  // from one move to the next: the stack of its search for an opening's
+  // cells, and the buffers it sorts their positions with
+  std::vector<std::pair<Cell *, int>> reveal_stack;
+  std::vector<std::pair<int, int>> reveal_sorted;
+  std::vector<int> reveal_starts;
+
+  // The openings of the board, if indexed by Game_index_openings(), or
+  // else empty. Opening i is made of the cells listed in
+  // opening_cells[opening_starts[i]] up to opening_cells[opening_starts[i + 1]],
+  // by their index in cells, in order of x and then y.
+  std::vector<int> opening_of; // for each of cells, the opening it opens,
+                               // or -1 (see opens_neighbors() in Game.cpp)
+  std::vector<int> opening_starts;
+  std::vector<int> opening_cells;
+};
+
+// How hard a board is, as in Minesweeper
+struct GameDifficulty {
+  int bbbv;                 // "3BV", the fewest reveals that would reveal
+                            // every cell that isn't a trap: one per opening
+                            // and one per isolated number
+  int num_openings;         // regions of connected cells with no adjacent
+                            // traps (see Game_reveal())
+  int num_isolated_numbers; // cells with adjacent traps that aren't traps
+                            // and aren't in any opening
+};
+
+// A read-only view of a rectangle of the board, for renderers and bots that
+// scan many cells. It points straight into the game's cells, so making one
+// copies nothing, and cells are reached by stepping a pointer instead of
+// calling Game_cell() for each. Cell (i,j) of the view, which is cell
+// (x + i, y + j) of the board, is origin[i * x_stride + j * y_stride] (see
+// GameView_cell()). The board is stored column by column, so y_stride is 1
+// and a column of the view is contiguous. Each field of the cells, such as
+// item, is likewise a span with strides of x_stride and y_stride Cells.
+//
+// The view shows the cells as they are, so it sees later moves, and it's
+// valid until the game is initialized or loaded again.
+struct GameView {
+  int x;
+  int y;
+  int width;
+  int height;
+  const Cell *origin; // cell (x,y) of the board
+  ptrdiff_t x_stride; // from a cell to the next one in its row, in Cells
+  ptrdiff_t y_stride; // from a cell to the next one in its column, in Cells
 };
 
+// REQUIRES: 0 <= i < view->width, 0 <= j < view->height
+// EFFECTS: Returns cell (i,j) of the view.
+inline const Cell * GameView_cell(const GameView *view, int i, int j) {
+  return view->origin + i * view->x_stride + j * view->y_stride;
+}
+
 ////////////////////////////////////////////////////////////
 // Declarations of "Public Interface" Game ADT Functions. //
 ////////////////////////////////////////////////////////////
@@ -53,20 +153,84 @@ struct Game {
 // REQUIRES: width > 0, height > 0
 //           num_treasures > 0, num_traps >= 0
 //           num_treasures + num_traps < width * height / 2
+//           width >= 3 and height >= 3 for TOPOLOGY_TORUS
 // EFFECTS: Initializes a Game with the given width and height. The specified
 //          number of treasures and traps are placed in random locations.
-void Game_init(Game* game, int width, int height, int num_treasures, int num_traps);
+void Game_init(Game* game, int width, int height, int num_treasures, int num_traps,
+               Topology topology = TOPOLOGY_RECT);
+
+// REQUIRES: same as Game_init() above
+// EFFECTS: Same as Game_init() above, except that the items are placed by
+//          a generator of its own seeded with seed, rather than rand(). The
+//          same seed always makes the same board (on any platform), and
+//          boards can be made on several threads at once.
+void Game_init_seeded(Game* game, unsigned seed, int width, int height, int num_treasures,
+                      int num_traps, Topology topology = TOPOLOGY_RECT);
+
+// REQUIRES: same as Game_init() above
+// EFFECTS: Same as Game_init() above, except that the cells are numbered
+//          one at a time, the first time each is revealed or looked at with
+//          Game_cell(), instead of all at once. Making the board then costs
+//          only allocating it and placing the items, so it's much quicker
+//          for big boards, where most cells are never revealed. Saving the
+//          game, rating it or indexing its openings numbers every cell.
+void Game_init_lazy(Game* game, int width, int height, int num_treasures, int num_traps,
+                    Topology topology = TOPOLOGY_RECT);
+
+// REQUIRES: cells holds width * height bytes written by Game_pack_board()
+//          for a board of this size and topology
+// EFFECTS: Initializes a Game from a packed board. The items, numbers and
+//          states of the cells are read, not generated, and the counts of
+//          found items, revealed cells and flags are restored from them.
+void Game_init_packed(Game* game, int width, int height, Topology topology,
+                      const unsigned char *cells);
 
+// REQUIRES: in contains a game written by Game_save()
+// EFFECTS: Initializes a Game from the saved board in the given stream. All
+//          counts of items, found items, revealed cells and flags are
+//          restored while the board is read.
 void Game_init(Game* game, std::istream &in);
 
 void Game_save(const Game* game, std::ostream &out);
 
+// EFFECTS: Writes the board to cells as width * height bytes, one per cell
+//          in order of x and then y: the number of adjacent traps, plus the
+//          Item times 16, plus the CellState times 64.
+void Game_pack_board(const Game *game, unsigned char *cells);
+
+// EFFECTS: Finds every opening on the board and keeps an index of them, so
+//          that Game_reveal() can reveal an opening in one pass over its
+//          cells rather than searching for them. Costs about 8 bytes per
+//          cell. The index lasts until the Game is initialized again.
+void Game_index_openings(Game *game);
+
+// EFFECTS: Rates the board, in one pass over it. Ignores what has been
+//          revealed or flagged.
+GameDifficulty Game_difficulty(const Game *game);
+
+// REQUIRES: num_threads > 0, and the other arguments are as for Game_init()
+// EFFECTS: Rates the board Game_init_seeded() makes from each seed, on up to
+//          num_threads threads, and returns the ratings in the same order.
+std::vector<GameDifficulty> Game_rate_seeds(const std::vector<unsigned> &seeds, int width,
+                                            int height, int num_treasures, int num_traps,
+                                            Topology topology, int num_threads);
+
 // EFFECTS: returns the width of the game board
 int Game_width(const Game *game);
 
 // EFFECTS: returns the height of the game board
 int Game_height(const Game *game);
 
+// EFFECTS: returns the shape of the game board
+Topology Game_topology(const Game *game);
+
+// EFFECTS: Returns the name of the topology: "rect", "torus" or "hex".
+std::string Game_topology_name(Topology topology);
+
+// EFFECTS: Sets topology to the one with the given name and returns true,
+//          or returns false if there is none.
+bool Game_parse_topology(const std::string &name, Topology &topology);
+
 // EFFECTS: returns the number of treasures in the game
 int Game_num_treasures(const Game *game);
 
@@ -79,6 +243,12 @@ int Game_num_treasures_found(const Game *game);
 // EFFECTS: returns the number of traps in the game
 int Game_num_traps_found(const Game *game);
 
+// EFFECTS: returns the number of cells that have been revealed
+int Game_num_revealed(const Game *game);
+
+// EFFECTS: returns the number of cells that are currently flagged
+int Game_num_flags(const Game *game);
+
 // EFFECTS: Returns true if (x,y) is the position of a valid cell.
 bool Game_in_bounds(const Game* game, int x, int y);
 
@@ -87,14 +257,23 @@ bool Game_in_bounds(const Game* game, int x, int y);
 bool Game_is_over(const Game* game);
 
 // REQUIRES: Game_in_bounds(x,y)
-// EFFECTS: Returns a pointer to the Cell at (x,y). The Cell may
-//          not be modified through the pointer.
+// EFFECTS: Returns a pointer to the Cell at (x,y), numbering it first if
+//          it hasn't been yet. The Cell may not be modified through the
+//          pointer.
 const Cell * Game_cell(const Game* game, int x, int y);
 
+// REQUIRES: width >= 0, height >= 0, and the rectangle of cells from (x,y)
+//           to (x + width - 1, y + height - 1) is on the board
+// EFFECTS: Returns a view of the rectangle (see GameView), numbering its
+//          cells first if the board is numbered lazily.
+GameView Game_view(const Game *game, int x, int y, int width, int height);
+
 // REQUIRES: Game_in_bounds(x,y)
 // EFFECTS: Reveals the cell at (x,y), if it was not already revealed.
-//          Otherwise, does nothing. If an empty cell is revealed, all
-//          adjacent empty cells are also revealed.
+//          Otherwise, does nothing. If the cell isn't a trap and has no
+//          adjacent traps, its whole opening is revealed too: the cells
+//          with no adjacent traps that are connected to it through each
+//          other, and all their neighbors.
 void Game_reveal(Game* game, int x, int y);
 
 // REQUIRES: Game_in_bounds(x,y)
@@ -103,4 +282,10 @@ void Game_reveal(Game* game, int x, int y);
 //          HIDDEN. If the state was REVEALED, nothing happens.
 void Game_toggle_flag(Game* game, int x, int y);
 
+// EFFECTS: Returns the (x,y) positions of the cells whose state was changed
+//          by the most recent call to Game_reveal() or Game_toggle_flag():
+//          the cell moved on first, then the rest of its opening (if any)
+//          in order of x and then y.
+const std::vector<std::pair<int, int>> & Game_changes(const Game *game);
+
 #endif
\ No newline at end of file
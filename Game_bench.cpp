@@ -0,0 +1,471 @@
+#include "Game.hpp"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <sys/resource.h>
+
+// Microbenchmarks for the Game ADT's hot paths, on boards from 9x9 up to
+// 10000x10000. Run them with `make bench`.
+//
+// Usage: Game_bench.exe [options]
+//
+// Options:
+//   --sizes <list>   Board sizes to run, e.g. 9x9,30x16 (defaults to all of
+//                    9x9, 30x16, 100x100, 1000x1000 and 10000x10000).
+//   --out <file>     Where to write the results as JSON (default bench.json).
+//   --min-time <s>   Minimum time to spend timing each operation (default 0.1).
+//
+// Every board is generated from a fixed seed, so runs of different versions
+// time the same work and their JSON results can be compared directly.
+//
+// Note that the default build keeps assert() enabled, but Game_reveal() and
+// both Game_init()s only check the game's counts with it. The
+// O(width * height) checks of the whole board, check_invariants included,
+// are only timed in a build with `make bench CHECK=1`. Build with
+// `make bench BENCH_FLAGS=-DNDEBUG` to time the code with no asserts.
+
+// "Private" Game functions, timed on their own
+void number_cells(Game *game);
+void check_invariants(Game *game);
+
+using Clock = std::chrono::steady_clock;
+
+const unsigned BENCH_SEED = 280;
+
+// Boards with more cells than this aren't also loaded from a string, since
+// the whole save file would have to be held in memory.
+const long long BENCH_MAX_IN_MEMORY_CELLS = 1000 * 1000;
+
+// Where Game_save() writes to, removed when done
+const char *const BENCH_SAVE_FILE = "Game_bench.tmp";
+
+struct BenchSize {
+  int width;
+  int height;
+};
+
+struct BenchResult {
+  std::string op;
+  BenchSize size;
+  long long ops;   // number of operations timed
+  long long cells; // number of cells they processed in total
+  double seconds;  // time spent in them, not counting setup
+  long peak_rss_kb;
+};
+
+// A benchmarked operation. setup() runs untimed before each call to run(),
+// which returns the number of operations it did and adds the number of cells
+// they processed to cells.
+struct BenchOp {
+  std::string name;
+  std::function<void()> setup;
+  std::function<long long(long long &cells)> run;
+};
+
+// EFFECTS: Initializes game with the standard layout for its size: about
+//          15% traps and 2% treasures, from a fixed seed. If lazy, with
+//          Game_init_lazy().
+void bench_new_game(Game *game, BenchSize size, bool lazy = false) {
+  long long num_cells = static_cast<long long>(size.width) * size.height;
+  srand(BENCH_SEED);
+  int num_treasures = std::max<long long>(1, num_cells / 50);
+  int num_traps = num_cells * 3 / 20;
+  if (lazy) {
+    Game_init_lazy(game, size.width, size.height, num_treasures, num_traps);
+  }
+  else {
+    Game_init(game, size.width, size.height, num_treasures, num_traps);
+  }
+}
+
+// EFFECTS: Releases the memory held by game.
+void bench_free_game(Game *game) {
+  std::vector<Cell>().swap(game->cells);
+  std::vector<std::pair<int, int>>().swap(game->changes);
+  std::vector<int>().swap(game->opening_of);
+  std::vector<int>().swap(game->opening_starts);
+  std::vector<int>().swap(game->opening_cells);
+}
+
+// EFFECTS: Returns the largest resident set size of the process so far.
+long bench_peak_rss_kb() {
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+// EFFECTS: Times op until at least min_seconds have been spent in it.
+BenchResult bench_time(const BenchOp &op, BenchSize size, double min_seconds) {
+  BenchResult result = {op.name, size, 0, 0, 0, 0};
+  while (result.seconds < min_seconds) {
+    op.setup();
+    Clock::time_point start = Clock::now();
+    result.ops += op.run(result.cells);
+    result.seconds += std::chrono::duration<double>(Clock::now() - start).count();
+  }
+  result.peak_rss_kb = bench_peak_rss_kb();
+  return result;
+}
+
+void bench_print(const BenchResult &result) {
+  std::cout << std::left << std::setw(20) << result.op
+            << std::right << std::setw(12)
+            << std::to_string(result.size.width) + "x" + std::to_string(result.size.height)
+            << std::setw(10) << result.ops
+            << std::setw(16) << std::fixed << std::setprecision(1)
+            << result.seconds * 1e9 / result.ops
+            << " " << std::setw(16) << std::setprecision(0) << result.cells / result.seconds
+            << std::setw(12) << result.peak_rss_kb / 1024
+            << std::endl;
+}
+
+// EFFECTS: Runs every operation on a board of the given size.
+void bench_size(BenchSize size, double min_seconds, std::vector<BenchResult> &results) {
+  long long num_cells = static_cast<long long>(size.width) * size.height;
+  Game game;
+  std::vector<BenchOp> ops;
+
+  ops.push_back({"init",
+    [] {},
+    [&](long long &cells) { bench_new_game(&game, size); cells += num_cells; return 1; }
+  });
+
+  ops.push_back({"init_lazy",
+    [] {},
+    [&](long long &cells) { bench_new_game(&game, size, true); cells += num_cells; return 1; }
+  });
+
+  ops.push_back({"number_cells",
+    [] {},
+    [&](long long &cells) { number_cells(&game); cells += num_cells; return 1; }
+  });
+
+  ops.push_back({"difficulty",
+    [] {},
+    [&](long long &cells) { Game_difficulty(&game); cells += num_cells; return 1; }
+  });
+
+  // Making and rating many boards at once, on every core, as for
+  // matchmaking. Each run rates a batch of seeded boards.
+  std::vector<unsigned> seeds(std::max(1LL, std::min(1000LL, BENCH_MAX_IN_MEMORY_CELLS / num_cells)));
+  if (num_cells <= BENCH_MAX_IN_MEMORY_CELLS) {
+    int num_threads = std::max(1u, std::thread::hardware_concurrency());
+    ops.push_back({"rate_seeds",
+      [&] {
+        for(unsigned &seed : seeds) {
+          seed = rand();
+        }
+      },
+      [&, num_threads](long long &cells) {
+        Game_rate_seeds(seeds, size.width, size.height,
+                        std::max<long long>(1, num_cells / 50), num_cells * 3 / 20,
+                        TOPOLOGY_RECT, num_threads);
+        cells += num_cells * seeds.size();
+        return static_cast<long long>(seeds.size());
+      }
+    });
+  }
+
+  ops.push_back({"check_invariants",
+    [] {},
+    [&](long long &cells) { check_invariants(&game); cells += num_cells; return 1; }
+  });
+
+  // Reading every cell row by row, as a renderer does, one Game_cell() call
+  // at a time and then through a view. The count of hidden cells keeps the
+  // reads from being optimized away.
+  volatile long long num_hidden = 0;
+  ops.push_back({"scan_cells",
+    [] {},
+    [&](long long &cells) {
+      long long n = 0;
+      for(int y = 0; y < size.height; ++y) {
+        for(int x = 0; x < size.width; ++x) {
+          n += Game_cell(&game, x, y)->state == HIDDEN;
+        }
+      }
+      num_hidden = n;
+      cells += num_cells;
+      return 1;
+    }
+  });
+
+  ops.push_back({"scan_view",
+    [] {},
+    [&](long long &cells) {
+      long long n = 0;
+      GameView view = Game_view(&game, 0, 0, size.width, size.height);
+      for(int y = 0; y < view.height; ++y) {
+        const Cell *cell = GameView_cell(&view, 0, y);
+        for(int x = 0; x < view.width; ++x, cell += view.x_stride) {
+          n += cell->state == HIDDEN;
+        }
+      }
+      num_hidden = n;
+      cells += num_cells;
+      return 1;
+    }
+  });
+
+  // Revealing hidden numbered cells one at a time, as in normal play. Each
+  // run reveals a batch (smaller on big boards, where the invariant checks
+  // make each reveal slow), and a new board is dealt when they run out.
+  long long batch = std::max(1LL, std::min(1000LL, BENCH_MAX_IN_MEMORY_CELLS / num_cells));
+  std::vector<std::pair<int, int>> numbered;
+  ops.push_back({"reveal_single",
+    [&] {
+      if (numbered.empty()) {
+        bench_free_game(&game);
+        bench_new_game(&game, size);
+        for(int x = 0; x < size.width; ++x) {
+          for(int y = 0; y < size.height; ++y) {
+            const Cell *cell = Game_cell(&game, x, y);
+            if (cell->item == EMPTY && cell->num_adjacent_traps > 0) {
+              numbered.push_back({x, y});
+            }
+          }
+        }
+        // Reveal them in a scattered order, like a player would
+        std::reverse(numbered.begin(), numbered.end());
+        for(size_t i = 1; i < numbered.size(); ++i) {
+          std::swap(numbered[i], numbered[rand() % (i + 1)]);
+        }
+      }
+    },
+    [&](long long &cells) {
+      long long n = 0;
+      while (!numbered.empty() && n < batch) {
+        Game_reveal(&game, numbered.back().first, numbered.back().second);
+        numbered.pop_back();
+        ++n;
+      }
+      cells += n;
+      return n;
+    }
+  });
+
+  // The worst case: without traps, one reveal opens the whole board.
+  ops.push_back({"reveal_opening",
+    [&] {
+      bench_free_game(&game);
+      srand(BENCH_SEED);
+      Game_init(&game, size.width, size.height, 1, 0);
+    },
+    [&](long long &cells) {
+      Game_reveal(&game, size.width / 2, size.height / 2);
+      cells += Game_changes(&game).size();
+      return 1;
+    }
+  });
+
+  // Indexing the openings of a board in normal play, and the same worst
+  // case reveal with the openings indexed.
+  ops.push_back({"index_openings",
+    [&] {
+      bench_free_game(&game);
+      bench_new_game(&game, size);
+    },
+    [&](long long &cells) { Game_index_openings(&game); cells += num_cells; return 1; }
+  });
+
+  ops.push_back({"reveal_indexed",
+    [&] {
+      bench_free_game(&game);
+      srand(BENCH_SEED);
+      Game_init(&game, size.width, size.height, 1, 0);
+      Game_index_openings(&game);
+    },
+    [&](long long &cells) {
+      Game_reveal(&game, size.width / 2, size.height / 2);
+      cells += Game_changes(&game).size();
+      return 1;
+    }
+  });
+
+  // The rest work on a board in the middle of a game, with some of it
+  // revealed and flagged.
+  bool mid_game = false;
+  ops.push_back({"save",
+    [&] {
+      if (!mid_game) {
+        mid_game = true;
+        bench_free_game(&game);
+        bench_new_game(&game, size);
+        for(int x = 0; x < size.width; x += 3) {
+          for(int y = 0; y < size.height; y += 2) {
+            Cell &cell = *const_cast<Cell *>(Game_cell(&game, x, y));
+            if (cell.item == EMPTY) {
+              cell.state = REVEALED;
+              ++game.num_revealed;
+            }
+            else if (cell.item == TRAP) {
+              Game_toggle_flag(&game, x, y);
+            }
+          }
+        }
+      }
+    },
+    [&](long long &cells) {
+      std::ofstream out(BENCH_SAVE_FILE);
+      Game_save(&game, out);
+      cells += num_cells;
+      return 1;
+    }
+  });
+
+  std::string saved; // the board as saved, for load_string
+
+  ops.push_back({"load_file",
+    [&] { bench_free_game(&game); },
+    [&](long long &cells) {
+      std::ifstream in(BENCH_SAVE_FILE);
+      Game_init(&game, in);
+      cells += num_cells;
+      return 1;
+    }
+  });
+
+  if (num_cells <= BENCH_MAX_IN_MEMORY_CELLS) {
+    ops.push_back({"load_string",
+      [&] { bench_free_game(&game); },
+      [&](long long &cells) {
+        std::istringstream in(saved);
+        Game_init(&game, in);
+        cells += num_cells;
+        return 1;
+      }
+    });
+  }
+
+  // Some operations use the board left by the ones before, so they run in
+  // order.
+  for(const BenchOp &op : ops) {
+    results.push_back(bench_time(op, size, min_seconds));
+    bench_print(results.back());
+    if (op.name == "save" && num_cells <= BENCH_MAX_IN_MEMORY_CELLS) {
+      std::ostringstream out;
+      Game_save(&game, out);
+      saved = out.str();
+    }
+  }
+  bench_free_game(&game);
+  std::remove(BENCH_SAVE_FILE);
+}
+
+// EFFECTS: Writes the results and how the benchmark was built as JSON.
+void bench_write_json(std::ostream &out, const std::vector<BenchResult> &results) {
+#ifdef NDEBUG
+  const char *asserts = "false";
+#else
+  const char *asserts = "true";
+#endif
+#if !defined(NDEBUG) && defined(PIRATE_CHECK_BOARD)
+  const char *board_checks = "true";
+#else
+  const char *board_checks = "false";
+#endif
+#ifdef __OPTIMIZE__
+  const char *optimized = "true";
+#else
+  const char *optimized = "false";
+#endif
+  out << "{\n";
+  out << "  \"build\": {\"compiler\": \"" << __VERSION__ << "\", \"optimized\": " << optimized
+      << ", \"asserts\": " << asserts << ", \"board_checks\": " << board_checks << "},\n";
+  out << "  \"seed\": " << BENCH_SEED << ",\n";
+  out << "  \"results\": [\n";
+  for(size_t i = 0; i < results.size(); ++i) {
+    const BenchResult &result = results[i];
+    out << "    {\"op\": \"" << result.op << "\""
+        << ", \"width\": " << result.size.width
+        << ", \"height\": " << result.size.height
+        << ", \"ops\": " << result.ops
+        << ", \"seconds\": " << std::setprecision(6) << result.seconds
+        << ", \"ns_per_op\": " << std::fixed << std::setprecision(1)
+        << result.seconds * 1e9 / result.ops
+        << ", \"cells_per_sec\": " << std::setprecision(0) << result.cells / result.seconds
+        << std::defaultfloat
+        << ", \"peak_rss_kb\": " << result.peak_rss_kb << "}"
+        << (i + 1 < results.size() ? "," : "") << "\n";
+  }
+  out << "  ]\n";
+  out << "}\n";
+}
+
+// EFFECTS: Parses a list of sizes like 9x9,30x16. Returns false if invalid.
+bool bench_parse_sizes(const std::string &list, std::vector<BenchSize> &sizes) {
+  sizes.clear();
+  std::istringstream in(list);
+  std::string item;
+  while (std::getline(in, item, ',')) {
+    std::istringstream size_in(item);
+    BenchSize size;
+    char x;
+    if (!(size_in >> size.width >> x >> size.height) || x != 'x' ||
+        size.width < 2 || size.height < 2) {
+      return false;
+    }
+    sizes.push_back(size);
+  }
+  return !sizes.empty();
+}
+
+void print_usage(const char *program) {
+  std::cerr << "Usage: " << program << " [options]" << std::endl;
+  std::cerr << "Options: --sizes WxH,..., --out file, --min-time seconds" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+  std::vector<BenchSize> sizes = {{9, 9}, {30, 16}, {100, 100}, {1000, 1000}, {10000, 10000}};
+  std::string out_file = "bench.json";
+  double min_seconds = 0.1;
+  int arg = 1;
+  while (arg < argc) {
+    std::string option = argv[arg++];
+    if (option == "--sizes" && arg < argc) {
+      if (!bench_parse_sizes(argv[arg++], sizes)) {
+        std::cerr << "Invalid sizes: " << argv[arg - 1] << std::endl;
+        return 1;
+      }
+    }
+    else if (option == "--out" && arg < argc) {
+      out_file = argv[arg++];
+    }
+    else if (option == "--min-time" && arg < argc) {
+      min_seconds = std::stod(argv[arg++]);
+    }
+    else {
+      std::cerr << "Invalid option: " << option << std::endl;
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+
+  std::cout << std::left << std::setw(20) << "op"
+            << std::right << std::setw(12) << "size"
+            << std::setw(10) << "ops"
+            << std::setw(16) << "ns/op"
+            << " " << std::setw(16) << "cells/sec"
+            << std::setw(12) << "peak MB" << std::endl;
+  std::vector<BenchResult> results;
+  for(BenchSize size : sizes) {
+    bench_size(size, min_seconds, results);
+  }
+
+  std::ofstream out(out_file);
+  bench_write_json(out, results);
+  if (!out) {
+    std::cerr << "Could not write " << out_file << std::endl;
+    return 1;
+  }
+  std::cout << "Results written to " << out_file << std::endl;
+}
@@ -0,0 +1,503 @@
+#include "Game.hpp"
+#include "RefGame.hpp"
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+#include <csignal>
+#include <cstring>
+#include <cctype>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+// Differential testing of the Game ADT against the reference implementation
+// in RefGame.cpp. Each game is generated from a seed: a random board size,
+// topology, number of treasures and traps, whether Game indexes its openings
+// and whether it numbers cells lazily, and a random sequence of reveals and
+// flags.
+// The game is played in both implementations, and after initializing and
+// after every move, everything observable is compared: every cell, the
+// counters, Game_changes() and Game_is_over(). Every few moves and at the
+// end, the Game_save() output is compared too, and the saved game is
+// loaded back with Game_init(). (Saving is most of the cost of a check, and
+// what it writes is exactly the cells, which are compared every move.)
+//
+// When the two differ, or Game crashes (e.g. on a failed assert()), the
+// game is shrunk to the smallest board and fewest moves that still fail,
+// and printed so that it can be replayed with --replay. Games are played in
+// a child process, so that a crash can be reported like any other failure.
+//
+// Usage: Game_fuzz.exe [options]
+//
+// Options:
+//   --games <n>      Number of games to play (default 100000).
+//   --seed <n>       Seed of the first game (default 1). Game i uses seed + i.
+//   --max-size <n>   Largest width and height of a board (default 24).
+//   --replay <case>  Play only the given case, as printed for a failure.
+
+struct FuzzMove {
+  char op; // 'R' to reveal, 'F' to toggle a flag
+  int x;
+  int y;
+};
+
+struct FuzzCase {
+  unsigned seed; // passed to srand() before initializing the board
+  int width;
+  int height;
+  int num_treasures;
+  int num_traps;
+  Topology topology;
+  bool indexed; // whether Game_index_openings() is called
+  bool lazy;    // whether the board is made by Game_init_lazy()
+  std::vector<FuzzMove> moves;
+};
+
+// Returned by fuzz_run() if the implementations agree
+const int FUZZ_PASSED = -2;
+
+// Returned by fuzz_run_isolated() if Game crashed
+const int FUZZ_CRASHED = -3;
+
+// How often (in moves) the saved games are compared and loaded back
+const int FUZZ_SAVE_INTERVAL = 8;
+
+// EFFECTS: Generates a random game from the seed.
+FuzzCase fuzz_generate(unsigned seed, int max_size) {
+  std::mt19937 rng(seed);
+  FuzzCase fuzz = {seed, 0, 0, 0, 0, TOPOLOGY_RECT, false, false, {}};
+  // Mostly small boards, where the edges matter most
+  int size_limit = rng() % 4 == 0 ? max_size : std::min(max_size, 8);
+  fuzz.width = 2 + rng() % (size_limit - 1);
+  fuzz.height = 2 + rng() % (size_limit - 1);
+  fuzz.topology = static_cast<Topology>(rng() % 3);
+  if (fuzz.topology == TOPOLOGY_TORUS && (fuzz.width < 3 || fuzz.height < 3)) {
+    fuzz.topology = TOPOLOGY_RECT;
+  }
+  fuzz.indexed = rng() % 2 == 0;
+  int num_cells = fuzz.width * fuzz.height;
+  int max_items = num_cells / 2 - 1; // see the REQUIRES of Game_init()
+  fuzz.num_treasures = 1 + rng() % max_items;
+  fuzz.num_traps = rng() % (max_items - fuzz.num_treasures + 1);
+  // Usually only a few traps, so that games last long enough to matter
+  if (rng() % 2 == 0) {
+    fuzz.num_traps = std::min(fuzz.num_traps, static_cast<int>(rng() % 4));
+  }
+  int num_moves = 1 + rng() % (2 * num_cells);
+  for(int i = 0; i < num_moves; ++i) {
+    char op = rng() % 4 == 0 ? 'F' : 'R';
+    int x = rng() % fuzz.width;
+    int y = rng() % fuzz.height;
+    fuzz.moves.push_back({op, x, y});
+  }
+  fuzz.lazy = rng() % 2 == 0;
+  return fuzz;
+}
+
+// EFFECTS: Returns the game as it's printed and read by --replay.
+std::string fuzz_format(const FuzzCase &fuzz) {
+  std::string str = std::to_string(fuzz.seed) + " " + std::to_string(fuzz.width) + " "
+                  + std::to_string(fuzz.height) + " " + std::to_string(fuzz.num_treasures) + " "
+                  + std::to_string(fuzz.num_traps);
+  if (fuzz.topology != TOPOLOGY_RECT) {
+    str += " " + Game_topology_name(fuzz.topology);
+  }
+  if (fuzz.indexed) {
+    str += " indexed";
+  }
+  if (fuzz.lazy) {
+    str += " lazy";
+  }
+  for(const FuzzMove &move : fuzz.moves) {
+    str += std::string(" ") + move.op + " " + std::to_string(move.x) + " " + std::to_string(move.y);
+  }
+  return str;
+}
+
+// EFFECTS: Returns whether the case meets the REQUIRES of Game_init().
+bool fuzz_valid(const FuzzCase &fuzz) {
+  return fuzz.width > 0 && fuzz.height > 0 && fuzz.num_treasures > 0 && fuzz.num_traps >= 0 &&
+         fuzz.num_treasures + fuzz.num_traps < fuzz.width * fuzz.height / 2 &&
+         (fuzz.topology != TOPOLOGY_TORUS || (fuzz.width >= 3 && fuzz.height >= 3));
+}
+
+// EFFECTS: Parses a game printed by fuzz_format(). Returns false if invalid.
+bool fuzz_parse(const std::string &str, FuzzCase &fuzz) {
+  std::istringstream in(str);
+  if (!(in >> fuzz.seed >> fuzz.width >> fuzz.height >> fuzz.num_treasures >> fuzz.num_traps)) {
+    return false;
+  }
+  // The topology is left out for rect boards, and "indexed" and "lazy" if
+  // not (the moves start with R or F)
+  fuzz.topology = TOPOLOGY_RECT;
+  fuzz.indexed = false;
+  fuzz.lazy = false;
+  while (islower((in >> std::ws).peek())) {
+    std::string word;
+    in >> word;
+    if (word == "indexed") {
+      fuzz.indexed = true;
+    }
+    else if (word == "lazy") {
+      fuzz.lazy = true;
+    }
+    else if (!Game_parse_topology(word, fuzz.topology)) {
+      return false;
+    }
+  }
+  fuzz.moves.clear();
+  FuzzMove move;
+  while (in >> move.op >> move.x >> move.y) {
+    if ((move.op != 'R' && move.op != 'F') || move.x < 0 || move.x >= fuzz.width ||
+        move.y < 0 || move.y >= fuzz.height) {
+      return false;
+    }
+    fuzz.moves.push_back(move);
+  }
+  return in.eof() && fuzz_valid(fuzz);
+}
+
+// EFFECTS: Describes the first difference between game and ref, or returns
+//          an empty string if there is none. The Game_save() output is only
+//          compared if compare_saves.
+std::string fuzz_compare(const Game *game, const RefGame *ref, bool compare_saves) {
+  if (Game_width(game) != ref->width || Game_height(game) != ref->height) {
+    return "size is " + std::to_string(Game_width(game)) + "x" + std::to_string(Game_height(game))
+         + ", expected " + std::to_string(ref->width) + "x" + std::to_string(ref->height);
+  }
+  if (Game_topology(game) != ref->topology) {
+    return "topology is " + Game_topology_name(Game_topology(game)) + ", expected "
+         + Game_topology_name(ref->topology);
+  }
+  const std::pair<const char *, std::pair<int, int>> counters[] = {
+    {"num_treasures", {Game_num_treasures(game), ref->num_treasures}},
+    {"num_traps", {Game_num_traps(game), ref->num_traps}},
+    {"num_treasures_found", {Game_num_treasures_found(game), ref->num_treasures_found}},
+    {"num_traps_found", {Game_num_traps_found(game), ref->num_traps_found}},
+    {"num_revealed", {Game_num_revealed(game), ref->num_revealed}},
+    {"num_flags", {Game_num_flags(game), ref->num_flags}},
+    {"is_over", {Game_is_over(game), RefGame_is_over(ref)}},
+  };
+  for(const auto &counter : counters) {
+    if (counter.second.first != counter.second.second) {
+      return std::string(counter.first) + " is " + std::to_string(counter.second.first)
+           + ", expected " + std::to_string(counter.second.second);
+    }
+  }
+  for(int x = 0; x < ref->width; ++x) {
+    for(int y = 0; y < ref->height; ++y) {
+      const Cell *cell = Game_cell(game, x, y);
+      const Cell &expected = ref->cells[x][y];
+      if (cell->x != expected.x || cell->y != expected.y || cell->item != expected.item ||
+          cell->state != expected.state || cell->has_flag != expected.has_flag ||
+          cell->num_adjacent_traps != expected.num_adjacent_traps) {
+        std::ostringstream out;
+        out << "cell (" << x << ", " << y << ") is [" << *cell << "], expected ["
+            << expected << "]";
+        return out.str();
+      }
+    }
+  }
+  if (Game_changes(game) != ref->changes) {
+    std::ostringstream out;
+    out << "changes are";
+    for(const std::pair<int, int> &pos : Game_changes(game)) {
+      out << " (" << pos.first << "," << pos.second << ")";
+    }
+    out << ", expected";
+    for(const std::pair<int, int> &pos : ref->changes) {
+      out << " (" << pos.first << "," << pos.second << ")";
+    }
+    return out.str();
+  }
+  if (!compare_saves) {
+    return "";
+  }
+  std::ostringstream saved;
+  std::ostringstream expected_saved;
+  Game_save(game, saved);
+  RefGame_save(ref, expected_saved);
+  if (saved.str() != expected_saved.str()) {
+    return "Game_save() output differs";
+  }
+  return "";
+}
+
+// EFFECTS: Plays the game in both implementations. Returns FUZZ_PASSED if
+//          they agree, otherwise the index of the move after which they
+//          first differ (-1 if right after initializing), with the
+//          difference in message.
+int fuzz_run(const FuzzCase &fuzz, std::string &message) {
+  Game game;
+  RefGame ref;
+  srand(fuzz.seed);
+  if (fuzz.lazy) {
+    Game_init_lazy(&game, fuzz.width, fuzz.height, fuzz.num_treasures, fuzz.num_traps,
+                   fuzz.topology);
+  }
+  else {
+    Game_init(&game, fuzz.width, fuzz.height, fuzz.num_treasures, fuzz.num_traps, fuzz.topology);
+  }
+  if (fuzz.indexed) {
+    Game_index_openings(&game);
+  }
+  srand(fuzz.seed);
+  RefGame_init(&ref, fuzz.width, fuzz.height, fuzz.num_treasures, fuzz.num_traps, fuzz.topology);
+  // Comparing looks at every cell, which would number them all, so a lazy
+  // game is compared through a copy, leaving the rest unnumbered for the
+  // moves to number.
+  auto compare = [&game, &ref, &fuzz](bool compare_saves) {
+    if (!fuzz.lazy) {
+      return fuzz_compare(&game, &ref, compare_saves);
+    }
+    Game copy = game;
+    return fuzz_compare(&copy, &ref, compare_saves);
+  };
+  message = compare(true);
+  if (!message.empty()) {
+    message = "after Game_init(): " + message;
+    return -1;
+  }
+
+  for(int i = 0; i < fuzz.moves.size() && !RefGame_is_over(&ref); ++i) {
+    const FuzzMove &move = fuzz.moves[i];
+    if (move.op == 'R') {
+      Game_reveal(&game, move.x, move.y);
+      RefGame_reveal(&ref, move.x, move.y);
+    }
+    else {
+      Game_toggle_flag(&game, move.x, move.y);
+      RefGame_toggle_flag(&ref, move.x, move.y);
+    }
+    bool last = i + 1 == fuzz.moves.size() || RefGame_is_over(&ref);
+    bool compare_saves = last || (i + 1) % FUZZ_SAVE_INTERVAL == 0;
+    message = compare(compare_saves);
+    if (message.empty() && compare_saves) {
+      // Loading doesn't restore the last move's changes
+      std::stringstream saved;
+      RefGame_save(&ref, saved);
+      Game loaded;
+      Game_init(&loaded, saved);
+      if (fuzz.indexed) {
+        Game_index_openings(&loaded);
+      }
+      ref.changes.clear();
+      message = fuzz_compare(&loaded, &ref, true);
+      if (!message.empty()) {
+        message = "after loading: " + message;
+      }
+    }
+    if (!message.empty()) {
+      message = "after " + std::string(1, move.op) + " " + std::to_string(move.x) + " "
+              + std::to_string(move.y) + ": " + message;
+      return i;
+    }
+  }
+  return FUZZ_PASSED;
+}
+
+// EFFECTS: Same as fuzz_run(), but plays the game in a child process. If it
+//          crashes, returns FUZZ_CRASHED with what it wrote to stderr (e.g.
+//          the failed assert()) in message.
+int fuzz_run_isolated(const FuzzCase &fuzz, std::string &message) {
+  int fds[2];
+  if (pipe(fds) != 0) {
+    perror("pipe");
+    exit(2);
+  }
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(fds[0]);
+    dup2(fds[1], STDERR_FILENO);
+    int result = fuzz_run(fuzz, message);
+    std::string output = std::to_string(result) + "\n" + message;
+    ssize_t written = write(fds[1], output.data(), output.size());
+    _exit(written == static_cast<ssize_t>(output.size()) ? 0 : 2);
+  }
+  close(fds[1]);
+  std::string output;
+  char buffer[4096];
+  ssize_t n;
+  while ((n = read(fds[0], buffer, sizeof(buffer))) > 0) {
+    output.append(buffer, n);
+  }
+  close(fds[0]);
+  int status;
+  waitpid(pid, &status, 0);
+  if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+    size_t end = output.find('\n');
+    message = output.substr(end + 1);
+    return std::stoi(output.substr(0, end));
+  }
+  while (!output.empty() && output.back() == '\n') {
+    output.pop_back();
+  }
+  message = "crashed";
+  if (WIFSIGNALED(status)) {
+    message += std::string(" (") + strsignal(WTERMSIG(status)) + ")";
+  }
+  if (!output.empty()) {
+    message += ": " + output;
+  }
+  return FUZZ_CRASHED;
+}
+
+// EFFECTS: Returns the case with moves that are out of bounds removed.
+FuzzCase fuzz_clip(FuzzCase fuzz) {
+  fuzz.moves.erase(std::remove_if(fuzz.moves.begin(), fuzz.moves.end(),
+    [&fuzz](const FuzzMove &move) { return move.x >= fuzz.width || move.y >= fuzz.height; }),
+    fuzz.moves.end());
+  return fuzz;
+}
+
+// REQUIRES: fuzz fails
+// EFFECTS: Returns the smallest failing case found by repeatedly dropping
+//          moves and shrinking the board and its number of items.
+FuzzCase fuzz_shrink(FuzzCase fuzz) {
+  std::string message;
+  auto fails = [&message](const FuzzCase &candidate) {
+    return fuzz_valid(candidate) && fuzz_run_isolated(candidate, message) != FUZZ_PASSED;
+  };
+
+  bool shrunk = true;
+  while (shrunk) {
+    shrunk = false;
+    // Moves after the failing one don't matter. (It isn't known which move
+    // a crash happened on.)
+    int failed = fuzz_run_isolated(fuzz, message);
+    if (failed != FUZZ_CRASHED) {
+      fuzz.moves.resize(failed + 1);
+    }
+
+    // Drop one move at a time, starting from the last ones
+    for(int i = static_cast<int>(fuzz.moves.size()) - 1; i >= 0; --i) {
+      FuzzCase candidate = fuzz;
+      candidate.moves.erase(candidate.moves.begin() + i);
+      if (fails(candidate)) {
+        fuzz = candidate;
+        shrunk = true;
+      }
+    }
+
+    // A smaller board, fewer items, a plain rect board, no index or no
+    // lazy numbering, with the same seed
+    FuzzCase candidates[] = {fuzz, fuzz, fuzz, fuzz, fuzz, fuzz, fuzz};
+    --candidates[0].width;
+    --candidates[1].height;
+    --candidates[2].num_traps;
+    --candidates[3].num_treasures;
+    candidates[4].topology = TOPOLOGY_RECT;
+    candidates[5].indexed = false;
+    candidates[6].lazy = false;
+    for(FuzzCase &candidate : candidates) {
+      candidate = fuzz_clip(candidate);
+      bool changed = candidate.topology != fuzz.topology || candidate.width != fuzz.width ||
+                     candidate.height != fuzz.height || candidate.num_traps != fuzz.num_traps ||
+                     candidate.num_treasures != fuzz.num_treasures ||
+                     candidate.indexed != fuzz.indexed || candidate.lazy != fuzz.lazy;
+      if (changed && fails(candidate)) {
+        fuzz = candidate;
+        shrunk = true;
+        break;
+      }
+    }
+  }
+  return fuzz;
+}
+
+// EFFECTS: Prints a failing case, shrunk, and how to replay it.
+void fuzz_report(const FuzzCase &fuzz) {
+  std::string message;
+  fuzz_run_isolated(fuzz, message);
+  std::cout << "FAILED: seed " << fuzz.seed << " " << message << std::endl;
+  FuzzCase shrunk = fuzz_shrink(fuzz);
+  fuzz_run_isolated(shrunk, message);
+  std::cout << "Shrunk to " << shrunk.width << "x" << shrunk.height << " "
+            << Game_topology_name(shrunk.topology) << " board with "
+            << shrunk.num_treasures << " treasures, " << shrunk.num_traps << " traps and "
+            << shrunk.moves.size() << " moves: " << message << std::endl;
+  std::cout << "Replay with: ./Game_fuzz.exe --replay \"" << fuzz_format(shrunk) << "\"" << std::endl;
+}
+
+void print_usage(const char *program) {
+  std::cerr << "Usage: " << program << " [options]" << std::endl;
+  std::cerr << "Options: --games n, --seed n, --max-size n, --replay case" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+  long long num_games = 100000;
+  unsigned first_seed = 1;
+  int max_size = 24;
+  std::string replay;
+  int arg = 1;
+  while (arg < argc) {
+    std::string option = argv[arg++];
+    if (option == "--games" && arg < argc) {
+      num_games = std::stoll(argv[arg++]);
+    }
+    else if (option == "--seed" && arg < argc) {
+      first_seed = std::stoul(argv[arg++]);
+    }
+    else if (option == "--max-size" && arg < argc) {
+      max_size = std::max(2, std::stoi(argv[arg++]));
+    }
+    else if (option == "--replay" && arg < argc) {
+      replay = argv[arg++];
+    }
+    else {
+      std::cerr << "Invalid option: " << option << std::endl;
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (!replay.empty()) {
+    FuzzCase fuzz;
+    if (!fuzz_parse(replay, fuzz)) {
+      std::cerr << "Invalid case: " << replay << std::endl;
+      return 1;
+    }
+    std::string message;
+    if (fuzz_run(fuzz, message) == FUZZ_PASSED) {
+      std::cout << "PASSED" << std::endl;
+      return 0;
+    }
+    std::cout << "FAILED: " << message << std::endl;
+    return 1;
+  }
+
+  // The games are played in a child process, which shares the number of
+  // the game it's playing, so that if it fails (or crashes), the parent
+  // knows which game to report.
+  auto start = std::chrono::steady_clock::now();
+  void *memory = mmap(nullptr, sizeof(long long), PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  volatile long long *current = static_cast<volatile long long *>(memory);
+  *current = 0;
+  pid_t pid = fork();
+  if (pid == 0) {
+    for(long long i = 0; i < num_games; ++i) {
+      *current = i;
+      std::string message;
+      if (fuzz_run(fuzz_generate(first_seed + i, max_size), message) != FUZZ_PASSED) {
+        _exit(1);
+      }
+    }
+    _exit(0);
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    fuzz_report(fuzz_generate(first_seed + *current, max_size));
+    return 1;
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cout << "PASSED: " << num_games << " games (seeds " << first_seed << "-"
+            << first_seed + num_games - 1 << ") in " << seconds << " s, "
+            << static_cast<long long>(num_games / seconds) << " games/s" << std::endl;
+}
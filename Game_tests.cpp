@@ -1,5 +1,20 @@
 #include "unit_test_framework.hpp"
 #include "Game.hpp"
+#include "ColumnLabel.hpp"
+#include "BigBoard.hpp"
+#include "PirateGame.h"
+#include "Journal.hpp"
+#include "JsonUI.hpp"
+#include "Bank.hpp"
+#include <sstream>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+#include <cstddef>
+#include <cassert>
+#include <new>
+#include <fstream>
+#include <unistd.h>
 
 TEST(test_game_init) {
   Game game;
@@ -70,6 +85,362 @@ TEST(test_game_no_traps) {
   ASSERT_EQUAL(num_treasures, 1);
 }
 
+TEST(test_game_reveal_large_opening) {
+  // With no traps, one reveal opens the whole board. This is deep enough
+  // that a recursive flood fill would overflow the stack.
+  Game game;
+  Game_init(&game, 1000, 1000, 1, 0);
+  Game_reveal(&game, 500, 500);
+  ASSERT_EQUAL(Game_num_revealed(&game), 1000 * 1000);
+  ASSERT_EQUAL(Game_changes(&game).size(), 1000 * 1000);
+  ASSERT_EQUAL(Game_changes(&game).front().first, 500);
+  ASSERT_EQUAL(Game_changes(&game).front().second, 500);
+  ASSERT_TRUE(Game_is_over(&game));
+}
+
+TEST(test_game_index_openings) {
+  // Revealing with and without the index opens the same cells, in the same
+  // order: the cell clicked first, then the rest in order of x and y.
+  for(Topology topology : {TOPOLOGY_RECT, TOPOLOGY_TORUS, TOPOLOGY_HEX}) {
+    srand(7);
+    Game game;
+    Game_init(&game, 30, 20, 5, 40, topology);
+    Game indexed = game;
+    Game_index_openings(&indexed);
+    for(int x = 0; x < 30; ++x) {
+      for(int y = 0; y < 20; ++y) {
+        if (Game_cell(&game, x, y)->item == TRAP || Game_is_over(&game)) {
+          continue;
+        }
+        Game_reveal(&game, x, y);
+        Game_reveal(&indexed, x, y);
+        ASSERT_TRUE(Game_changes(&indexed) == Game_changes(&game));
+        ASSERT_EQUAL(Game_num_revealed(&indexed), Game_num_revealed(&game));
+        const std::vector<std::pair<int, int>> &changes = Game_changes(&game);
+        if (!changes.empty()) {
+          ASSERT_TRUE(changes.front() == std::make_pair(x, y));
+          ASSERT_TRUE(std::is_sorted(changes.begin() + 1, changes.end()));
+        }
+      }
+    }
+  }
+}
+
+TEST(test_game_difficulty) {
+  // A 5x3 board with a trap in the middle and a treasure in a corner. The
+  // columns on the left and right are openings, and the cells above and
+  // below the trap are isolated numbers.
+  for(Topology topology : {TOPOLOGY_RECT, TOPOLOGY_TORUS}) {
+    std::ostringstream saved;
+    saved << "5 3 " << Game_topology_name(topology) << "\n";
+    for(int x = 0; x < 5; ++x) {
+      for(int y = 0; y < 3; ++y) {
+        int item = x == 2 && y == 1 ? TRAP : x == 0 && y == 0 ? TREASURE : EMPTY;
+        int count = 1 <= x && x <= 3 && item != TRAP;
+        saved << x << " " << y << " " << item << " 0 0 " << count << " ";
+      }
+      saved << "\n";
+    }
+    std::istringstream in(saved.str());
+    Game game;
+    Game_init(&game, in);
+    GameDifficulty difficulty = Game_difficulty(&game);
+    // On a torus, the left and right columns are next to each other
+    int num_openings = topology == TOPOLOGY_TORUS ? 1 : 2;
+    ASSERT_EQUAL(difficulty.num_openings, num_openings);
+    ASSERT_EQUAL(difficulty.num_isolated_numbers, 2);
+    ASSERT_EQUAL(difficulty.bbbv, num_openings + 2);
+  }
+
+  // The openings found agree with the index, and batches with one board
+  // at a time
+  std::vector<unsigned> seeds = {1, 2, 3, 4, 5, 6, 7};
+  std::vector<GameDifficulty> ratings = Game_rate_seeds(seeds, 40, 30, 10, 150, TOPOLOGY_HEX, 3);
+  ASSERT_EQUAL(ratings.size(), seeds.size());
+  for(size_t i = 0; i < seeds.size(); ++i) {
+    Game game;
+    Game_init_seeded(&game, seeds[i], 40, 30, 10, 150, TOPOLOGY_HEX);
+    Game_index_openings(&game);
+    ASSERT_EQUAL(ratings[i].num_openings, game.opening_starts.size() - 1);
+    ASSERT_EQUAL(ratings[i].bbbv, Game_difficulty(&game).bbbv);
+  }
+}
+
+TEST(test_game_init_seeded) {
+  Game game;
+  Game_init_seeded(&game, 42, 20, 10, 5, 30);
+  Game again;
+  Game_init_seeded(&again, 42, 20, 10, 5, 30);
+  std::ostringstream saved;
+  std::ostringstream saved_again;
+  Game_save(&game, saved);
+  Game_save(&again, saved_again);
+  ASSERT_EQUAL(saved.str(), saved_again.str());
+  ASSERT_EQUAL(Game_num_treasures(&game), 5);
+  ASSERT_EQUAL(Game_num_traps(&game), 30);
+}
+
+TEST(test_game_init_lazy) {
+  // A board numbered lazily plays and saves the same as one numbered up
+  // front, and starts with no cell numbered.
+  for(Topology topology : {TOPOLOGY_RECT, TOPOLOGY_TORUS, TOPOLOGY_HEX}) {
+    srand(3);
+    Game game;
+    Game_init(&game, 30, 20, 5, 60, topology);
+    srand(3);
+    Game lazy;
+    Game_init_lazy(&lazy, 30, 20, 5, 60, topology);
+    ASSERT_EQUAL(std::count_if(lazy.cells.begin(), lazy.cells.end(),
+                               [](const Cell &cell) { return cell.num_adjacent_traps == -2; }),
+                 30 * 20);
+    for(int x = 0; x < 30; x += 3) {
+      for(int y = 0; y < 20; y += 2) {
+        if (Game_cell(&game, x, y)->item == TRAP || Game_is_over(&game)) {
+          continue;
+        }
+        Game_reveal(&game, x, y);
+        Game_reveal(&lazy, x, y);
+        ASSERT_TRUE(Game_changes(&lazy) == Game_changes(&game));
+        ASSERT_EQUAL(Game_num_revealed(&lazy), Game_num_revealed(&game));
+      }
+    }
+    std::ostringstream saved;
+    std::ostringstream saved_lazy;
+    Game_save(&game, saved);
+    Game_save(&lazy, saved_lazy);
+    ASSERT_EQUAL(saved.str(), saved_lazy.str());
+  }
+}
+
+TEST(test_game_view) {
+  // A view shows the same cells as Game_cell(), numbered even on a lazy
+  // board, and sees later moves.
+  srand(5);
+  Game game;
+  Game_init_lazy(&game, 20, 15, 4, 30, TOPOLOGY_HEX);
+  GameView view = Game_view(&game, 3, 2, 10, 7);
+  ASSERT_EQUAL(view.width, 10);
+  ASSERT_EQUAL(view.height, 7);
+  for(int i = 0; i < 10; ++i) {
+    for(int j = 0; j < 7; ++j) {
+      const Cell *cell = GameView_cell(&view, i, j);
+      ASSERT_NOT_EQUAL(cell->num_adjacent_traps, -2);
+      ASSERT_EQUAL(cell, Game_cell(&game, 3 + i, 2 + j));
+      ASSERT_EQUAL(cell->x, 3 + i);
+      ASSERT_EQUAL(cell->y, 2 + j);
+    }
+  }
+  ASSERT_EQUAL(std::count_if(game.cells.begin(), game.cells.end(),
+                             [](const Cell &cell) { return cell.num_adjacent_traps == -2; }),
+               20 * 15 - 10 * 7);
+  Game_toggle_flag(&game, 5, 4);
+  ASSERT_EQUAL(GameView_cell(&view, 2, 2)->state, FLAG);
+}
+
+TEST(test_game_init_packed) {
+  Game game;
+  Game_init_seeded(&game, 7, 12, 9, 4, 20, TOPOLOGY_HEX);
+  // What has been revealed and flagged is packed too
+  for(int x = 0; x < 12; x += 5) {
+    if (Game_cell(&game, x, 4)->item != TRAP) {
+      Game_reveal(&game, x, 4);
+    }
+  }
+  Game_toggle_flag(&game, 1, 8);
+  std::vector<unsigned char> packed(12 * 9);
+  Game_pack_board(&game, packed.data());
+  Game unpacked;
+  Game_init_packed(&unpacked, 12, 9, TOPOLOGY_HEX, packed.data());
+  std::ostringstream saved;
+  std::ostringstream saved_unpacked;
+  Game_save(&game, saved);
+  Game_save(&unpacked, saved_unpacked);
+  ASSERT_EQUAL(saved.str(), saved_unpacked.str());
+  ASSERT_EQUAL(Game_num_treasures(&unpacked), 4);
+  ASSERT_EQUAL(Game_num_traps(&unpacked), 20);
+  ASSERT_EQUAL(Game_num_treasures_found(&unpacked), Game_num_treasures_found(&game));
+  ASSERT_EQUAL(Game_num_revealed(&unpacked), Game_num_revealed(&game));
+  ASSERT_EQUAL(Game_num_flags(&unpacked), 1);
+}
+
+TEST(test_big_board) {
+  // Three stripes of tiles wide and two high, the last ones partly padding
+  for(Topology topology : {TOPOLOGY_RECT, TOPOLOGY_TORUS, TOPOLOGY_HEX}) {
+    const char *filename = "test_big_board.big";
+    ASSERT_TRUE(BigBoard_generate(filename, 3, 150, 70, 40, 900, topology));
+    BigBoard board;
+    ASSERT_TRUE(BigBoard_open(&board, filename));
+    std::vector<unsigned char> packed;
+    for(int x = 0; x < 150; ++x) {
+      for(int y = 0; y < 70; ++y) {
+        Cell cell = BigBoard_cell(&board, x, y);
+        packed.push_back(BigBoard_cell_byte(cell.item, HIDDEN, cell.num_adjacent_traps));
+      }
+    }
+    Game game;
+    Game_init_packed(&game, 150, 70, topology, packed.data());
+    ASSERT_EQUAL(Game_num_treasures(&game), 40);
+    ASSERT_EQUAL(Game_num_traps(&game), 900);
+    if (topology == TOPOLOGY_RECT) {
+      for(int x = 0; x < 150; ++x) {
+        for(int y = 0; y < 70; ++y) {
+          int count = 0;
+          for(int nx = x - 1; nx <= x + 1; ++nx) {
+            for(int ny = y - 1; ny <= y + 1; ++ny) {
+              count += (nx != x || ny != y) && Game_in_bounds(&game, nx, ny) &&
+                       Game_cell(&game, nx, ny)->item == TRAP;
+            }
+          }
+          ASSERT_EQUAL(BigBoard_cell(&board, x, y).num_adjacent_traps, count);
+        }
+      }
+    }
+
+    srand(5);
+    for(int move = 0; move < 200; ++move) {
+      int x = rand() % 150;
+      int y = rand() % 70;
+      if (Game_cell(&game, x, y)->item == TRAP) {
+        continue;
+      }
+      Game_reveal(&game, x, y);
+      BigBoard_reveal(&board, x, y);
+      ASSERT_TRUE(BigBoard_changes(&board) == Game_changes(&game));
+    }
+    ASSERT_EQUAL(BigBoard_num_revealed(&board), Game_num_revealed(&game));
+    ASSERT_EQUAL(BigBoard_num_treasures_found(&board), Game_num_treasures_found(&game));
+    BigBoard_close(&board);
+
+    // The game is kept in the file.
+    ASSERT_TRUE(BigBoard_open(&board, filename));
+    ASSERT_EQUAL(BigBoard_num_revealed(&board), Game_num_revealed(&game));
+    BigBoard_close(&board);
+    std::remove(filename);
+  }
+}
+
+// Counts the allocations made with new, so tests can check that code
+// doesn't allocate
+long long num_allocations = 0;
+
+void * operator new(size_t size) {
+  ++num_allocations;
+  if (void *memory = std::malloc(size)) {
+    return memory;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void *memory) noexcept {
+  std::free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept {
+  std::free(memory);
+}
+
+TEST(test_pirate_game) {
+  // The C interface plays the same game as Game does, and doesn't allocate
+  // once memory is reserved.
+  PirateGame *pirate = PirateGame_new();
+  ASSERT_EQUAL(PirateGame_reserve(pirate, 40, 30), PIRATE_OK);
+  Game game;
+  Game_init_seeded(&game, 11, 40, 30, 8, 250, TOPOLOGY_HEX);
+  // Moves all over the board (and off it), flagging the traps
+  std::vector<PirateMove> moves;
+  for(int i = 0; i < 300; ++i) {
+    int x = i * 7 % 41;
+    int y = i * 3 % 30;
+    bool trap = Game_in_bounds(&game, x, y) && Game_cell(&game, x, y)->item == TRAP;
+    moves.push_back({trap || i % 7 == 0 ? PIRATE_MOVE_FLAG : PIRATE_MOVE_REVEAL, x, y});
+  }
+  std::vector<int32_t> results(moves.size());
+  std::vector<uint8_t> saved(24 + 40 * 30);
+  std::vector<uint8_t> cells(40 * 30);
+  std::vector<int32_t> changes(2 * 40 * 30);
+
+  long long allocations_before = num_allocations;
+  ASSERT_EQUAL(PirateGame_init(pirate, 11, 40, 30, 8, 250, PIRATE_HEX), PIRATE_OK);
+  ASSERT_EQUAL(PirateGame_moves(pirate, moves.data(), 150, results.data()), PIRATE_OK);
+  ASSERT_EQUAL(PirateGame_changes(pirate, changes.data(), changes.size()), PIRATE_OK);
+  ASSERT_EQUAL(PirateGame_export(pirate, 0, 0, 40, 30, PIRATE_EXPORT_PLAYER,
+                                 cells.data(), cells.size()), PIRATE_OK);
+  ASSERT_EQUAL(PirateGame_save(pirate, saved.data(), saved.size()), PIRATE_OK);
+  ASSERT_EQUAL(PirateGame_init(pirate, 12, 40, 30, 8, 100, PIRATE_RECT), PIRATE_OK);
+  ASSERT_EQUAL(PirateGame_load(pirate, saved.data(), saved.size()), PIRATE_OK);
+  ASSERT_EQUAL(PirateGame_moves(pirate, moves.data() + 150, 150, results.data() + 150), PIRATE_OK);
+  ASSERT_EQUAL(num_allocations, allocations_before);
+
+  // So are boards of other shapes with no more cells, down to a single row
+  // or column, on a handle that has only played one of them.
+  PirateGame *other = PirateGame_new();
+  ASSERT_EQUAL(PirateGame_reserve(other, 40, 30), PIRATE_OK);
+  allocations_before = num_allocations;
+  const int32_t shapes[][2] = {{1200, 1}, {1, 1200}, {80, 15}, {7, 171}};
+  for(const int32_t *shape : shapes) {
+    ASSERT_EQUAL(PirateGame_init(other, 3, shape[0], shape[1], 1, 0, PIRATE_RECT), PIRATE_OK);
+    // With one treasure and no traps, a reveal opens almost the whole board
+    ASSERT_EQUAL(PirateGame_move(other, PIRATE_MOVE_REVEAL, shape[0] / 2, shape[1] / 2),
+                 PIRATE_OK);
+    ASSERT_TRUE(PirateGame_num_changes(other) > 1000);
+  }
+  ASSERT_EQUAL(num_allocations, allocations_before);
+  PirateGame_free(other);
+
+  size_t num_changes = 0;
+  for(size_t i = 0; i < moves.size(); ++i) {
+    if (i == 150) {
+      num_changes = 0;
+    }
+    int32_t result = PIRATE_OK;
+    if (Game_is_over(&game)) {
+      result = PIRATE_ERR_GAME_OVER;
+    }
+    else if (!Game_in_bounds(&game, moves[i].x, moves[i].y)) {
+      result = PIRATE_ERR_OUT_OF_BOUNDS;
+    }
+    else if (moves[i].kind == PIRATE_MOVE_FLAG) {
+      Game_toggle_flag(&game, moves[i].x, moves[i].y);
+    }
+    else {
+      Game_reveal(&game, moves[i].x, moves[i].y);
+    }
+    num_changes += result == PIRATE_OK ? Game_changes(&game).size() : 0;
+    ASSERT_EQUAL(results[i], result);
+  }
+  ASSERT_EQUAL(PirateGame_num_changes(pirate), num_changes);
+  PirateStatus status;
+  ASSERT_EQUAL(PirateGame_status(pirate, &status), PIRATE_OK);
+  ASSERT_EQUAL(status.topology, PIRATE_HEX);
+  ASSERT_EQUAL(status.num_revealed, Game_num_revealed(&game));
+  ASSERT_EQUAL(status.num_flags, Game_num_flags(&game));
+  ASSERT_EQUAL(status.state, !Game_is_over(&game) ? PIRATE_PLAYING
+                           : Game_num_traps_found(&game) > 0 ? PIRATE_LOST : PIRATE_WON);
+  ASSERT_EQUAL(PirateGame_export(pirate, 0, 0, 40, 30, PIRATE_EXPORT_ALL,
+                                 cells.data(), cells.size()), PIRATE_OK);
+  for(int x = 0; x < 40; ++x) {
+    for(int y = 0; y < 30; ++y) {
+      const Cell *cell = Game_cell(&game, x, y);
+      uint8_t byte = cells[y * 40 + x];
+      ASSERT_EQUAL(PIRATE_CELL_STATE(byte), cell->state);
+      ASSERT_EQUAL(PIRATE_CELL_ITEM(byte), cell->item);
+      ASSERT_EQUAL(PIRATE_CELL_NUMBER(byte), cell->num_adjacent_traps);
+    }
+  }
+
+  // Bad arguments and saves are turned away, leaving the game as it was.
+  ASSERT_EQUAL(PirateGame_export(pirate, 35, 0, 10, 1, PIRATE_EXPORT_ALL,
+                                 cells.data(), cells.size()), PIRATE_ERR_OUT_OF_BOUNDS);
+  ASSERT_EQUAL(PirateGame_save(pirate, saved.data(), saved.size() - 1), PIRATE_ERR_TOO_SMALL);
+  ASSERT_EQUAL(PirateGame_init(pirate, 1, 4, 4, 5, 5, PIRATE_RECT), PIRATE_ERR_INVALID);
+  ASSERT_EQUAL(PirateGame_load(pirate, saved.data(), saved.size() - 1), PIRATE_ERR_BAD_SAVE);
+  saved[30] = 0xff;
+  ASSERT_EQUAL(PirateGame_load(pirate, saved.data(), saved.size()), PIRATE_ERR_BAD_SAVE);
+  ASSERT_EQUAL(PirateGame_status(pirate, &status), PIRATE_OK);
+  ASSERT_EQUAL(status.num_revealed, Game_num_revealed(&game));
+  PirateGame_free(pirate);
+}
+
 TEST(test_game_bounds) {
   Game game;
   Game_init(&game, 5, 6, 3, 4);
@@ -86,4 +457,366 @@ TEST(test_game_bounds) {
   ASSERT_FALSE(Game_in_bounds(&game, 0, 6));
 }
 
+TEST(test_game_load_counts) {
+  // 4x2 board with a revealed treasure, a hidden treasure, a flagged trap,
+  // and one more revealed empty cell
+  std::istringstream in(
+    "4 2\n"
+    "0 0 1 1 0 1 0 1 0 0 0 1\n"
+    "1 0 0 1 0 1 1 1 2 2 0 0\n"
+    "2 0 1 0 0 1 2 1 0 0 0 1\n"
+    "3 0 0 0 0 0 3 1 0 0 0 0\n"
+  );
+  Game game;
+  Game_init(&game, in);
+  ASSERT_EQUAL(Game_width(&game), 4);
+  ASSERT_EQUAL(Game_height(&game), 2);
+  ASSERT_EQUAL(Game_num_treasures(&game), 2);
+  ASSERT_EQUAL(Game_num_traps(&game), 1);
+  ASSERT_EQUAL(Game_num_treasures_found(&game), 1);
+  ASSERT_EQUAL(Game_num_traps_found(&game), 0);
+  ASSERT_EQUAL(Game_num_revealed(&game), 2);
+  ASSERT_EQUAL(Game_num_flags(&game), 1);
+
+  // Counts stay consistent as the loaded game continues
+  Game_toggle_flag(&game, 1, 1);
+  ASSERT_EQUAL(Game_num_flags(&game), 0);
+  Game_reveal(&game, 2, 0);
+  ASSERT_EQUAL(Game_num_treasures_found(&game), 2);
+  ASSERT_EQUAL(Game_num_revealed(&game), 3);
+  ASSERT_TRUE(Game_is_over(&game));
+}
+
+TEST(test_game_topologies) {
+  // Every cell of a torus has 8 neighbors, so each trap is counted 8 times
+  Game torus;
+  Game_init(&torus, 5, 4, 1, 3, TOPOLOGY_TORUS);
+  ASSERT_EQUAL(Game_topology(&torus), TOPOLOGY_TORUS);
+  int total = 0;
+  for(int x = 0; x < 5; ++x) {
+    for(int y = 0; y < 4; ++y) {
+      total += Game_cell(&torus, x, y)->num_adjacent_traps;
+    }
+  }
+  ASSERT_EQUAL(total, 3 * 8);
+
+  // The topology is saved with the game (and left out for rect boards)
+  Game hex;
+  Game_init(&hex, 6, 5, 2, 3, TOPOLOGY_HEX);
+  std::ostringstream saved;
+  Game_save(&hex, saved);
+  ASSERT_EQUAL(saved.str().substr(0, saved.str().find('\n')), "6 5 hex");
+  std::istringstream in(saved.str());
+  Game loaded;
+  Game_init(&loaded, in);
+  ASSERT_EQUAL(Game_topology(&loaded), TOPOLOGY_HEX);
+  std::ostringstream resaved;
+  Game_save(&loaded, resaved);
+  ASSERT_EQUAL(resaved.str(), saved.str());
+
+  Topology topology = TOPOLOGY_RECT;
+  ASSERT_TRUE(Game_parse_topology("torus", topology));
+  ASSERT_EQUAL(topology, TOPOLOGY_TORUS);
+  ASSERT_FALSE(Game_parse_topology("sphere", topology));
+  ASSERT_EQUAL(Game_topology_name(TOPOLOGY_RECT), "rect");
+}
+
+TEST(test_column_labels) {
+  ASSERT_EQUAL(ColumnLabel_format(0), "A");
+  ASSERT_EQUAL(ColumnLabel_format(25), "Z");
+  ASSERT_EQUAL(ColumnLabel_format(26), "AA");
+  ASSERT_EQUAL(ColumnLabel_format(27), "AB");
+  ASSERT_EQUAL(ColumnLabel_format(701), "ZZ");
+  ASSERT_EQUAL(ColumnLabel_format(702), "AAA");
+  ASSERT_EQUAL(ColumnLabel_format(9999), "NTP");
+
+  for(int x : {0, 1, 25, 26, 51, 52, 701, 702, 9999}) {
+    ASSERT_EQUAL(ColumnLabel_parse(ColumnLabel_format(x)), x);
+  }
+  ASSERT_EQUAL(ColumnLabel_parse("ab"), 27);
+  ASSERT_EQUAL(ColumnLabel_parse(""), -1);
+  ASSERT_EQUAL(ColumnLabel_parse("A1"), -1);
+  ASSERT_EQUAL(ColumnLabel_parse("3"), -1);
+}
+
+TEST(test_json_requests) {
+  Game game;
+  Game_init_seeded(&game, 4, 10, 8, 2, 10);
+  std::istringstream in;
+  std::ostringstream out;
+  JsonUI ui;
+  JsonUI_init(&ui, &game, in, out);
+  std::string response;
+
+  // Escapes in strings, and ids given back as valid JSON
+  ASSERT_TRUE(JsonUI_handle(&ui, "{\"id\":\"a\\\"b\\\\c\\n\", \"cmd\" : \"status\"}", response));
+  std::string expected = "{\"id\":\"a\\\"b\\\\c\\n\",\"ok\":true";
+  ASSERT_EQUAL(response.substr(0, expected.size()), expected);
+  for(const char *id : {"7", "-3", "1.5e3", "0"}) {
+    response.clear();
+    JsonUI_handle(&ui, std::string("{\"id\":") + id + ",\"cmd\":\"status\"}", response);
+    expected = std::string("{\"id\":") + id + ",\"ok\":true";
+    ASSERT_EQUAL(response.substr(0, expected.size()), expected);
+  }
+
+  // Bad ids are errors, and aren't echoed
+  for(const char *id : {"true", "null", "012", "+1", "1.", "1e", "0x10", "-"}) {
+    response.clear();
+    JsonUI_handle(&ui, std::string("{\"id\":") + id + ",\"cmd\":\"status\"}", response);
+    ASSERT_EQUAL(response, "{\"ok\":false,\"error\":\"id must be a number or a string\"}\n");
+  }
+
+  // Missing fields and malformed requests
+  const std::vector<std::pair<std::string, std::string>> errors = {
+    {"{\"id\":1,\"cmd\":\"reveal\",\"x\":1}", "x and y are required"},
+    {"{\"id\":1,\"cmd\":\"save\"}", "file is required"},
+    {"{\"id\":1}", "unknown cmd"},
+    {"{\"id\":1,\"cmd\":\"reveal\",\"x\":\"1\",\"y\":1}", "x must be an integer"},
+    {"{\"id\":1,\"cmd\":\"st\\qtus\"}", "malformed string"},
+    {"{\"id\":1,\"cmd\":\"status\"", "expected ',' or '}'"},
+    {"[1]", "expected an object"},
+  };
+  for(const auto &error : errors) {
+    response.clear();
+    ASSERT_TRUE(JsonUI_handle(&ui, error.first, response));
+    ASSERT_NOT_EQUAL(response.find("\"ok\":false,\"error\":\"" + error.second + "\""),
+                     std::string::npos);
+  }
+  ASSERT_EQUAL(Game_num_revealed(&game), 0);
+}
+
+TEST(test_json_pipelined) {
+  // Requests sent together are answered in order, one line each, and
+  // nothing after a quit is handled.
+  Game game;
+  Game_init_seeded(&game, 4, 10, 8, 2, 10);
+  std::istringstream in("{\"id\":1,\"cmd\":\"status\"}\n"
+                        "\n"
+                        "{\"id\":2,\"cmd\":\"flag\",\"x\":0,\"y\":0}\n"
+                        "{\"id\":3,\"cmd\":\"bogus\"}\n"
+                        "{\"id\":4,\"cmd\":\"quit\"}\n"
+                        "{\"id\":5,\"cmd\":\"status\"}\n");
+  std::ostringstream out;
+  JsonUI ui;
+  JsonUI_init(&ui, &game, in, out);
+  JsonUI_play(&ui);
+  std::istringstream responses(out.str());
+  std::string line;
+  int id = 0;
+  while (std::getline(responses, line)) {
+    ++id;
+    ASSERT_EQUAL(line.substr(0, 7), "{\"id\":" + std::to_string(id));
+  }
+  ASSERT_EQUAL(id, 4);
+  ASSERT_EQUAL(Game_num_flags(&game), 1);
+}
+
+// EFFECTS: Returns the contents of the file.
+std::string read_file(const std::string &filename) {
+  std::ifstream in(filename, std::ios::binary);
+  std::ostringstream contents;
+  contents << in.rdbuf();
+  return contents.str();
+}
+
+void write_file(const std::string &filename, const std::string &contents) {
+  std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+  out << contents;
+}
+
+std::string save_string(const Game *game) {
+  std::ostringstream out;
+  Game_save(game, out);
+  return out.str();
+}
+
+// EFFECTS: Makes moves first up to last of a fixed sequence of moves on a
+//          20x15 board, journaling each. Traps are flagged, not revealed.
+void journal_moves(Journal *journal, Game *game, int first, int last) {
+  for(int i = first; i < last; ++i) {
+    int x = i * 7 % 20;
+    int y = i * 4 % 15;
+    if (Game_cell(game, x, y)->item == TRAP) {
+      Game_toggle_flag(game, x, y);
+      Journal_record(journal, game, JOURNAL_FLAG, x, y);
+    }
+    else {
+      Game_reveal(game, x, y);
+      Journal_record(journal, game, JOURNAL_REVEAL, x, y);
+    }
+  }
+}
+
+TEST(test_journal_recover) {
+  // A crash after the log is rotated for a checkpoint leaves the rotated
+  // log behind. Recovery plays it and then the current log over whichever
+  // checkpoint is on disk, skipping the moves the checkpoint already has.
+  const std::string base = "test_journal";
+  Game game;
+  Game_init_seeded(&game, 9, 20, 15, 3, 30);
+  Journal journal;
+  Journal_init(&journal, base, 1000);
+  Journal_begin(&journal, &game);
+  std::string first_checkpoint = read_file(base + ".ckpt");
+  journal_moves(&journal, &game, 0, 5);
+  std::string first_log = read_file(base + ".log");
+  Journal_tick(&journal, &game);
+  journal_moves(&journal, &game, 5, 10);
+  Journal_close(&journal);
+  std::string second_checkpoint = read_file(base + ".ckpt");
+  ASSERT_NOT_EQUAL(second_checkpoint, first_checkpoint);
+
+  // Crashed before the new checkpoint was written, and after it was
+  // written but before the rotated log was removed
+  for(const std::string &checkpoint : {first_checkpoint, second_checkpoint}) {
+    write_file(base + ".ckpt", checkpoint);
+    write_file(base + ".log.old", first_log);
+    Game recovered;
+    Journal again;
+    Journal_init(&again, base, 1000);
+    ASSERT_TRUE(Journal_recover(&again, &recovered));
+    ASSERT_EQUAL(save_string(&recovered), save_string(&game));
+    ASSERT_EQUAL(again.seq, 10);
+  }
+  for(const char *extension : {".ckpt", ".log", ".log.old"}) {
+    std::remove((base + extension).c_str());
+  }
+}
+
+TEST(test_journal_torn_record) {
+  // A record only partly written when the process died is ignored, along
+  // with anything after it.
+  const std::string base = "test_journal";
+  Game game;
+  Game_init_seeded(&game, 9, 20, 15, 3, 30);
+  Journal journal;
+  Journal_init(&journal, base, 1000);
+  Journal_begin(&journal, &game);
+  journal_moves(&journal, &game, 0, 6);
+  std::string expected = save_string(&game);
+  journal_moves(&journal, &game, 6, 7);
+  Journal_close(&journal);
+  ASSERT_EQUAL(truncate((base + ".log").c_str(), 7 * sizeof(JournalRecord) - 5), 0);
+
+  Game recovered;
+  Journal again;
+  Journal_init(&again, base, 1000);
+  ASSERT_TRUE(Journal_recover(&again, &recovered));
+  ASSERT_EQUAL(save_string(&recovered), expected);
+  ASSERT_EQUAL(again.seq, 6);
+  std::remove((base + ".ckpt").c_str());
+  std::remove((base + ".log").c_str());
+}
+
+TEST(test_bank_kinds) {
+  for(const char *name : {"30x16/10/99", "16x16/5/40/hex", "30x16/10/99/100-130",
+                          "10x10/2/10/torus/5-9"}) {
+    BankKind kind;
+    ASSERT_TRUE(Bank_parse_kind(name, kind));
+    ASSERT_EQUAL(Bank_kind_name(kind), name);
+  }
+  BankKind kind;
+  ASSERT_TRUE(Bank_parse_kind("16x16/5/40/rect", kind));
+  ASSERT_EQUAL(Bank_kind_name(kind), "16x16/5/40");
+  for(const char *name : {"", "30x16", "30x16/10", "30-16/10/99", "ax16/1/1", "30x16/10/99/sphere",
+                          "30x16/10/99/130-100", "30x16/10/99/10-", "4x4/5/5", "2x2/1/0/torus",
+                          "0x10/1/1"}) {
+    ASSERT_FALSE(Bank_parse_kind(name, kind));
+  }
+}
+
+// EFFECTS: Returns the kind Bank_parse_kind() reads from name.
+BankKind bank_kind(const std::string &name) {
+  BankKind kind;
+  bool parsed = Bank_parse_kind(name, kind);
+  assert(parsed);
+  (void)parsed;
+  return kind;
+}
+
+TEST(test_bank_fill_take) {
+  const std::string filename = "test_bank.bank";
+  ASSERT_TRUE(Bank_create(filename, {bank_kind("10x8/2/10/20-40"), bank_kind("10x8/2/10"),
+                                     bank_kind("10x8/2/10/hex")}, 3));
+  Bank bank;
+  ASSERT_TRUE(Bank_open(&bank, filename));
+  ASSERT_EQUAL(Bank_num_shelves(&bank), 3);
+
+  // Without a range of 3BV, any shelf of the right size and items matches
+  ASSERT_EQUAL(Bank_find(&bank, bank_kind("10x8/2/10")), 0);
+  ASSERT_EQUAL(Bank_find(&bank, bank_kind("10x8/2/10/20-40")), 0);
+  ASSERT_EQUAL(Bank_find(&bank, bank_kind("10x8/2/10/1-5")), -1);
+  ASSERT_EQUAL(Bank_find(&bank, bank_kind("10x8/2/10/hex")), 2);
+  ASSERT_EQUAL(Bank_find(&bank, bank_kind("12x8/2/10")), -1);
+
+  // Fill the shelf, take two, and refill it, so the ring wraps around
+  const int shelf = 1;
+  Game game;
+  ASSERT_FALSE(Bank_take(&bank, shelf, &game));
+  ASSERT_EQUAL(Bank_fill(&bank, shelf, 10), 3);
+  ASSERT_EQUAL(Bank_fill(&bank, shelf, 10), 0);
+  ASSERT_TRUE(Bank_take(&bank, shelf, &game));
+  ASSERT_TRUE(Bank_take(&bank, shelf, &game));
+  ASSERT_EQUAL(Bank_fill(&bank, shelf, 10), 2);
+  ASSERT_EQUAL(Bank_shelf(&bank, shelf)->head, 2);
+  ASSERT_EQUAL(Bank_shelf(&bank, shelf)->tail, 5);
+
+  // Boards come out in the order they were added, from slots 2, 0 and 1
+  std::vector<unsigned char> packed(10 * 8);
+  for(int slot : {2, 0, 1}) {
+    const unsigned char *stored = bank.data + Bank_shelf(&bank, shelf)->offset + slot * packed.size();
+    std::vector<unsigned char> expected(stored, stored + packed.size());
+    ASSERT_TRUE(Bank_take(&bank, shelf, &game));
+    Game_pack_board(&game, packed.data());
+    ASSERT_TRUE(packed == expected);
+    ASSERT_EQUAL(Game_num_treasures(&game), 2);
+    ASSERT_EQUAL(Game_num_traps(&game), 10);
+    ASSERT_EQUAL(Game_num_revealed(&game), 0);
+  }
+  ASSERT_FALSE(Bank_take(&bank, shelf, &game));
+
+  // Boards with a range of 3BV are in it
+  ASSERT_EQUAL(Bank_fill(&bank, 0, 2), 2);
+  for(int i = 0; i < 2; ++i) {
+    ASSERT_TRUE(Bank_take(&bank, 0, &game));
+    int bbbv = Game_difficulty(&game).bbbv;
+    ASSERT_TRUE(20 <= bbbv && bbbv <= 40);
+  }
+  Bank_close(&bank);
+  std::remove(filename.c_str());
+}
+
+TEST(test_bank_open_invalid) {
+  const std::string filename = "test_bank.bank";
+  ASSERT_TRUE(Bank_create(filename, {bank_kind("10x8/2/10"), bank_kind("9x9/1/10")}, 4));
+  std::string contents = read_file(filename);
+  Bank bank;
+  ASSERT_TRUE(Bank_open(&bank, filename));
+  Bank_close(&bank);
+
+  // Cut off in the slots, in the shelves and in the header
+  for(size_t size : {contents.size() - 1, sizeof(BankHeader) + sizeof(BankShelf), size_t(10)}) {
+    write_file(filename, contents.substr(0, size));
+    ASSERT_FALSE(Bank_open(&bank, filename));
+  }
+
+  // A damaged magic number, version, shelf count and shelf
+  std::vector<std::pair<size_t, char>> damage = {
+    {0, 'X'},
+    {offsetof(BankHeader, version), 9},
+    {offsetof(BankHeader, num_shelves), 3},
+    {sizeof(BankHeader) + sizeof(BankShelf) + offsetof(BankShelf, capacity), 5},
+    {sizeof(BankHeader) + offsetof(BankShelf, offset) + 2, 1},
+    {sizeof(BankHeader) + offsetof(BankShelf, kind) + offsetof(BankKind, num_traps), 60},
+  };
+  for(const std::pair<size_t, char> &change : damage) {
+    std::string damaged = contents;
+    damaged[change.first] = change.second;
+    write_file(filename, damaged);
+    ASSERT_FALSE(Bank_open(&bank, filename));
+  }
+  std::remove(filename.c_str());
+  ASSERT_FALSE(Bank_open(&bank, filename));
+}
+
 TEST_MAIN()
\ No newline at end of file
@@ -0,0 +1,167 @@
+#include "HeadlessUI.hpp"
+#include "ColumnLabel.hpp"
+#include "Stats.hpp"
+#include "Trace.hpp"
+#include <fstream>
+#include <string>
+#include <cctype>
+
+// Output is written out whenever this much has been collected
+const size_t HEADLESS_BUFFER_SIZE = 1 << 16;
+
+// "Private" function declarations
+int parse_number(const std::string &str);
+int parse_x(const std::string &str);
+void HeadlessUI_write_status(HeadlessUI *ui);
+void HeadlessUI_flush(HeadlessUI *ui);
+
+void HeadlessUI_init(HeadlessUI *ui, Game *game, std::istream &in, std::ostream &out,
+                     bool summary_only) {
+  ui->game = game;
+  ui->journal = nullptr;
+  ui->spectator = nullptr;
+  ui->in = &in;
+  ui->out = &out;
+  ui->summary_only = summary_only;
+  ui->buffer.reserve(HEADLESS_BUFFER_SIZE + 256);
+  ui->num_moves = 0;
+  ui->num_errors = 0;
+}
+
+void HeadlessUI_enable_autosave(HeadlessUI *ui, Journal *journal) {
+  ui->journal = journal;
+}
+
+void HeadlessUI_enable_spectate(HeadlessUI *ui, Spectator *spectator) {
+  ui->spectator = spectator;
+}
+
+// EFFECTS: Returns the non-negative number in str, or -1 if str is not one.
+int parse_number(const std::string &str) {
+  if (str.empty() || str.size() > 9) {
+    return -1;
+  }
+  int n = 0;
+  for(char c : str) {
+    if (!std::isdigit(static_cast<unsigned char>(c))) {
+      return -1;
+    }
+    n = n * 10 + (c - '0');
+  }
+  return n;
+}
+
+// EFFECTS: Returns the column given either as a number or a column label,
+//          or -1 if str is neither.
+int parse_x(const std::string &str) {
+  if (!str.empty() && std::isdigit(static_cast<unsigned char>(str[0]))) {
+    return parse_number(str);
+  }
+  return ColumnLabel_parse(str);
+}
+
+// EFFECTS: Appends the fields describing the state of the game, shared by
+//          move and summary lines.
+void HeadlessUI_write_status(HeadlessUI *ui) {
+  Game *game = ui->game;
+  ui->buffer += ' ';
+  ui->buffer += std::to_string(Game_num_treasures_found(game));
+  ui->buffer += '/';
+  ui->buffer += std::to_string(Game_num_treasures(game));
+  ui->buffer += ' ';
+  ui->buffer += std::to_string(Game_num_traps_found(game));
+  ui->buffer += ' ';
+  ui->buffer += std::to_string(Game_num_revealed(game));
+  if (!Game_is_over(game)) {
+    ui->buffer += " playing\n";
+  }
+  else if (Game_num_traps_found(game) > 0) {
+    ui->buffer += " lost\n";
+  }
+  else {
+    ui->buffer += " won\n";
+  }
+}
+
+void HeadlessUI_flush(HeadlessUI *ui) {
+  STATS_TIME(STAT_UI_OUTPUT);
+  ui->out->write(ui->buffer.data(), ui->buffer.size());
+  ui->buffer.clear();
+}
+
+// EFFECTS: Reads and applies one move. Returns false if there are no more
+//          moves to apply.
+bool HeadlessUI_input(HeadlessUI *ui) {
+  std::istream &in = *ui->in;
+  std::string move;
+  if (!(in >> move) || move == "Q") {
+    return false;
+  }
+  TRACE_SPAN("turn");
+
+  std::string x_str = "-";
+  std::string y_str = "-";
+  std::string result = "ok";
+  if (move == "R" || move == "F") {
+    in >> x_str >> y_str;
+    int x = parse_x(x_str);
+    int y = parse_number(y_str);
+    if (!Game_in_bounds(ui->game, x, y)) {
+      result = "oob";
+    }
+    else if (move == "R") {
+      Game_reveal(ui->game, x, y);
+      if (ui->spectator) {
+        Spectator_publish(ui->spectator, ui->game);
+      }
+      if (ui->journal) {
+        Journal_record(ui->journal, ui->game, JOURNAL_REVEAL, x, y);
+      }
+    }
+    else {
+      Game_toggle_flag(ui->game, x, y);
+      if (ui->spectator) {
+        Spectator_publish(ui->spectator, ui->game);
+      }
+      if (ui->journal) {
+        Journal_record(ui->journal, ui->game, JOURNAL_FLAG, x, y);
+      }
+    }
+  }
+  else if (move == "S") {
+    in >> x_str;
+    std::ofstream fout(x_str);
+    Game_save(ui->game, fout);
+    if (!fout) {
+      result = "invalid";
+    }
+  }
+  else {
+    result = "invalid";
+  }
+
+  ++ui->num_moves;
+  if (result != "ok") {
+    ++ui->num_errors;
+  }
+  if (!ui->summary_only) {
+    ui->buffer += move + ' ' + x_str + ' ' + y_str + ' ' + result;
+    HeadlessUI_write_status(ui);
+    if (ui->buffer.size() >= HEADLESS_BUFFER_SIZE) {
+      HeadlessUI_flush(ui);
+    }
+  }
+  return true;
+}
+
+void HeadlessUI_play(HeadlessUI *ui) {
+  while (!Game_is_over(ui->game) && HeadlessUI_input(ui)) { }
+
+  if (ui->summary_only) {
+    ui->buffer += "summary " + std::to_string(ui->num_moves)
+                + ' ' + std::to_string(ui->num_errors);
+    HeadlessUI_write_status(ui);
+  }
+  HeadlessUI_flush(ui);
+  ui->out->flush();
+}
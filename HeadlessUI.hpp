@@ -0,0 +1,51 @@
+#ifndef HEADLESS_UI_HPP
+#define HEADLESS_UI_HPP
+
+#include "Game.hpp"
+#include "Journal.hpp"
+#include "Spectator.hpp"
+#include <iostream>
+#include <string>
+
+// A UI for scripts and bots. Moves are read from a stream using the same
+// commands as CommandUI (R/F <x> <y>, S <filename>, Q), where <x> may be a
+// column label or a number. Nothing is rendered. Instead, one line is
+// written per move:
+//
+//   <move> <x> <y> <result> <found>/<treasures> <traps_found> <revealed> <state>
+//
+// where <result> is ok, oob (out of bounds) or invalid, and <state> is
+// playing, won or lost. For S, <x> is the filename and <y> is "-". When only
+// a summary is requested, a single line is written once input ends, the
+// player quits, or the game is over:
+//
+//   summary <moves> <errors> <found>/<treasures> <traps_found> <revealed> <state>
+
+struct HeadlessUI {
+  Game *game;
+  Journal *journal; // nullptr unless autosave is enabled
+  Spectator *spectator; // nullptr unless spectating is enabled
+  std::istream *in;
+  std::ostream *out;
+  bool summary_only;
+
+  // Output is collected here and written out in large blocks.
+  std::string buffer;
+  int num_moves;
+  int num_errors;
+};
+
+void HeadlessUI_init(HeadlessUI *ui, Game *game, std::istream &in, std::ostream &out,
+                     bool summary_only);
+
+// EFFECTS: Records every reveal and flag in journal.
+void HeadlessUI_enable_autosave(HeadlessUI *ui, Journal *journal);
+
+// EFFECTS: Publishes every move made through the UI to spectator.
+void HeadlessUI_enable_spectate(HeadlessUI *ui, Spectator *spectator);
+
+// EFFECTS: Applies moves from the input stream until it ends, the player
+//          quits, or the game is over.
+void HeadlessUI_play(HeadlessUI *ui);
+
+#endif
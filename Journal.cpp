@@ -0,0 +1,254 @@
+#include "Journal.hpp"
+#include "Stats.hpp"
+#include "Trace.hpp"
+#include <cassert>
+#include <cstdio>
+#include <iostream>
+#include <fstream>
+#include <utility>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+// "Private" function declarations
+uint8_t record_checksum(const JournalRecord &record);
+bool file_exists(const std::string &filename);
+bool sync_file(const std::string &filename, int flags);
+void replay_log(Journal *journal, Game *game, const std::string &filename);
+void write_checkpoint(const Game &game, uint32_t seq,
+                      const std::string &filename, const std::string &old_log_filename);
+void Journal_checkpoint(Journal *journal, const Game *game);
+void Journal_checkpoint_worker(Journal *journal);
+void Journal_wait(Journal *journal);
+
+
+void Journal_init(Journal *journal, const std::string &base, int checkpoint_interval) {
+  assert(checkpoint_interval > 0);
+  journal->checkpoint_filename = base + ".ckpt";
+  journal->log_filename = base + ".log";
+  journal->old_log_filename = base + ".log.old";
+  journal->seq = 0;
+  journal->checkpoint_interval = checkpoint_interval;
+  journal->records_since_checkpoint = 0;
+  journal->checkpoint_running = false;
+  journal->checkpoint_stopping = false;
+}
+
+bool Journal_recover(Journal *journal, Game *game) {
+  std::ifstream fin(journal->checkpoint_filename);
+  uint32_t seq;
+  if (!(fin >> seq)) {
+    return false;
+  }
+  Game_init(game, fin);
+  journal->seq = seq;
+
+  // The old log (if any) holds records older than those in the current log.
+  replay_log(journal, game, journal->old_log_filename);
+  replay_log(journal, game, journal->log_filename);
+  return true;
+}
+
+void Journal_begin(Journal *journal, const Game *game) {
+  Journal_wait(journal);
+  write_checkpoint(*game, journal->seq,
+                   journal->checkpoint_filename, journal->old_log_filename);
+
+  // Everything up to seq is now in the checkpoint, so the log starts empty.
+  // This also discards any partially written record left by a crash.
+  journal->log.close();
+  journal->log.open(journal->log_filename, std::ios::binary | std::ios::trunc);
+  journal->records_since_checkpoint = 0;
+}
+
+void Journal_record(Journal *journal, const Game *game, JournalOp op, int x, int y) {
+  STATS_TIME(STAT_JOURNAL_RECORD);
+  JournalRecord record = {};
+  record.seq = ++journal->seq;
+  record.x = x;
+  record.y = y;
+  record.op = op;
+  record.checksum = record_checksum(record);
+
+  // Flush each record so it survives if the process dies right after.
+  journal->log.write(reinterpret_cast<const char *>(&record), sizeof(record));
+  journal->log.flush();
+
+  if (++journal->records_since_checkpoint >= journal->checkpoint_interval) {
+    Journal_checkpoint(journal, game);
+  }
+}
+
+void Journal_tick(Journal *journal, const Game *game) {
+  if (journal->records_since_checkpoint > 0) {
+    Journal_checkpoint(journal, game);
+  }
+}
+
+void Journal_close(Journal *journal) {
+  Journal_wait(journal);
+  if (journal->checkpoint_thread.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(journal->checkpoint_mutex);
+      journal->checkpoint_stopping = true;
+    }
+    journal->checkpoint_changed.notify_all();
+    journal->checkpoint_thread.join();
+    journal->checkpoint_stopping = false;
+  }
+  journal->log.close();
+}
+
+// EFFECTS: Starts writing a checkpoint of game on a background thread,
+//          unless the previous checkpoint is still being written (in which
+//          case we'll try again after the next record).
+void Journal_checkpoint(Journal *journal, const Game *game) {
+  if (journal->checkpoint_running) {
+    return;
+  }
+
+  // Rotate the log so that the current one only holds records newer than
+  // this checkpoint. If an old log is still around, a previous checkpoint
+  // failed, and its records are still needed. In that case, keep appending
+  // to the current log - recovery skips records the checkpoint covers.
+  if (!file_exists(journal->old_log_filename)) {
+    journal->log.close();
+    std::rename(journal->log_filename.c_str(), journal->old_log_filename.c_str());
+    journal->log.open(journal->log_filename, std::ios::binary | std::ios::trunc);
+  }
+  journal->records_since_checkpoint = 0;
+
+  // Copying the game here gives the background thread a consistent board
+  // that later moves won't touch. The copy reuses the memory of the last
+  // one.
+  journal->snapshot = *game;
+  journal->snapshot_seq = journal->seq;
+  if (!journal->checkpoint_thread.joinable()) {
+    journal->checkpoint_thread = std::thread(Journal_checkpoint_worker, journal);
+  }
+  {
+    std::lock_guard<std::mutex> lock(journal->checkpoint_mutex);
+    journal->checkpoint_running = true;
+  }
+  journal->checkpoint_changed.notify_all();
+}
+
+// EFFECTS: Writes each checkpoint Journal_checkpoint() starts, until
+//          Journal_close() stops it.
+void Journal_checkpoint_worker(Journal *journal) {
+  Trace_name_thread("checkpoint");
+  std::unique_lock<std::mutex> lock(journal->checkpoint_mutex);
+  while (true) {
+    journal->checkpoint_changed.wait(lock, [journal]() {
+      return journal->checkpoint_running || journal->checkpoint_stopping;
+    });
+    if (!journal->checkpoint_running) {
+      return;
+    }
+    lock.unlock();
+    {
+      TRACE_SPAN("checkpoint");
+      write_checkpoint(journal->snapshot, journal->snapshot_seq,
+                       journal->checkpoint_filename, journal->old_log_filename);
+    }
+    lock.lock();
+    journal->checkpoint_running = false;
+    journal->checkpoint_changed.notify_all();
+  }
+}
+
+// EFFECTS: Blocks until the background checkpoint (if any) has finished.
+void Journal_wait(Journal *journal) {
+  std::unique_lock<std::mutex> lock(journal->checkpoint_mutex);
+  journal->checkpoint_changed.wait(lock, [journal]() { return !journal->checkpoint_running; });
+}
+
+// EFFECTS: Writes the checkpoint to a temporary file, then renames it over
+//          the previous checkpoint, so a crash part way through never
+//          leaves a damaged checkpoint behind. The file is synced to disk
+//          before the rename, and the rename before the old log is removed,
+//          so that even after a power loss the disk never holds a new
+//          checkpoint without its data, or lacks both the old log and the
+//          checkpoint that replaces it.
+void write_checkpoint(const Game &game, uint32_t seq,
+                      const std::string &filename, const std::string &old_log_filename) {
+  std::string tmp_filename = filename + ".tmp";
+  {
+    std::ofstream out(tmp_filename);
+    out << seq << std::endl;
+    Game_save(&game, out);
+    out.flush();
+    if (!out) {
+      std::cerr << "Autosave failed: could not write " << tmp_filename << std::endl;
+      return;
+    }
+  }
+  if (!sync_file(tmp_filename, O_RDONLY)) {
+    std::cerr << "Autosave failed: could not sync " << tmp_filename << std::endl;
+    return;
+  }
+  if (std::rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+    std::cerr << "Autosave failed: could not replace " << filename << std::endl;
+    return;
+  }
+  size_t slash = filename.rfind('/');
+  std::string directory = slash == std::string::npos ? "." : filename.substr(0, slash + 1);
+  if (!sync_file(directory, O_RDONLY | O_DIRECTORY)) {
+    std::cerr << "Autosave failed: could not sync " << directory << std::endl;
+    return;
+  }
+  std::remove(old_log_filename.c_str());
+}
+
+// EFFECTS: Applies every valid record in the given log with a sequence
+//          number greater than journal->seq. Stops at the first damaged
+//          or incomplete record.
+void replay_log(Journal *journal, Game *game, const std::string &filename) {
+  std::ifstream fin(filename, std::ios::binary);
+  JournalRecord record;
+  while (fin.read(reinterpret_cast<char *>(&record), sizeof(record))) {
+    if (record.checksum != record_checksum(record) ||
+        !Game_in_bounds(game, record.x, record.y)) {
+      return;
+    }
+    if (record.seq <= journal->seq) {
+      continue; // already part of the checkpoint
+    }
+    if (record.op == JOURNAL_REVEAL) {
+      Game_reveal(game, record.x, record.y);
+    }
+    else if (record.op == JOURNAL_FLAG) {
+      Game_toggle_flag(game, record.x, record.y);
+    }
+    else {
+      return;
+    }
+    journal->seq = record.seq;
+  }
+}
+
+uint8_t record_checksum(const JournalRecord &record) {
+  // The checksum is the last byte, so it isn't included in the sum.
+  const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&record);
+  uint8_t sum = 0x5A;
+  for(size_t i = 0; i < sizeof(record) - 1; ++i) {
+    sum = static_cast<uint8_t>((sum << 1 | sum >> 7) ^ bytes[i]);
+  }
+  return sum;
+}
+
+bool file_exists(const std::string &filename) {
+  return std::ifstream(filename).good();
+}
+
+// EFFECTS: Flushes the file (or directory) to disk, opening it with the
+//          given flags. Returns false if it couldn't be.
+bool sync_file(const std::string &filename, int flags) {
+  int fd = open(filename.c_str(), flags);
+  if (fd < 0) {
+    return false;
+  }
+  bool synced = fsync(fd) == 0;
+  close(fd);
+  return synced;
+}
@@ -0,0 +1,94 @@
+#ifndef JOURNAL_HPP
+#define JOURNAL_HPP
+
+#include "Game.hpp"
+#include <string>
+#include <fstream>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+// An autosave journal consists of up to three files sharing a base name:
+//   <base>.ckpt     - the latest checkpoint: a sequence number followed by a
+//                     full Game_save() snapshot
+//   <base>.log      - fixed-size JournalRecords appended after every move
+//   <base>.log.old  - the previous log, kept until the checkpoint that
+//                     replaces it has been completely written
+// Recovery loads the checkpoint and replays every logged record with a
+// sequence number greater than the checkpoint's.
+
+enum JournalOp {
+  JOURNAL_REVEAL = 1,
+  JOURNAL_FLAG = 2,
+};
+
+// A single logged move. Records are written to the log as raw bytes, so
+// every field has a fixed size. A record whose checksum does not match
+// (e.g. a partial write at the end of the log after a crash) is ignored.
+struct JournalRecord {
+  uint32_t seq;
+  int32_t x;
+  int32_t y;
+  uint8_t op;
+  uint8_t padding[2];
+  uint8_t checksum;
+};
+
+static_assert(sizeof(JournalRecord) == 16, "JournalRecord must be 16 bytes");
+
+struct Journal {
+  std::string checkpoint_filename;
+  std::string log_filename;
+  std::string old_log_filename;
+  std::ofstream log;
+  uint32_t seq; // sequence number of the last move recorded
+  int checkpoint_interval;
+  int records_since_checkpoint;
+
+  // Checkpoints are written from a copy of the game by a background thread.
+  // It's started with the first checkpoint and runs until Journal_close(),
+  // so checkpoints don't each start a thread of their own.
+  std::thread checkpoint_thread;
+  std::mutex checkpoint_mutex;
+  std::condition_variable checkpoint_changed; // a checkpoint started or finished
+  Game snapshot;         // only touched by the thread while a checkpoint runs
+  uint32_t snapshot_seq;
+  std::atomic<bool> checkpoint_running;
+  bool checkpoint_stopping; // guarded by checkpoint_mutex
+};
+
+// REQUIRES: checkpoint_interval > 0
+// EFFECTS: Initializes a Journal that uses the files with the given base
+//          name. A checkpoint is started after every checkpoint_interval
+//          records. No files are touched until Journal_recover() or
+//          Journal_begin() is called.
+void Journal_init(Journal *journal, const std::string &base, int checkpoint_interval);
+
+// EFFECTS: If the journal's files record a game, restores it into game
+//          (latest checkpoint plus the log tail) and returns true.
+//          Otherwise, returns false and leaves game untouched.
+bool Journal_recover(Journal *journal, Game *game);
+
+// EFFECTS: Synchronously writes a checkpoint of game and starts a fresh,
+//          empty log. Must be called before the first Journal_record().
+void Journal_begin(Journal *journal, const Game *game);
+
+// REQUIRES: Journal_begin() has been called
+// EFFECTS: Appends a record of the given move to the log. If enough records
+//          have been written since the last checkpoint, starts writing a
+//          new checkpoint of game in the background.
+void Journal_record(Journal *journal, const Game *game, JournalOp op, int x, int y);
+
+// REQUIRES: Journal_begin() has been called
+// EFFECTS: Starts writing a checkpoint of game in the background if any
+//          records have been written since the last one, so that a UI can
+//          checkpoint periodically while the player is idle. Never waits
+//          for a checkpoint already in progress.
+void Journal_tick(Journal *journal, const Game *game);
+
+// EFFECTS: Waits for any checkpoint in progress and closes the log.
+void Journal_close(Journal *journal);
+
+#endif
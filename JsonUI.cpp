@@ -0,0 +1,425 @@
+#include "JsonUI.hpp"
+#include "Stats.hpp"
+#include "Trace.hpp"
+#include <fstream>
+#include <string>
+#include <cctype>
+#include <cstdlib>
+#include <climits>
+#include <cstdio>
+
+// The fields of a request that the protocol understands
+struct JsonRequest {
+  std::string id; // JSON text to echo for the id, empty if there was none
+  std::string cmd;
+  std::string file;
+  long long x;
+  long long y;
+  bool has_x;
+  bool has_y;
+};
+
+// "Private" function declarations
+std::string parse_request(const std::string &line, JsonRequest &request);
+void append_cell(std::string &response, const Cell *cell);
+void append_string(std::string &response, const std::string &str);
+bool is_number(const std::string &str);
+void append_state(JsonUI *ui, std::string &response);
+
+void JsonUI_init(JsonUI *ui, Game *game, std::istream &in, std::ostream &out) {
+  ui->game = game;
+  ui->journal = nullptr;
+  ui->spectator = nullptr;
+  ui->in = &in;
+  ui->out = &out;
+  ui->save_dir.clear();
+}
+
+void JsonUI_enable_autosave(JsonUI *ui, Journal *journal) {
+  ui->journal = journal;
+}
+
+void JsonUI_enable_spectate(JsonUI *ui, Spectator *spectator) {
+  ui->spectator = spectator;
+}
+
+bool JsonUI_handle(JsonUI *ui, const std::string &line, std::string &response) {
+  TRACE_SPAN("request");
+  Game *game = ui->game;
+  JsonRequest request;
+  std::string error = parse_request(line, request);
+  if (error.empty()) {
+    if (request.cmd == "reveal" || request.cmd == "flag") {
+      if (!request.has_x || !request.has_y) {
+        error = "x and y are required";
+      }
+      else if (!Game_in_bounds(game, request.x, request.y)) {
+        error = "out of bounds";
+      }
+      else if (Game_is_over(game)) {
+        error = "game is over";
+      }
+    }
+    else if (request.cmd == "save") {
+      if (request.file.empty()) {
+        error = "file is required";
+      }
+      else if (!ui->save_dir.empty() &&
+               (request.file.find('/') != std::string::npos ||
+                request.file == "." || request.file == "..")) {
+        error = "file must be a name, not a path";
+      }
+    }
+    else if (request.cmd != "board" && request.cmd != "status" && request.cmd != "quit") {
+      error = "unknown cmd";
+    }
+  }
+
+  response += '{';
+  if (!request.id.empty()) {
+    response += "\"id\":" + request.id + ',';
+  }
+  if (!error.empty()) {
+    response += "\"ok\":false,\"error\":\"" + error + "\"}\n";
+    return true;
+  }
+
+  int x = request.x;
+  int y = request.y;
+  if (request.cmd == "reveal") {
+    Game_reveal(game, x, y);
+    if (ui->spectator) {
+      Spectator_publish(ui->spectator, game);
+    }
+    if (ui->journal) {
+      Journal_record(ui->journal, game, JOURNAL_REVEAL, x, y);
+    }
+  }
+  else if (request.cmd == "flag") {
+    Game_toggle_flag(game, x, y);
+    if (ui->spectator) {
+      Spectator_publish(ui->spectator, game);
+    }
+    if (ui->journal) {
+      Journal_record(ui->journal, game, JOURNAL_FLAG, x, y);
+    }
+  }
+  else if (request.cmd == "save") {
+    std::ofstream fout(ui->save_dir.empty() ? request.file : ui->save_dir + '/' + request.file);
+    Game_save(game, fout);
+    if (!fout) {
+      response += "\"ok\":false,\"error\":\"could not write file\"}\n";
+      return true;
+    }
+  }
+
+  response += "\"ok\":true,";
+  if (request.cmd == "reveal" || request.cmd == "flag") {
+    // Only the cells the move changed are sent.
+    response += "\"cells\":[";
+    const std::vector<std::pair<int, int>> &changes = Game_changes(game);
+    for(size_t i = 0; i < changes.size(); ++i) {
+      if (i > 0) {
+        response += ',';
+      }
+      append_cell(response, Game_cell(game, changes[i].first, changes[i].second));
+    }
+    response += "],";
+  }
+  else if (request.cmd == "board") {
+    response += "\"cells\":[";
+    bool first = true;
+    GameView view = Game_view(game, 0, 0, Game_width(game), Game_height(game));
+    for(int cx = 0; cx < view.width; ++cx) {
+      const Cell *cell = GameView_cell(&view, cx, 0);
+      for(int cy = 0; cy < view.height; ++cy, cell += view.y_stride) {
+        if (cell->state != HIDDEN) {
+          if (!first) {
+            response += ',';
+          }
+          append_cell(response, cell);
+          first = false;
+        }
+      }
+    }
+    response += "],";
+  }
+  else if (request.cmd == "status") {
+    response += "\"width\":" + std::to_string(Game_width(game))
+              + ",\"height\":" + std::to_string(Game_height(game))
+              + ",\"treasures\":" + std::to_string(Game_num_treasures(game))
+              + ",\"traps\":" + std::to_string(Game_num_traps(game))
+              + ",\"flags\":" + std::to_string(Game_num_flags(game)) + ',';
+  }
+  append_state(ui, response);
+  response += "}\n";
+  return request.cmd != "quit";
+}
+
+void JsonUI_play(JsonUI *ui) {
+  std::string line;
+  std::string response;
+  bool running = true;
+  while (running && std::getline(*ui->in, line)) {
+    if (line.find_first_not_of(" \t\r") == std::string::npos) {
+      continue; // ignore blank lines
+    }
+    running = JsonUI_handle(ui, line, response);
+
+    // Keep answering requests that have already arrived before writing, so
+    // a bot that pipelines many requests gets its responses in one write.
+    if (ui->in->rdbuf()->in_avail() <= 0) {
+      STATS_TIME(STAT_UI_OUTPUT);
+      ui->out->write(response.data(), response.size());
+      ui->out->flush();
+      response.clear();
+    }
+  }
+  ui->out->write(response.data(), response.size());
+  ui->out->flush();
+}
+
+// EFFECTS: Appends [x, y, state, item, count] for the cell. Item and count
+//          are only given (otherwise -1) for revealed cells, so that bots
+//          can't see what a hidden cell holds.
+void append_cell(std::string &response, const Cell *cell) {
+  bool revealed = cell->state == REVEALED;
+  response += '[';
+  response += std::to_string(cell->x);
+  response += ',';
+  response += std::to_string(cell->y);
+  response += ',';
+  response += std::to_string(cell->state);
+  response += ',';
+  response += revealed ? std::to_string(cell->item) : "-1";
+  response += ',';
+  response += revealed ? std::to_string(cell->num_adjacent_traps) : "-1";
+  response += ']';
+}
+
+// EFFECTS: Appends str as a JSON string, in quotes and with the characters
+//          JSON doesn't allow in strings escaped.
+void append_string(std::string &response, const std::string &str) {
+  response += '"';
+  for(char c : str) {
+    if (c == '"' || c == '\\') {
+      response += '\\';
+      response += c;
+    }
+    else if (c == '\n') {
+      response += "\\n";
+    }
+    else if (c == '\t') {
+      response += "\\t";
+    }
+    else if (static_cast<unsigned char>(c) < 0x20) {
+      char code[8];
+      snprintf(code, sizeof(code), "\\u%04x", static_cast<unsigned>(c));
+      response += code;
+    }
+    else {
+      response += c;
+    }
+  }
+  response += '"';
+}
+
+// EFFECTS: Appends the fields describing the progress of the game.
+void append_state(JsonUI *ui, std::string &response) {
+  Game *game = ui->game;
+  response += "\"found\":" + std::to_string(Game_num_treasures_found(game))
+            + ",\"traps_found\":" + std::to_string(Game_num_traps_found(game))
+            + ",\"revealed\":" + std::to_string(Game_num_revealed(game))
+            + ",\"state\":";
+  if (!Game_is_over(game)) {
+    response += "\"playing\"";
+  }
+  else if (Game_num_traps_found(game) > 0) {
+    response += "\"lost\"";
+  }
+  else {
+    response += "\"won\"";
+  }
+}
+
+///////////////////////////////////////////////////////////
+// A minimal parser for flat JSON objects. Values may be //
+// strings, numbers, booleans or null, but not objects   //
+// or arrays.                                            //
+///////////////////////////////////////////////////////////
+
+void skip_space(const std::string &line, size_t &i) {
+  while (i < line.size() && std::isspace(static_cast<unsigned char>(line[i]))) {
+    ++i;
+  }
+}
+
+// EFFECTS: Parses the string starting at line[i] (which must be a quote)
+//          into str, and moves i past it. Returns false if it's malformed.
+bool parse_string(const std::string &line, size_t &i, std::string &str) {
+  str.clear();
+  ++i; // opening quote
+  while (i < line.size() && line[i] != '"') {
+    char c = line[i++];
+    if (c == '\\') {
+      if (i >= line.size()) {
+        return false;
+      }
+      c = line[i++];
+      if (c == 'n') {
+        c = '\n';
+      }
+      else if (c == 't') {
+        c = '\t';
+      }
+      else if (c != '"' && c != '\\' && c != '/') {
+        return false; // other escapes aren't needed by the protocol
+      }
+    }
+    str += c;
+  }
+  if (i >= line.size()) {
+    return false;
+  }
+  ++i; // closing quote
+  return true;
+}
+
+// EFFECTS: Returns true if str is a number written the way JSON allows,
+//          such as 12, -3.5 or 1e9 (but not 012, +1 or 1.).
+bool is_number(const std::string &str) {
+  auto digit = [&str](size_t i) {
+    return i < str.size() && std::isdigit(static_cast<unsigned char>(str[i]));
+  };
+  size_t i = 0;
+  if (i < str.size() && str[i] == '-') {
+    ++i;
+  }
+  if (!digit(i)) {
+    return false;
+  }
+  if (str[i] == '0') {
+    ++i;
+  }
+  else {
+    while (digit(i)) {
+      ++i;
+    }
+  }
+  if (i < str.size() && str[i] == '.') {
+    if (!digit(++i)) {
+      return false;
+    }
+    while (digit(i)) {
+      ++i;
+    }
+  }
+  if (i < str.size() && (str[i] == 'e' || str[i] == 'E')) {
+    ++i;
+    if (i < str.size() && (str[i] == '+' || str[i] == '-')) {
+      ++i;
+    }
+    if (!digit(i)) {
+      return false;
+    }
+    while (digit(i)) {
+      ++i;
+    }
+  }
+  return i == str.size();
+}
+
+std::string parse_request(const std::string &line, JsonRequest &request) {
+  request = JsonRequest{"", "", "", -1, -1, false, false};
+  size_t i = 0;
+  skip_space(line, i);
+  if (i >= line.size() || line[i] != '{') {
+    return "expected an object";
+  }
+  ++i;
+  skip_space(line, i);
+  bool done = i < line.size() && line[i] == '}';
+  if (done) {
+    ++i;
+  }
+  while (!done) {
+    std::string key;
+    skip_space(line, i);
+    if (i >= line.size() || line[i] != '"' || !parse_string(line, i, key)) {
+      return "expected a key";
+    }
+    skip_space(line, i);
+    if (i >= line.size() || line[i] != ':') {
+      return "expected ':'";
+    }
+    ++i;
+    skip_space(line, i);
+
+    size_t start = i;
+    std::string str;
+    bool is_string = false;
+    if (i < line.size() && line[i] == '"') {
+      if (!parse_string(line, i, str)) {
+        return "malformed string";
+      }
+      is_string = true;
+    }
+    else {
+      while (i < line.size() && (std::isalnum(static_cast<unsigned char>(line[i])) ||
+                                 line[i] == '-' || line[i] == '+' || line[i] == '.')) {
+        ++i;
+      }
+      str = line.substr(start, i - start);
+      if (str.empty()) {
+        return "unsupported value";
+      }
+    }
+
+    if (key == "id") {
+      // The id is echoed back, so only accept what can be written back out
+      // as valid JSON.
+      request.id.clear();
+      if (is_string) {
+        append_string(request.id, str);
+      }
+      else if (is_number(str)) {
+        request.id = str;
+      }
+      else {
+        return "id must be a number or a string";
+      }
+    }
+    else if (key == "cmd" || key == "file") {
+      if (!is_string) {
+        return key + " must be a string";
+      }
+      (key == "cmd" ? request.cmd : request.file) = str;
+    }
+    else if (key == "x" || key == "y") {
+      char *end = nullptr;
+      long long n = std::strtoll(str.c_str(), &end, 10);
+      if (is_string || *end != '\0' || n < INT_MIN || INT_MAX < n) {
+        return key + " must be an integer";
+      }
+      (key == "x" ? request.x : request.y) = n;
+      (key == "x" ? request.has_x : request.has_y) = true;
+    }
+
+    skip_space(line, i);
+    if (i < line.size() && line[i] == ',') {
+      ++i;
+    }
+    else if (i < line.size() && line[i] == '}') {
+      ++i;
+      done = true;
+    }
+    else {
+      return "expected ',' or '}'";
+    }
+  }
+  skip_space(line, i);
+  if (i != line.size()) {
+    return "unexpected text after object";
+  }
+  return "";
+}
@@ -0,0 +1,59 @@
+#ifndef JSON_UI_HPP
+#define JSON_UI_HPP
+
+#include "Game.hpp"
+#include "Journal.hpp"
+#include "Spectator.hpp"
+#include <iostream>
+#include <string>
+
+// A line-delimited JSON protocol for bots. Each request is one JSON object
+// on its own line, and gets exactly one response line, in order:
+//
+//   {"id":1,"cmd":"reveal","x":3,"y":4}
+//   {"id":1,"ok":true,"cells":[[3,4,1,0,2]],"found":0,"traps_found":0,"revealed":1,"state":"playing"}
+//
+// Commands:
+//   reveal, flag  Require "x" and "y". "cells" lists only the cells the move
+//                 changed, each as [x, y, state, item, count]. Item and count
+//                 are -1 unless the cell is REVEALED.
+//   board         "cells" lists every cell that isn't HIDDEN.
+//   status        Includes the board dimensions and totals.
+//   save          Saves the game to the file given by "file".
+//   quit          Ends the session after responding.
+//
+// "id" is optional. It may be a number or a string, and is echoed back in
+// the response. Errors are reported as
+//   {"id":1,"ok":false,"error":"..."}
+// and leave the session open. Requests may be pipelined: responses are held
+// back until every request already received has been answered.
+
+struct JsonUI {
+  Game *game;
+  Journal *journal; // nullptr unless autosave is enabled
+  Spectator *spectator; // nullptr unless spectating is enabled
+  std::istream *in;
+  std::ostream *out;
+
+  // If set, "save" may only name a file (not a path), which is written to
+  // this directory. Used when requests come from the network.
+  std::string save_dir;
+};
+
+void JsonUI_init(JsonUI *ui, Game *game, std::istream &in, std::ostream &out);
+
+// EFFECTS: Records every reveal and flag in journal.
+void JsonUI_enable_autosave(JsonUI *ui, Journal *journal);
+
+// EFFECTS: Publishes every move made through the UI to spectator.
+void JsonUI_enable_spectate(JsonUI *ui, Spectator *spectator);
+
+// EFFECTS: Handles a single request line, appending the response line to
+//          response. Returns false if the request asked to quit.
+bool JsonUI_handle(JsonUI *ui, const std::string &request, std::string &response);
+
+// EFFECTS: Handles requests from the input stream until it ends or a quit
+//          request is received.
+void JsonUI_play(JsonUI *ui);
+
+#endif
@@ -1,7 +1,10 @@
 #include <cassert>
+#include <algorithm>
 #include <ncurses.h>
 #include "Game.hpp"
 #include "KeyboardUI.hpp"
+#include "Stats.hpp"
+#include "Trace.hpp"
 
 const std::vector<std::string> colors = {
   "\033[0m",  // reset
@@ -15,15 +18,39 @@ const std::vector<std::string> colors = {
   "\033[35m", // magenta
 };
 
+// The pad extends this many screens around the viewport, so that moving the
+// cursor only refills it once the viewport has moved about a screen away.
+const int PAD_SCREENS = 3;
+
+// While autosaving, an idle player's moves are checkpointed this often
+const std::chrono::seconds AUTOSAVE_TICK(10);
+
 // "Private" function declarations
 void KeyboardUI_init_curses(KeyboardUI *ui);
+void KeyboardUI_fit(KeyboardUI *ui);
 
 void KeyboardUI_init(KeyboardUI *ui, Game *game) {
   ui->game = game;
   ui->cursor_x = Game_width(ui->game) / 2;
   ui->cursor_y = Game_height(ui->game) / 2;
+  ui->journal = nullptr;
+  ui->spectator = nullptr;
+  ui->repaint = true;
+  ui->board_window = nullptr;
+  ui->status_window = nullptr;
+  ui->pad_row = ui->pad_col = ui->pad_height = ui->pad_width = 0;
+  ui->view_row = ui->view_col = ui->view_height = ui->view_width = 0;
+  ui->cell_width = Game_topology(game) == TOPOLOGY_HEX ? 2 : 1;
   KeyboardUI_init_curses(ui);
 }
+
+void KeyboardUI_enable_autosave(KeyboardUI *ui, Journal *journal) {
+  ui->journal = journal;
+}
+
+void KeyboardUI_enable_spectate(KeyboardUI *ui, Spectator *spectator) {
+  ui->spectator = spectator;
+}
 constexpr int COLOR_TREASURE = 9;
 constexpr int COLOR_TRAP = 10;
 constexpr int COLOR_HIDDEN = 11;
@@ -53,80 +80,242 @@ void KeyboardUI_init_curses(KeyboardUI *ui) {
   init_pair(COLOR_EMPTY, COLOR_WHITE, COLOR_BLACK);
   
   // board takes up everything except the last row
-  ui->board_window = subwin(stdscr, Game_height(ui->game), Game_width(ui->game), 0, 0);
+  KeyboardUI_fit(ui);
+
+  // Mark stdscr as up to date. Otherwise, the first getch() refreshes it,
+  // which moves the cursor away from the board.
+  wnoutrefresh(stdscr);
 
-  // status bar in the last row
-  // ui->status_window = subwin(main_window, 1, getmaxx(main_window), getmaxy(main_window) - 1, getbegx(main_window));
 }
 
-void render_cell(KeyboardUI *ui, const Cell *cell) {
-  char c;
+// EFFECTS: Returns the character for the cell, with its color pair built
+//          in, so that drawing a cell never needs a separate attribute call.
+chtype cell_char(const Cell *cell) {
   if (cell->state == HIDDEN) {
-    wattr_on(ui->board_window, COLOR_PAIR(COLOR_HIDDEN), NULL);
-    c = ' ';
+    return ' ' | COLOR_PAIR(COLOR_HIDDEN);
   }
   else if (cell->state == FLAG) {
-    wattr_on(ui->board_window, COLOR_PAIR(COLOR_FLAG), NULL);
-    c = 'F';
+    return 'F' | COLOR_PAIR(COLOR_FLAG);
   }
   else if (cell->state == REVEALED) {
     if (cell->item == EMPTY) {
       if (cell->num_adjacent_traps == 0) {
-        wattr_on(ui->board_window, COLOR_PAIR(COLOR_EMPTY), NULL);
-        c = ' ';
+        return ' ' | COLOR_PAIR(COLOR_EMPTY);
       }
       else {
-        wattr_on(ui->board_window, COLOR_PAIR(cell->num_adjacent_traps), NULL);
-        c = '0' + cell->num_adjacent_traps;
+        return ('0' + cell->num_adjacent_traps) | COLOR_PAIR(cell->num_adjacent_traps);
       }
     }
     else if (cell->item == TREASURE) {
-      wattr_on(ui->board_window, COLOR_PAIR(COLOR_TREASURE), NULL);
-      c = '$';
+      return '$' | COLOR_PAIR(COLOR_TREASURE);
     }
     else if (cell->item == TRAP) {
-      wattr_on(ui->board_window, COLOR_PAIR(COLOR_TRAP), NULL);
-      c = 'X';
+      return 'X' | COLOR_PAIR(COLOR_TRAP);
     }
-    else {
-      assert(false);
+  }
+  assert(false);
+  return ' ';
+}
+
+// EFFECTS: Sizes the viewport and the pad to the terminal, recreating the
+//          pad if its size changed. Called every frame so that a resized
+//          terminal (KEY_RESIZE) is picked up.
+void KeyboardUI_fit(KeyboardUI *ui) {
+  // status bar in the last row
+  if (ui->status_window &&
+      (getbegy(ui->status_window) != LINES - 1 || getmaxx(ui->status_window) != COLS)) {
+    delwin(ui->status_window);
+    ui->status_window = nullptr;
+  }
+  if (!ui->status_window) {
+    ui->status_window = newwin(1, COLS, LINES - 1, 0);
+    ui->status.clear();
+  }
+
+  // On a hex board, one more column is needed for the shifted rows.
+  int view_height = std::max(1, std::min(LINES - 1, Game_height(ui->game)));
+  int view_width = std::max(1, std::min((COLS - ui->cell_width + 1) / ui->cell_width,
+                                        Game_width(ui->game)));
+  if (ui->board_window && view_height == ui->view_height && view_width == ui->view_width) {
+    return;
+  }
+  ui->view_height = view_height;
+  ui->view_width = view_width;
+
+  int pad_height = std::min(PAD_SCREENS * view_height, Game_height(ui->game));
+  int pad_width = std::min(PAD_SCREENS * view_width, Game_width(ui->game));
+  if (!ui->board_window || pad_height != ui->pad_height || pad_width != ui->pad_width) {
+    if (ui->board_window) {
+      delwin(ui->board_window);
     }
+    ui->board_window = newpad(pad_height, pad_width * ui->cell_width + ui->cell_width - 1);
+    ui->pad_height = pad_height;
+    ui->pad_width = pad_width;
+  }
+  // Start from a viewport centered on the cursor
+  ui->view_row = Game_height(ui->game)-1 - ui->cursor_y - view_height / 2;
+  ui->view_col = ui->cursor_x - view_width / 2;
+  ui->pad_row = ui->pad_col = -1; // forces the pad to be placed around it
+
+  // Anything on the terminal outside the board is stale after a resize.
+  clear();
+  wnoutrefresh(stdscr);
+  ui->repaint = true;
+  ui->status.clear();
+}
+
+// EFFECTS: Returns value moved into [low, high].
+int clamp(int value, int low, int high) {
+  return std::max(low, std::min(value, high));
+}
+
+// EFFECTS: Scrolls the viewport as little as possible to show the cursor,
+//          and moves the pad (marking it for repaint) if the viewport is
+//          no longer inside it.
+void KeyboardUI_follow_cursor(KeyboardUI *ui) {
+  int height = Game_height(ui->game);
+  int width = Game_width(ui->game);
+  int row = height-1 - ui->cursor_y;
+  int col = ui->cursor_x;
+  ui->view_row = clamp(ui->view_row, row - ui->view_height + 1, row);
+  ui->view_row = clamp(ui->view_row, 0, height - ui->view_height);
+  ui->view_col = clamp(ui->view_col, col - ui->view_width + 1, col);
+  ui->view_col = clamp(ui->view_col, 0, width - ui->view_width);
+
+  if (ui->pad_row < 0 ||
+      ui->view_row < ui->pad_row || ui->pad_row + ui->pad_height < ui->view_row + ui->view_height ||
+      ui->view_col < ui->pad_col || ui->pad_col + ui->pad_width < ui->view_col + ui->view_width) {
+    // Center the pad on the viewport
+    ui->pad_row = clamp(ui->view_row - (ui->pad_height - ui->view_height) / 2,
+                        0, height - ui->pad_height);
+    ui->pad_col = clamp(ui->view_col - (ui->pad_width - ui->view_width) / 2,
+                        0, width - ui->pad_width);
+    ui->repaint = true;
+  }
+}
+
+// EFFECTS: Returns how many columns row y is shifted right. On a hex board
+//          odd rows are shifted half a cell, as in CommandUI.
+int row_indent(const KeyboardUI *ui, int y) {
+  return ui->cell_width == 2 && y % 2 == 1;
+}
+
+// EFFECTS: Returns the pad column where the cell at (x,y) starts.
+int pad_column(const KeyboardUI *ui, int x, int y) {
+  return (x - ui->pad_col) * ui->cell_width + row_indent(ui, y);
+}
+
+// REQUIRES: the pad covers the cell at (x,y)
+// EFFECTS: Draws the cell at (x,y), filling every column of it with the
+//          cell's color.
+void draw_cell(KeyboardUI *ui, int x, int y, const Cell *cell) {
+  chtype ch = cell_char(cell);
+  mvwaddch(ui->board_window, Game_height(ui->game)-1 - y - ui->pad_row,
+           pad_column(ui, x, y), ch);
+  if (ui->cell_width == 2) {
+    waddch(ui->board_window, ' ' | (ch & A_COLOR));
+  }
+}
+
+// EFFECTS: Draws the cell into the pad, if the pad currently covers it.
+void render_cell(KeyboardUI *ui, int x, int y) {
+  int row = Game_height(ui->game)-1 - y - ui->pad_row;
+  int col = x - ui->pad_col;
+  if (row < 0 || ui->pad_height <= row || col < 0 || ui->pad_width <= col) {
+    return;
+  }
+  draw_cell(ui, x, y, Game_cell(ui->game, x, y));
+}
+
+// EFFECTS: Returns the time on the game clock in seconds.
+long long KeyboardUI_elapsed(KeyboardUI *ui) {
+  std::chrono::steady_clock::time_point now =
+    Game_is_over(ui->game) ? ui->end_time : std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::seconds>(now - ui->start_time).count();
+}
+
+// EFFECTS: Redraws the status line, if its text has changed.
+void KeyboardUI_render_status(KeyboardUI *ui) {
+  Game *game = ui->game;
+  long long elapsed = KeyboardUI_elapsed(ui);
+  std::string seconds = std::to_string(elapsed % 60);
+  std::string time = std::to_string(elapsed / 60) + ":" + (seconds.size() < 2 ? "0" : "") + seconds;
+
+  std::string status;
+  if (!Game_is_over(game)) {
+    status = "Time " + time
+           + "  Treasures " + std::to_string(Game_num_treasures_found(game))
+           + "/" + std::to_string(Game_num_treasures(game))
+           + "  Flags " + std::to_string(Game_num_flags(game));
+  }
+  else if (Game_num_treasures_found(game) == Game_num_treasures(game)) {
+    status = "Yarrr! Ye found all " + std::to_string(Game_num_treasures(game))
+           + " treasures in " + time + ". Press q to quit.";
   }
   else {
-    assert(false);
+    status = "Avast! Ye hit a trap! Ye found " + std::to_string(Game_num_treasures_found(game))
+           + "/" + std::to_string(Game_num_treasures(game)) + " treasures. Press q to quit.";
+  }
+
+  if (status != ui->status) {
+    werase(ui->status_window);
+    mvwaddnstr(ui->status_window, 0, 0, status.c_str(), COLS - 1);
+    wnoutrefresh(ui->status_window);
+    ui->status = status;
   }
-  waddch(ui->board_window, c);
 }
 
 void KeyboardUI_render(KeyboardUI *ui) {
-  // Render board
-  wrefresh(ui->board_window);
-  wclear(ui->board_window);
-  for(int y = Game_height(ui->game)-1; y >= 0; --y) {
-    for(int x = 0; x < Game_width(ui->game); ++x) {
-      const Cell *cell = Game_cell(ui->game, x, y);
-      render_cell(ui, cell);
+  STATS_TIME(STAT_UI_RENDER);
+  TRACE_SPAN("render");
+  KeyboardUI_fit(ui);
+  KeyboardUI_follow_cursor(ui);
+
+  // The pad is only filled when it is created or moved. Otherwise, only
+  // cells changed by moves are redrawn.
+  if (ui->repaint) {
+    int bottom_y = Game_height(ui->game) - ui->pad_row - ui->pad_height;
+    GameView view = Game_view(ui->game, ui->pad_col, bottom_y, ui->pad_width, ui->pad_height);
+    for(int row = 0; row < ui->pad_height; ++row) {
+      int y = bottom_y + ui->pad_height-1 - row;
+      const Cell *cell = GameView_cell(&view, 0, y - bottom_y);
+      for(int x = ui->pad_col; x < ui->pad_col + ui->pad_width; ++x, cell += view.x_stride) {
+        draw_cell(ui, x, y, cell);
+      }
     }
-    // wmove(ui->board_window, y, 0);
-  }
-
-  // for(int r = 0; r < Game_height(ui->game); r++) {
-  //   for(int c = 0; c < Game_width(ui->game); c++) {
-  //     const Cell *cell = Game_cell(ui->game, r, c);
-  //     render_cell(ui, cell);
-      
-  //     // wattr_off(ui->board_window, COLOR_PAIR(cell->item), NULL);
-  //   }
-  // }
-  // wattr_on(ui->board_window, COLOR_PAIR(TRAP), NULL);
-  // mvwaddch(ui->board_window, Game_height(ui->game)-1 - ui->cursor_y, ui->cursor_x, '*');
-  wmove(ui->board_window, Game_height(ui->game)-1 - ui->cursor_y, ui->cursor_x);
-  // wrefresh(ui->status_window);
-  wrefresh(ui->board_window);
-}
-
-bool KeyboardUI_input(KeyboardUI *ui) {
-  int ch = getch();
+    ui->repaint = false;
+  }
+  else {
+    for(const std::pair<int, int> &pos : ui->dirty) {
+      render_cell(ui, pos.first, pos.second);
+    }
+  }
+  ui->dirty.clear();
+
+  KeyboardUI_render_status(ui);
+
+  // The board is refreshed last so the terminal's cursor ends up on it.
+  wmove(ui->board_window, Game_height(ui->game)-1 - ui->cursor_y - ui->pad_row,
+        pad_column(ui, ui->cursor_x, ui->cursor_y));
+
+  // Only the viewport is copied to the screen. curses compares it to what's
+  // already on the terminal, so a frame where only the cursor moved just
+  // sends a cursor movement.
+  pnoutrefresh(ui->board_window,
+               ui->view_row - ui->pad_row, (ui->view_col - ui->pad_col) * ui->cell_width,
+               0, 0, ui->view_height - 1, (ui->view_width + 1) * ui->cell_width - 2);
+  doupdate();
+}
+
+// EFFECTS: Marks the cells changed by the last move to be redrawn.
+void KeyboardUI_mark_changes(KeyboardUI *ui) {
+  const std::vector<std::pair<int, int>> &changes = Game_changes(ui->game);
+  ui->dirty.insert(ui->dirty.end(), changes.begin(), changes.end());
+}
+
+// EFFECTS: Handles a key. Returns false if the player quit.
+bool KeyboardUI_input(KeyboardUI *ui, int ch) {
+  TRACE_SPAN("turn");
   if (ch == 'q') {
     return false;
   }
@@ -142,19 +331,77 @@ bool KeyboardUI_input(KeyboardUI *ui) {
   else if (ch == KEY_RIGHT) {
     ui->cursor_x = (ui->cursor_x + 1) % Game_width(ui->game);
   }
+  else if (Game_is_over(ui->game)) {
+    // no more moves
+  }
   else if (ch == ' ') {
     Game_reveal(ui->game, ui->cursor_x, ui->cursor_y);
+    KeyboardUI_mark_changes(ui);
+    if (ui->spectator) {
+      Spectator_publish(ui->spectator, ui->game);
+    }
+    if (ui->journal) {
+      Journal_record(ui->journal, ui->game, JOURNAL_REVEAL, ui->cursor_x, ui->cursor_y);
+    }
   }
   else if (ch == 'f') {
     Game_toggle_flag(ui->game, ui->cursor_x, ui->cursor_y);
+    KeyboardUI_mark_changes(ui);
+    if (ui->spectator) {
+      Spectator_publish(ui->spectator, ui->game);
+    }
+    if (ui->journal) {
+      Journal_record(ui->journal, ui->game, JOURNAL_FLAG, ui->cursor_x, ui->cursor_y);
+    }
   }
   return true;
 }
 
+// EFFECTS: Runs any timers that are due, and returns how long getch() may
+//          wait (in milliseconds, or -1 for no limit) before one is due.
+int KeyboardUI_run_timers(KeyboardUI *ui) {
+  using namespace std::chrono;
+  steady_clock::time_point now = steady_clock::now();
+  int wait = -1;
+
+  if (!Game_is_over(ui->game)) {
+    // Wake up when the clock reaches the next whole second
+    long long ms = duration_cast<milliseconds>(now - ui->start_time).count();
+    wait = 1000 - ms % 1000;
+  }
+
+  if (ui->journal) {
+    if (now >= ui->next_autosave) {
+      // Starts the checkpoint on a background thread, so it doesn't delay
+      // the next key press.
+      Journal_tick(ui->journal, ui->game);
+      ui->next_autosave = now + AUTOSAVE_TICK;
+    }
+    int autosave_wait = duration_cast<milliseconds>(ui->next_autosave - now).count() + 1;
+    wait = wait < 0 ? autosave_wait : std::min(wait, autosave_wait);
+  }
+  return wait;
+}
+
 void KeyboardUI_play(KeyboardUI *ui) {
-  do {
+  ui->start_time = std::chrono::steady_clock::now();
+  ui->end_time = ui->start_time;
+  ui->next_autosave = ui->start_time + AUTOSAVE_TICK;
+  bool running = true;
+  while (running) {
+    timeout(KeyboardUI_run_timers(ui));
     KeyboardUI_render(ui);
+
+    // getch() returns ERR if a timer is due before a key is pressed.
+    int ch = getch();
+    if (ch != ERR) {
+      running = KeyboardUI_input(ui, ch);
+      if (Game_is_over(ui->game) && ui->end_time == ui->start_time) {
+        ui->end_time = std::chrono::steady_clock::now();
+      }
+    }
   }
-  while (KeyboardUI_input(ui));
+  delwin(ui->status_window);
+  delwin(ui->board_window);
   endwin();
 }
\ No newline at end of file
@@ -2,17 +2,66 @@
 #define KeyboardUI_HPP
 
 #include <ncurses.h>
+#include <chrono>
+#include <string>
 #include "Game.hpp"
+#include "Journal.hpp"
+#include "Spectator.hpp"
 
 struct KeyboardUI {
   Game *game;
+
+  // A pad holding the part of the board around the viewport. Rows are
+  // counted from the top of the board, so board row r is y = height-1 - r.
+  // The pad covers rows [pad_row, pad_row + pad_height) and columns
+  // [pad_col, pad_col + pad_width), and is refilled when the viewport
+  // leaves it. Its size depends only on the terminal size.
   WINDOW *board_window;
-  WINDOW *status_window;
+  int pad_row;
+  int pad_col;
+  int pad_height;
+  int pad_width;
+
+  // The part of the board shown on the terminal, which follows the cursor
+  int view_row;
+  int view_col;
+  int view_height;
+  int view_width;
+
+  // Columns each cell takes up on the terminal. On a hex board cells are
+  // two columns wide, so that odd rows can be shifted by half a cell.
+  int cell_width;
+
+  WINDOW *status_window; // the last row of the terminal
+  std::string status;    // text currently shown in status_window
   int cursor_x;
   int cursor_y;
+  Journal *journal; // nullptr unless autosave is enabled
+  Spectator *spectator; // nullptr unless spectating is enabled
+
+  // After the first frame, only cells marked dirty are redrawn.
+  bool repaint;
+  std::vector<std::pair<int, int>> dirty;
+
+  // Timers for the event loop. The clock stops when the game ends.
+  std::chrono::steady_clock::time_point start_time;
+  std::chrono::steady_clock::time_point end_time;
+  std::chrono::steady_clock::time_point next_autosave;
 };
 
 void KeyboardUI_init(KeyboardUI *ui, Game *game);
+
+// EFFECTS: Records every reveal and flag made through the UI in journal.
+void KeyboardUI_enable_autosave(KeyboardUI *ui, Journal *journal);
+
+// EFFECTS: Publishes every move made through the UI to spectator.
+void KeyboardUI_enable_spectate(KeyboardUI *ui, Spectator *spectator);
+
+// EFFECTS: Runs the game until the player quits. Keyboard input is handled
+//          as soon as it arrives. In between, getch() times out to update
+//          the clock on the status line and to checkpoint the autosave
+//          journal while the player is idle. Once the game is over, the
+//          result is shown and only quitting is allowed.
 void KeyboardUI_play(KeyboardUI *ui);
 
 #endif
\ No newline at end of file
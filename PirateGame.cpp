@@ -0,0 +1,319 @@
+#include "PirateGame.h"
+#include "Game.hpp"
+#include <new>
+#include <cstring>
+#include <climits>
+#include <algorithm>
+
+static_assert(PIRATE_EMPTY == static_cast<int>(EMPTY) &&
+              PIRATE_TREASURE == static_cast<int>(TREASURE) &&
+              PIRATE_TRAP == static_cast<int>(TRAP) &&
+              PIRATE_HIDDEN == static_cast<int>(HIDDEN) &&
+              PIRATE_REVEALED == static_cast<int>(REVEALED) &&
+              PIRATE_FLAG == static_cast<int>(FLAG) &&
+              PIRATE_RECT == static_cast<int>(TOPOLOGY_RECT) &&
+              PIRATE_TORUS == static_cast<int>(TOPOLOGY_TORUS) &&
+              PIRATE_HEX == static_cast<int>(TOPOLOGY_HEX),
+              "the C interface must use the same values as Game.hpp");
+
+// A saved game is a PirateSaveHeader, then the board as Game_pack_board()
+// writes it. Numbers are stored in the byte order of the machine.
+const char PIRATE_SAVE_MAGIC[8] = "PIRSAVE";
+const uint32_t PIRATE_SAVE_VERSION = 1;
+
+struct PirateSaveHeader {
+  char magic[8];
+  uint32_t version;
+  int32_t width;
+  int32_t height;
+  int32_t topology;
+};
+
+static_assert(sizeof(PirateSaveHeader) == 24,
+              "the saved game layout must not depend on the compiler");
+
+struct PirateGame {
+  Game game;
+  bool started; // false until a game is made or loaded
+
+  // Positions of the cells changed by the last call to PirateGame_move()
+  // or PirateGame_moves()
+  std::vector<std::pair<int, int>> changes;
+};
+
+// "Private" function declarations
+bool PirateGame_valid_size(int64_t width, int64_t height, int64_t topology);
+bool PirateGame_valid_board(int64_t width, int64_t height, int64_t num_treasures,
+                            int64_t num_traps, int64_t topology);
+int PirateGame_apply(PirateGame *game, const PirateMove &move);
+
+int PirateGame_abi_version(void) {
+  return PIRATE_ABI_VERSION;
+}
+
+PirateGame * PirateGame_new(void) {
+  PirateGame *game = new (std::nothrow) PirateGame;
+  if (game) {
+    game->started = false;
+  }
+  return game;
+}
+
+void PirateGame_free(PirateGame *game) {
+  delete game;
+}
+
+int PirateGame_reserve(PirateGame *game, int32_t width, int32_t height) {
+  if (!game || !PirateGame_valid_size(width, height, PIRATE_RECT)) {
+    return PIRATE_ERR_INVALID;
+  }
+  size_t num_cells = static_cast<size_t>(width) * height;
+  try {
+    // Room for a board of any shape with num_cells cells, and a reveal of
+    // every cell at once. With its border (see Game), such a board is
+    // largest as a single row, 3 * (num_cells + 2) cells, and a reveal sorts
+    // its cells into at most num_cells + 2 buckets, one per row or column.
+    game->game.cells.reserve(3 * (num_cells + 2));
+    game->game.changes.reserve(num_cells);
+    game->game.reveal_stack.reserve(num_cells);
+    game->game.reveal_sorted.reserve(num_cells);
+    game->game.reveal_starts.reserve(num_cells + 2);
+    game->changes.reserve(num_cells);
+  }
+  catch (const std::bad_alloc &) {
+    return PIRATE_ERR_NO_MEMORY;
+  }
+  return PIRATE_OK;
+}
+
+int PirateGame_init(PirateGame *game, uint32_t seed, int32_t width, int32_t height,
+                    int32_t num_treasures, int32_t num_traps, int32_t topology) {
+  if (!game || !PirateGame_valid_board(width, height, num_treasures, num_traps, topology)) {
+    return PIRATE_ERR_INVALID;
+  }
+  game->changes.clear();
+  try {
+    Game_init_seeded(&game->game, seed, width, height, num_treasures, num_traps,
+                     static_cast<Topology>(topology));
+  }
+  catch (const std::bad_alloc &) {
+    game->started = false;
+    return PIRATE_ERR_NO_MEMORY;
+  }
+  game->started = true;
+  return PIRATE_OK;
+}
+
+int PirateGame_status(const PirateGame *game, PirateStatus *status) {
+  if (!game || !game->started || !status) {
+    return PIRATE_ERR_INVALID;
+  }
+  const Game *board = &game->game;
+  status->width = Game_width(board);
+  status->height = Game_height(board);
+  status->topology = Game_topology(board);
+  status->num_treasures = Game_num_treasures(board);
+  status->num_traps = Game_num_traps(board);
+  status->num_treasures_found = Game_num_treasures_found(board);
+  status->num_traps_found = Game_num_traps_found(board);
+  status->num_revealed = Game_num_revealed(board);
+  status->num_flags = Game_num_flags(board);
+  status->state = !Game_is_over(board) ? PIRATE_PLAYING
+                : Game_num_traps_found(board) > 0 ? PIRATE_LOST : PIRATE_WON;
+  return PIRATE_OK;
+}
+
+int PirateGame_move(PirateGame *game, int32_t kind, int32_t x, int32_t y) {
+  PirateMove move = {kind, x, y};
+  int32_t result;
+  int status = PirateGame_moves(game, &move, 1, &result);
+  return status == PIRATE_OK ? result : status;
+}
+
+int PirateGame_moves(PirateGame *game, const PirateMove *moves, size_t num_moves,
+                     int32_t *results) {
+  if (!game || !game->started || (!moves && num_moves > 0)) {
+    return PIRATE_ERR_INVALID;
+  }
+  game->changes.clear();
+  for(size_t i = 0; i < num_moves; ++i) {
+    int result = PirateGame_apply(game, moves[i]);
+    if (results) {
+      results[i] = result;
+    }
+    if (result == PIRATE_ERR_NO_MEMORY) {
+      return result;
+    }
+  }
+  return PIRATE_OK;
+}
+
+size_t PirateGame_num_changes(const PirateGame *game) {
+  return game && game->started ? game->changes.size() : 0;
+}
+
+int PirateGame_changes(const PirateGame *game, int32_t *xy, size_t size) {
+  if (!game || !game->started || (!xy && size > 0)) {
+    return PIRATE_ERR_INVALID;
+  }
+  if (size < 2 * game->changes.size()) {
+    return PIRATE_ERR_TOO_SMALL;
+  }
+  for(const std::pair<int, int> &change : game->changes) {
+    *xy++ = change.first;
+    *xy++ = change.second;
+  }
+  return PIRATE_OK;
+}
+
+int PirateGame_export(const PirateGame *game, int32_t x, int32_t y, int32_t width,
+                      int32_t height, int32_t how, uint8_t *out, size_t size) {
+  if (!game || !game->started || width < 0 || height < 0 ||
+      (how != PIRATE_EXPORT_ALL && how != PIRATE_EXPORT_PLAYER)) {
+    return PIRATE_ERR_INVALID;
+  }
+  const Game *board = &game->game;
+  if (x < 0 || y < 0 || static_cast<int64_t>(x) + width > Game_width(board) ||
+      static_cast<int64_t>(y) + height > Game_height(board)) {
+    return PIRATE_ERR_OUT_OF_BOUNDS;
+  }
+  if (size < static_cast<size_t>(width) * height) {
+    return PIRATE_ERR_TOO_SMALL;
+  }
+  if (width == 0 || height == 0) {
+    return PIRATE_OK;
+  }
+  // The view's columns are contiguous, so they're read in order and
+  // written across the rows of out.
+  GameView view = Game_view(board, x, y, width, height);
+  for(int i = 0; i < width; ++i) {
+    const Cell *cell = GameView_cell(&view, i, 0);
+    uint8_t *byte = out + i;
+    for(int j = 0; j < height; ++j, cell += view.y_stride, byte += width) {
+      if (how == PIRATE_EXPORT_PLAYER && cell->state != REVEALED) {
+        *byte = cell->state << 6;
+      }
+      else {
+        *byte = cell->state << 6 | cell->item << 4 | cell->num_adjacent_traps;
+      }
+    }
+  }
+  return PIRATE_OK;
+}
+
+size_t PirateGame_save_size(const PirateGame *game) {
+  if (!game || !game->started) {
+    return 0;
+  }
+  return sizeof(PirateSaveHeader)
+       + static_cast<size_t>(Game_width(&game->game)) * Game_height(&game->game);
+}
+
+int PirateGame_save(const PirateGame *game, uint8_t *out, size_t size) {
+  if (!game || !game->started || !out) {
+    return PIRATE_ERR_INVALID;
+  }
+  if (size < PirateGame_save_size(game)) {
+    return PIRATE_ERR_TOO_SMALL;
+  }
+  PirateSaveHeader header;
+  memcpy(header.magic, PIRATE_SAVE_MAGIC, sizeof(header.magic));
+  header.version = PIRATE_SAVE_VERSION;
+  header.width = Game_width(&game->game);
+  header.height = Game_height(&game->game);
+  header.topology = Game_topology(&game->game);
+  memcpy(out, &header, sizeof(header));
+  Game_pack_board(&game->game, out + sizeof(header));
+  return PIRATE_OK;
+}
+
+int PirateGame_load(PirateGame *game, const uint8_t *data, size_t size) {
+  if (!game || (!data && size > 0)) {
+    return PIRATE_ERR_INVALID;
+  }
+  // Everything is checked before the game is touched, so that a bad save
+  // leaves it as it was.
+  PirateSaveHeader header;
+  if (size < sizeof(header)) {
+    return PIRATE_ERR_BAD_SAVE;
+  }
+  memcpy(&header, data, sizeof(header));
+  if (memcmp(header.magic, PIRATE_SAVE_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != PIRATE_SAVE_VERSION ||
+      !PirateGame_valid_size(header.width, header.height, header.topology) ||
+      size != sizeof(header) + static_cast<size_t>(header.width) * header.height) {
+    return PIRATE_ERR_BAD_SAVE;
+  }
+  const uint8_t *cells = data + sizeof(header);
+  int64_t num_treasures = 0;
+  int64_t num_traps = 0;
+  for(size_t i = 0; i < size - sizeof(header); ++i) {
+    int item = PIRATE_CELL_ITEM(cells[i]);
+    if (item > PIRATE_TRAP || PIRATE_CELL_STATE(cells[i]) > PIRATE_FLAG ||
+        PIRATE_CELL_NUMBER(cells[i]) > 8) {
+      return PIRATE_ERR_BAD_SAVE;
+    }
+    num_treasures += item == PIRATE_TREASURE;
+    num_traps += item == PIRATE_TRAP;
+  }
+  if (!PirateGame_valid_board(header.width, header.height, num_treasures, num_traps,
+                              header.topology)) {
+    return PIRATE_ERR_BAD_SAVE;
+  }
+  game->changes.clear();
+  try {
+    Game_init_packed(&game->game, header.width, header.height,
+                     static_cast<Topology>(header.topology), cells);
+  }
+  catch (const std::bad_alloc &) {
+    game->started = false;
+    return PIRATE_ERR_NO_MEMORY;
+  }
+  game->started = true;
+  return PIRATE_OK;
+}
+
+// EFFECTS: Returns true if a board of this size and topology can be made:
+//          one whose cells, with the border around them, can be counted in
+//          an int.
+bool PirateGame_valid_size(int64_t width, int64_t height, int64_t topology) {
+  return width > 0 && height > 0 && (width + 2) * (height + 2) <= INT_MAX &&
+         (topology == PIRATE_RECT || topology == PIRATE_HEX ||
+          (topology == PIRATE_TORUS && width >= 3 && height >= 3));
+}
+
+// EFFECTS: Returns true if the arguments meet the REQUIRES of Game_init().
+bool PirateGame_valid_board(int64_t width, int64_t height, int64_t num_treasures,
+                            int64_t num_traps, int64_t topology) {
+  return PirateGame_valid_size(width, height, topology) && num_treasures > 0 &&
+         num_traps >= 0 && num_treasures + num_traps < width * height / 2;
+}
+
+// EFFECTS: Makes the move, adding the cells it changed to game->changes,
+//          and returns its result.
+int PirateGame_apply(PirateGame *game, const PirateMove &move) {
+  Game *board = &game->game;
+  if (move.kind != PIRATE_MOVE_REVEAL && move.kind != PIRATE_MOVE_FLAG) {
+    return PIRATE_ERR_INVALID;
+  }
+  if (Game_is_over(board)) {
+    return PIRATE_ERR_GAME_OVER;
+  }
+  if (!Game_in_bounds(board, move.x, move.y)) {
+    return PIRATE_ERR_OUT_OF_BOUNDS;
+  }
+  try {
+    if (move.kind == PIRATE_MOVE_REVEAL) {
+      Game_reveal(board, move.x, move.y);
+    }
+    else {
+      Game_toggle_flag(board, move.x, move.y);
+    }
+    const std::vector<std::pair<int, int>> &changes = Game_changes(board);
+    game->changes.insert(game->changes.end(), changes.begin(), changes.end());
+  }
+  catch (const std::bad_alloc &) {
+    return PIRATE_ERR_NO_MEMORY;
+  }
+  return PIRATE_OK;
+}
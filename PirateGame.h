@@ -0,0 +1,182 @@
+#ifndef PIRATE_GAME_H
+#define PIRATE_GAME_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A C interface to the game, for programs that embed it rather than run
+// pirate.exe. It's built as libpiratetreasure.so by
+// `make libpiratetreasure.so`, and this header can be included from C or
+// C++.
+//
+// A game is reached through an opaque PirateGame handle. Moves can be made
+// one at a time or in batches, and the board is read by copying the cells
+// of any rectangle of it into a buffer of the caller's. Games are saved to
+// and loaded from memory. Once PirateGame_reserve() has been called with
+// the size of the largest board to be played, nothing but PirateGame_new()
+// and PirateGame_reserve() allocates memory: games on boards of any shape
+// with no more cells can be made, played, read, saved and loaded over and
+// over without it.
+//
+// The time a move takes grows with the number of cells it changes (see
+// PirateGame_num_changes()), not with the size of the board, so a reveal
+// on a huge board costs no more than the same reveal on a small one. Only
+// making, exporting, saving and loading a game touch the whole board or
+// rectangle involved.
+//
+// Only the functions and types declared here are exported, and they only
+// change along with PIRATE_ABI_VERSION. Functions report errors by
+// returning one of the PIRATE_ERR_ codes below, and never throw. A handle
+// may be used by one thread at a time, and different handles by different
+// threads at once.
+
+#define PIRATE_ABI_VERSION 1
+
+#if defined(__GNUC__)
+#define PIRATE_API __attribute__((visibility("default")))
+#else
+#define PIRATE_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct PirateGame PirateGame;
+
+// Results of functions
+enum {
+  PIRATE_OK = 0,
+  PIRATE_ERR_INVALID = -1,       // an invalid argument, or no game yet
+  PIRATE_ERR_OUT_OF_BOUNDS = -2, // a move off the board
+  PIRATE_ERR_GAME_OVER = -3,     // a move after the game was over
+  PIRATE_ERR_TOO_SMALL = -4,     // a buffer too small for the result
+  PIRATE_ERR_BAD_SAVE = -5,      // data that isn't a saved game
+  PIRATE_ERR_NO_MEMORY = -6,
+};
+
+// The same values as Item, CellState and Topology in Game.hpp
+enum { PIRATE_EMPTY = 0, PIRATE_TREASURE = 1, PIRATE_TRAP = 2 };
+enum { PIRATE_HIDDEN = 0, PIRATE_REVEALED = 1, PIRATE_FLAG = 2 };
+enum { PIRATE_RECT = 0, PIRATE_TORUS = 1, PIRATE_HEX = 2 };
+
+// Kinds of moves
+enum { PIRATE_MOVE_REVEAL = 0, PIRATE_MOVE_FLAG = 1 };
+
+// States of a game
+enum { PIRATE_PLAYING = 0, PIRATE_WON = 1, PIRATE_LOST = 2 };
+
+// Ways to export cells
+enum {
+  PIRATE_EXPORT_ALL = 0,    // every cell's item and number
+  PIRATE_EXPORT_PLAYER = 1, // only what the player sees: cells that aren't
+                            // revealed are exported as EMPTY with number 0
+};
+
+// Each exported cell is a byte holding its number of adjacent traps in the
+// low four bits, its item in the next two and its state in the top two.
+#define PIRATE_CELL_NUMBER(byte) ((byte) & 0xf)
+#define PIRATE_CELL_ITEM(byte) (((byte) >> 4) & 3)
+#define PIRATE_CELL_STATE(byte) ((byte) >> 6)
+
+typedef struct PirateMove {
+  int32_t kind; // PIRATE_MOVE_REVEAL or PIRATE_MOVE_FLAG
+  int32_t x;
+  int32_t y;
+} PirateMove;
+
+typedef struct PirateStatus {
+  int32_t width;
+  int32_t height;
+  int32_t topology;
+  int32_t num_treasures;
+  int32_t num_traps;
+  int32_t num_treasures_found;
+  int32_t num_traps_found;
+  int32_t num_revealed;
+  int32_t num_flags;
+  int32_t state; // PIRATE_PLAYING, PIRATE_WON or PIRATE_LOST
+} PirateStatus;
+
+// EFFECTS: Returns the PIRATE_ABI_VERSION the library was built with.
+PIRATE_API int PirateGame_abi_version(void);
+
+// EFFECTS: Returns a new handle with no game yet, or NULL if out of memory.
+PIRATE_API PirateGame * PirateGame_new(void);
+
+// EFFECTS: Frees the handle and its game. Does nothing if game is NULL.
+PIRATE_API void PirateGame_free(PirateGame *game);
+
+// EFFECTS: Allocates enough memory for games on boards of any shape with up
+//          to width * height cells to be played without allocating any
+//          more, as long as each call to PirateGame_moves() changes at most
+//          width * height cells. This is about three times the memory of a
+//          width x height board, for a board that's a single row.
+PIRATE_API int PirateGame_reserve(PirateGame *game, int32_t width, int32_t height);
+
+// EFFECTS: Starts a new game, replacing any game the handle had, on a
+//          board made from seed as Game_init_seeded() makes it. Returns
+//          PIRATE_ERR_INVALID, leaving the handle as it was, if the board
+//          can't be made (see Game_init()). After PIRATE_ERR_NO_MEMORY,
+//          here or in PirateGame_load(), the handle has no game.
+PIRATE_API int PirateGame_init(PirateGame *game, uint32_t seed, int32_t width, int32_t height,
+                               int32_t num_treasures, int32_t num_traps, int32_t topology);
+
+// EFFECTS: Writes the counts and state of the game to status.
+PIRATE_API int PirateGame_status(const PirateGame *game, PirateStatus *status);
+
+// EFFECTS: Reveals the cell at (x,y), or toggles its flag, as Game_reveal()
+//          and Game_toggle_flag() do. Returns PIRATE_ERR_OUT_OF_BOUNDS or
+//          PIRATE_ERR_GAME_OVER, making no move, if (x,y) isn't on the
+//          board or the game is over.
+PIRATE_API int PirateGame_move(PirateGame *game, int32_t kind, int32_t x, int32_t y);
+
+// EFFECTS: Makes num_moves moves in order, as PirateGame_move() does, and
+//          writes the result of each to results, unless results is NULL.
+//          Moves after the game is over have the result
+//          PIRATE_ERR_GAME_OVER. Returns PIRATE_ERR_NO_MEMORY, making no
+//          more moves, if a move runs out of memory.
+PIRATE_API int PirateGame_moves(PirateGame *game, const PirateMove *moves, size_t num_moves,
+                                int32_t *results);
+
+// EFFECTS: Returns the number of cells whose state was changed by the last
+//          call to PirateGame_move() or PirateGame_moves(), or 0 if there's
+//          no game.
+PIRATE_API size_t PirateGame_num_changes(const PirateGame *game);
+
+// EFFECTS: Writes the positions of the cells changed by the last call to
+//          PirateGame_move() or PirateGame_moves() to xy, as x and then y
+//          for each, in the order Game_changes() gives them for each move.
+//          Returns PIRATE_ERR_TOO_SMALL if xy doesn't have room for
+//          2 * PirateGame_num_changes() values.
+PIRATE_API int PirateGame_changes(const PirateGame *game, int32_t *xy, size_t size);
+
+// EFFECTS: Writes the cells of the width x height rectangle with (x,y) its
+//          lowest corner to out, cell (x + i, y + j) to out[j * width + i],
+//          as the bytes described above. how is one of the PIRATE_EXPORT_
+//          values. Returns PIRATE_ERR_OUT_OF_BOUNDS if the rectangle isn't
+//          on the board, or PIRATE_ERR_TOO_SMALL if out has fewer than
+//          width * height bytes.
+PIRATE_API int PirateGame_export(const PirateGame *game, int32_t x, int32_t y, int32_t width,
+                                 int32_t height, int32_t how, uint8_t *out, size_t size);
+
+// EFFECTS: Returns the number of bytes PirateGame_save() writes, or 0 if
+//          there's no game.
+PIRATE_API size_t PirateGame_save_size(const PirateGame *game);
+
+// EFFECTS: Saves the game to out, in a binary form only for
+//          PirateGame_load() on a machine of the same kind. Returns
+//          PIRATE_ERR_TOO_SMALL if out has fewer than
+//          PirateGame_save_size() bytes.
+PIRATE_API int PirateGame_save(const PirateGame *game, uint8_t *out, size_t size);
+
+// EFFECTS: Loads a game saved by PirateGame_save(), replacing any game the
+//          handle had. Returns PIRATE_ERR_BAD_SAVE, leaving the handle as
+//          it was, if data isn't a saved game.
+PIRATE_API int PirateGame_load(PirateGame *game, const uint8_t *data, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
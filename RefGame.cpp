@@ -0,0 +1,203 @@
+#include "RefGame.hpp"
+#include <cstdlib>
+#include <string>
+#include <algorithm>
+
+// "Private" function declarations
+void RefGame_place_items(RefGame *game, int n, Item item);
+void RefGame_reveal_cell(RefGame *game, int x, int y);
+bool RefGame_neighbor(const RefGame *game, int x, int y, int dx, int dy, int &nx, int &ny);
+
+void RefGame_init(RefGame *game, int width, int height, int num_treasures, int num_traps,
+                  Topology topology) {
+  game->width = width;
+  game->height = height;
+  game->topology = topology;
+  game->cells = std::vector<std::vector<Cell>>(width, std::vector<Cell>(height));
+  for(int x = 0; x < width; ++x) {
+    for(int y = 0; y < height; ++y) {
+      game->cells[x][y] = {x, y, EMPTY, HIDDEN, false, 0};
+    }
+  }
+  game->num_treasures = num_treasures;
+  game->num_traps = num_traps;
+  game->num_treasures_found = 0;
+  game->num_traps_found = 0;
+  game->num_revealed = 0;
+  game->num_flags = 0;
+  game->changes.clear();
+
+  RefGame_place_items(game, num_treasures, TREASURE);
+  RefGame_place_items(game, num_traps, TRAP);
+
+  for(int x = 0; x < width; ++x) {
+    for(int y = 0; y < height; ++y) {
+      int count = 0;
+      for(int dx = -1; dx <= 1; ++dx) {
+        for(int dy = -1; dy <= 1; ++dy) {
+          int nx;
+          int ny;
+          if (RefGame_neighbor(game, x, y, dx, dy, nx, ny) &&
+              game->cells[nx][ny].item == TRAP) {
+            ++count;
+          }
+        }
+      }
+      game->cells[x][y].num_adjacent_traps = count;
+    }
+  }
+}
+
+void RefGame_init(RefGame *game, std::istream &in) {
+  in >> game->width >> game->height;
+  std::string rest;
+  std::getline(in, rest);
+  game->topology = TOPOLOGY_RECT;
+  for(Topology topology : {TOPOLOGY_TORUS, TOPOLOGY_HEX}) {
+    if (rest.find(Game_topology_name(topology)) != std::string::npos) {
+      game->topology = topology;
+    }
+  }
+  game->cells = std::vector<std::vector<Cell>>(game->width, std::vector<Cell>(game->height));
+  game->num_treasures = 0;
+  game->num_traps = 0;
+  game->num_treasures_found = 0;
+  game->num_traps_found = 0;
+  game->num_revealed = 0;
+  game->num_flags = 0;
+  game->changes.clear();
+  for(int x = 0; x < game->width; ++x) {
+    for(int y = 0; y < game->height; ++y) {
+      Cell &cell = game->cells[x][y];
+      int item;
+      int state;
+      in >> cell.x >> cell.y >> item >> state >> cell.has_flag >> cell.num_adjacent_traps;
+      cell.item = static_cast<Item>(item);
+      cell.state = static_cast<CellState>(state);
+      game->num_treasures += cell.item == TREASURE;
+      game->num_traps += cell.item == TRAP;
+      game->num_treasures_found += cell.item == TREASURE && cell.state == REVEALED;
+      game->num_traps_found += cell.item == TRAP && cell.state == REVEALED;
+      game->num_revealed += cell.state == REVEALED;
+      game->num_flags += cell.state == FLAG;
+    }
+  }
+}
+
+void RefGame_save(const RefGame *game, std::ostream &out) {
+  out << game->width << " " << game->height;
+  if (game->topology != TOPOLOGY_RECT) {
+    out << " " << Game_topology_name(game->topology);
+  }
+  out << std::endl;
+  for(int x = 0; x < game->width; ++x) {
+    for(int y = 0; y < game->height; ++y) {
+      const Cell &cell = game->cells[x][y];
+      out << cell.x << " " << cell.y << " " << cell.item << " " << cell.state << " "
+          << cell.has_flag << " " << cell.num_adjacent_traps << " ";
+    }
+    out << std::endl;
+  }
+}
+
+bool RefGame_is_over(const RefGame *game) {
+  return game->num_traps_found > 0 || game->num_treasures_found == game->num_treasures;
+}
+
+void RefGame_reveal(RefGame *game, int x, int y) {
+  game->changes.clear();
+  RefGame_reveal_cell(game, x, y);
+  // The cell clicked, then the rest of its opening in order of x and y
+  if (!game->changes.empty()) {
+    std::sort(game->changes.begin() + 1, game->changes.end());
+  }
+}
+
+void RefGame_toggle_flag(RefGame *game, int x, int y) {
+  game->changes.clear();
+  Cell &cell = game->cells[x][y];
+  if (cell.state == HIDDEN) {
+    cell.state = FLAG;
+    ++game->num_flags;
+    game->changes.emplace_back(x, y);
+  }
+  else if (cell.state == FLAG) {
+    cell.state = HIDDEN;
+    --game->num_flags;
+    game->changes.emplace_back(x, y);
+  }
+}
+
+// EFFECTS: Places n of the item on random empty cells, using rand().
+void RefGame_place_items(RefGame *game, int n, Item item) {
+  int num_placed = 0;
+  while (num_placed < n) {
+    int x = rand() % game->width;
+    int y = rand() % game->height;
+    if (game->cells[x][y].item == EMPTY) {
+      game->cells[x][y].item = item;
+      ++num_placed;
+    }
+  }
+}
+
+// EFFECTS: Reveals the cell, and if it's safe and has no adjacent traps,
+//          recursively reveals its hidden safe neighbors, in order of x
+//          and then y.
+void RefGame_reveal_cell(RefGame *game, int x, int y) {
+  Cell &cell = game->cells[x][y];
+  if (cell.state == REVEALED) {
+    return;
+  }
+  if (cell.state == FLAG) {
+    --game->num_flags;
+  }
+  cell.state = REVEALED;
+  ++game->num_revealed;
+  game->changes.emplace_back(x, y);
+
+  if (cell.item == TRAP) {
+    ++game->num_traps_found;
+    return;
+  }
+  if (cell.item == TREASURE) {
+    ++game->num_treasures_found;
+  }
+  if (cell.num_adjacent_traps == 0) {
+    for(int dx = -1; dx <= 1; ++dx) {
+      for(int dy = -1; dy <= 1; ++dy) {
+        int nx;
+        int ny;
+        if (RefGame_neighbor(game, x, y, dx, dy, nx, ny) &&
+            game->cells[nx][ny].state != REVEALED &&
+            game->cells[nx][ny].item != TRAP) {
+          RefGame_reveal_cell(game, nx, ny);
+        }
+      }
+    }
+  }
+}
+
+// EFFECTS: If the cell dx, dy away from x, y is a neighbor, sets nx, ny to
+//          it and returns true. On a torus the board wraps around. On a hex
+//          board odd rows are shifted half a cell right, so besides the two
+//          cells beside it in its row, a cell touches the two above and the
+//          two below that overlap it.
+bool RefGame_neighbor(const RefGame *game, int x, int y, int dx, int dy, int &nx, int &ny) {
+  if (dx == 0 && dy == 0) {
+    return false;
+  }
+  if (game->topology == TOPOLOGY_HEX && dy != 0) {
+    bool odd_row = y % 2 == 1;
+    if ((odd_row && dx == -1) || (!odd_row && dx == 1)) {
+      return false;
+    }
+  }
+  nx = x + dx;
+  ny = y + dy;
+  if (game->topology == TOPOLOGY_TORUS) {
+    nx = (nx + game->width) % game->width;
+    ny = (ny + game->height) % game->height;
+  }
+  return 0 <= nx && nx < game->width && 0 <= ny && ny < game->height;
+}
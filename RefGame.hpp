@@ -0,0 +1,51 @@
+#ifndef REF_GAME_HPP
+#define REF_GAME_HPP
+
+#include "Game.hpp"
+#include <vector>
+#include <iostream>
+#include <utility>
+
+// A reference implementation of the Game rules, kept as simple as possible
+// so that it's easy to see that it's right. It's never used to play, only
+// by Game_fuzz.cpp, which checks that Game (however much it's optimized)
+// behaves exactly the same way.
+//
+// Don't optimize this. Change it only when the rules themselves change,
+// and then change Game to match.
+
+struct RefGame {
+  int width;
+  int height;
+  Topology topology;
+  int num_treasures;
+  int num_traps;
+  int num_treasures_found;
+  int num_traps_found;
+  int num_revealed;
+  int num_flags;
+  std::vector<std::vector<Cell>> cells; // cells[x][y]
+  std::vector<std::pair<int, int>> changes; // as in Game_changes()
+};
+
+// EFFECTS: Same as Game_init(). Items are placed with rand() in the same
+//          order, so after the same srand() both create the same board.
+void RefGame_init(RefGame *game, int width, int height, int num_treasures, int num_traps,
+                  Topology topology = TOPOLOGY_RECT);
+
+// EFFECTS: Same as Game_init() from a stream.
+void RefGame_init(RefGame *game, std::istream &in);
+
+// EFFECTS: Same as Game_save().
+void RefGame_save(const RefGame *game, std::ostream &out);
+
+// EFFECTS: Same as Game_is_over().
+bool RefGame_is_over(const RefGame *game);
+
+// EFFECTS: Same as Game_reveal().
+void RefGame_reveal(RefGame *game, int x, int y);
+
+// EFFECTS: Same as Game_toggle_flag().
+void RefGame_toggle_flag(RefGame *game, int x, int y);
+
+#endif
@@ -0,0 +1,490 @@
+#include "Server.hpp"
+#include "Stats.hpp"
+#include "Trace.hpp"
+#include <iostream>
+#include <cerrno>
+#include <cstring>
+#include <csignal>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+// Maximum number of epoll events handled per wakeup
+const int SERVER_MAX_EVENTS = 256;
+
+// Longest request line a session may send. A longer one is answered with
+// an error, and the connection is shut down.
+const size_t SERVER_MAX_LINE = 1 << 16;
+
+// A session isn't read while this many bytes of its requests are waiting
+// to be handled, and isn't handled while this many bytes of its responses
+// are waiting to be written, so a client that sends faster than it reads
+// can't make the server buffer without limit.
+const size_t SERVER_HIGH_WATER = 1 << 20;
+
+// Set by SIGINT and SIGTERM
+volatile std::sig_atomic_t server_stop_requested = 0;
+
+// "Private" function declarations
+void Server_accept(Server *server);
+void Server_read(Server *server, const std::shared_ptr<ServerSession> &session);
+void Server_close(Server *server, const std::shared_ptr<ServerSession> &session);
+bool Server_claim(ServerSession *session);
+void Server_queue(Server *server, const std::shared_ptr<ServerSession> &session);
+void Server_worker(Server *server);
+void Server_handle(Server *server, ServerSession *session);
+void Server_write(Server *server, ServerSession *session);
+void Server_watch(Server *server, ServerSession *session, uint32_t events);
+
+ServerSession::~ServerSession() {
+  Spectator_close(&spectator);
+  close(fd);
+}
+
+void Server_init(Server *server, int width, int height, int num_treasures, int num_traps,
+                 const std::string &save_dir) {
+  server->listen_fd = -1;
+  server->epoll_fd = -1;
+  server->unix_path.clear();
+  server->width = width;
+  server->height = height;
+  server->num_treasures = num_treasures;
+  server->num_traps = num_traps;
+  server->save_dir = save_dir;
+  server->index_openings = false;
+  server->spectate_prefix.clear();
+  server->next_session_id = 1;
+  server->seeds.seed(std::random_device{}());
+  server->stopping = false;
+}
+
+void Server_enable_index(Server *server) {
+  server->index_openings = true;
+}
+
+void Server_enable_spectate(Server *server, const std::string &prefix) {
+  server->spectate_prefix = prefix;
+}
+
+bool Server_listen_unix(Server *server, const std::string &path) {
+  sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    std::cerr << "Socket path is too long: " << path << std::endl;
+    return false;
+  }
+  std::strcpy(addr.sun_path, path.c_str());
+  unlink(path.c_str());
+
+  server->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (server->listen_fd < 0 ||
+      bind(server->listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 ||
+      listen(server->listen_fd, SOMAXCONN) != 0) {
+    std::cerr << "Could not listen on " << path << ": " << std::strerror(errno) << std::endl;
+    return false;
+  }
+  server->unix_path = path;
+  return true;
+}
+
+bool Server_listen_tcp(Server *server, int port) {
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  int reuse = 1;
+  server->listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (server->listen_fd < 0 ||
+      setsockopt(server->listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) != 0 ||
+      bind(server->listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 ||
+      listen(server->listen_fd, SOMAXCONN) != 0) {
+    std::cerr << "Could not listen on port " << port << ": " << std::strerror(errno) << std::endl;
+    return false;
+  }
+  return true;
+}
+
+void Server_run(Server *server, int num_workers) {
+  // Interrupt epoll_wait() (no SA_RESTART) so the loop can exit cleanly.
+  struct sigaction action = {};
+  action.sa_handler = [](int) { server_stop_requested = 1; };
+  sigaction(SIGINT, &action, nullptr);
+  sigaction(SIGTERM, &action, nullptr);
+
+  server->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  epoll_event listen_event = {};
+  listen_event.events = EPOLLIN;
+  listen_event.data.fd = server->listen_fd;
+  epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, server->listen_fd, &listen_event);
+
+  for(int i = 0; i < num_workers; ++i) {
+    server->workers.emplace_back(Server_worker, server);
+  }
+
+  epoll_event events[SERVER_MAX_EVENTS];
+  while (!server_stop_requested) {
+    int num_events = epoll_wait(server->epoll_fd, events, SERVER_MAX_EVENTS, -1);
+    for(int i = 0; i < num_events; ++i) {
+      int fd = events[i].data.fd;
+      if (fd == server->listen_fd) {
+        Server_accept(server);
+        continue;
+      }
+      auto it = server->sessions.find(fd);
+      if (it == server->sessions.end()) {
+        continue; // closed by an earlier event in this batch
+      }
+      std::shared_ptr<ServerSession> session = it->second;
+      if (events[i].events & EPOLLOUT) {
+        bool schedule = false;
+        {
+          std::lock_guard<std::mutex> lock(session->mutex);
+          Server_write(server, session.get());
+          // Requests left unhandled while responses were backed up
+          schedule = Server_claim(session.get());
+        }
+        if (schedule) {
+          Server_queue(server, session);
+        }
+      }
+      if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+        Server_read(server, session);
+      }
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(server->queue_mutex);
+    server->stopping = true;
+  }
+  server->queue_ready.notify_all();
+  for(std::thread &worker : server->workers) {
+    worker.join();
+  }
+  server->workers.clear();
+  server->queue.clear();
+  server->sessions.clear();
+  close(server->epoll_fd);
+  close(server->listen_fd);
+  if (!server->unix_path.empty()) {
+    unlink(server->unix_path.c_str());
+  }
+}
+
+// EFFECTS: Accepts every pending connection, starting a new game for each.
+void Server_accept(Server *server) {
+  while (true) {
+    int fd = accept4(server->listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        std::cerr << "accept: " << std::strerror(errno) << std::endl;
+      }
+      return;
+    }
+    // Responses are small and latency matters more than packet count.
+    int nodelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+    std::shared_ptr<ServerSession> session = std::make_shared<ServerSession>();
+    session->fd = fd;
+    session->has_line = false;
+    session->line_length = 0;
+    session->too_long = false;
+    session->scheduled = false;
+    session->quit = false;
+    session->ended = false;
+    session->closed = false;
+    session->started = false;
+    session->seed = server->seeds();
+    session->id = server->next_session_id++;
+    session->spectator.header = nullptr;
+
+    // Only JsonUI_handle() is used, so the UI needs no streams.
+    session->ui.game = &session->game;
+    session->ui.journal = nullptr;
+    session->ui.spectator = nullptr;
+    session->ui.in = nullptr;
+    session->ui.out = nullptr;
+    session->ui.save_dir = server->save_dir;
+
+    session->watched = false;
+
+    server->sessions[fd] = session;
+    std::lock_guard<std::mutex> lock(session->mutex);
+    Server_watch(server, session.get(), EPOLLIN);
+  }
+}
+
+// EFFECTS: Reads up to about SERVER_HIGH_WATER bytes of what the client
+//          has sent, and queues the session for a worker if it now has a
+//          complete request line.
+void Server_read(Server *server, const std::shared_ptr<ServerSession> &session) {
+  char buffer[1 << 16];
+  bool eof = false;
+  bool error = false;
+  std::string received;
+  while (received.size() < SERVER_HIGH_WATER) {
+    ssize_t n = recv(session->fd, buffer, sizeof(buffer), 0);
+    if (n > 0) {
+      received.append(buffer, n);
+    }
+    else if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    else {
+      eof = n == 0;
+      error = n < 0 && errno != EAGAIN && errno != EWOULDBLOCK;
+      break;
+    }
+  }
+
+  bool schedule = false;
+  {
+    std::unique_lock<std::mutex> lock(session->mutex);
+    if (!session->quit && !session->too_long) {
+      // Anything after a quit is ignored. Only the new bytes are searched
+      // for the end of a line, so a long line isn't searched over and over.
+      size_t last = received.rfind('\n');
+      if (last != std::string::npos) {
+        session->has_line = true;
+        session->line_length = received.size() - last - 1;
+      }
+      else {
+        session->line_length += received.size();
+      }
+      session->input += received;
+      if (session->line_length > SERVER_MAX_LINE) {
+        // Answer the complete lines before it, then the error.
+        session->input.resize(session->input.size() - session->line_length);
+        session->line_length = 0;
+        session->too_long = true;
+      }
+    }
+    bool pending = session->scheduled || !session->output.empty() ||
+                   (!session->quit && (session->has_line || session->too_long));
+    if (error || (eof && !pending)) {
+      lock.unlock();
+      Server_close(server, session);
+      return;
+    }
+    if (eof) {
+      // Answer the requests that were sent before the client stopped
+      // sending, then shut the connection down.
+      session->ended = true;
+      Server_watch(server, session.get(), session->output.empty() ? 0 : EPOLLOUT);
+    }
+    else if (session->too_long || session->input.size() >= SERVER_HIGH_WATER) {
+      // Stop reading until a worker has caught up, and then Server_write()
+      // starts again.
+      Server_watch(server, session.get(), session->output.empty() ? 0 : EPOLLOUT);
+    }
+    schedule = Server_claim(session.get());
+  }
+  if (schedule) {
+    Server_queue(server, session);
+  }
+}
+
+// REQUIRES: the caller holds session->mutex
+// EFFECTS: Marks the session as scheduled and returns true if it has
+//          requests for a worker to handle now, and isn't already
+//          scheduled.
+bool Server_claim(ServerSession *session) {
+  if (session->scheduled || session->quit || session->closed ||
+      !(session->has_line || session->too_long) ||
+      session->output.size() >= SERVER_HIGH_WATER) {
+    return false;
+  }
+  session->scheduled = true;
+  return true;
+}
+
+// REQUIRES: Server_claim() returned true for the session
+// EFFECTS: Queues the session for a worker.
+void Server_queue(Server *server, const std::shared_ptr<ServerSession> &session) {
+  {
+    std::lock_guard<std::mutex> lock(server->queue_mutex);
+    server->queue.push_back(session);
+  }
+  server->queue_ready.notify_one();
+}
+
+// EFFECTS: Drops the session. Its socket is closed once no worker is using it.
+void Server_close(Server *server, const std::shared_ptr<ServerSession> &session) {
+  {
+    std::lock_guard<std::mutex> lock(session->mutex);
+    Server_watch(server, session.get(), 0);
+    session->closed = true;
+  }
+  server->sessions.erase(session->fd);
+}
+
+void Server_worker(Server *server) {
+  Trace_name_thread("worker");
+  while (true) {
+    std::shared_ptr<ServerSession> session;
+    {
+      std::unique_lock<std::mutex> lock(server->queue_mutex);
+      server->queue_ready.wait(lock, [server]() {
+        return server->stopping || !server->queue.empty();
+      });
+      if (server->stopping) {
+        return;
+      }
+      session = std::move(server->queue.front());
+      server->queue.pop_front();
+    }
+    Server_handle(server, session.get());
+  }
+}
+
+// REQUIRES: session->scheduled, and the calling worker owns the session
+// EFFECTS: Handles every complete request line the session has received,
+//          then writes the responses. If SERVER_HIGH_WATER bytes of
+//          responses are waiting and the socket won't take them, the rest
+//          are left for when it does (see Server_claim()).
+void Server_handle(Server *server, ServerSession *session) {
+  std::string lines;
+  std::string response;
+  std::unique_lock<std::mutex> lock(session->mutex);
+  while (!session->quit && !session->closed && session->has_line) {
+    if (session->output.size() >= SERVER_HIGH_WATER) {
+      Server_write(server, session);
+      if (session->output.size() >= SERVER_HIGH_WATER) {
+        break;
+      }
+    }
+    size_t end = session->input.rfind('\n');
+    lines.assign(session->input, 0, end + 1);
+    session->input.erase(0, end + 1);
+    session->has_line = false;
+    // Only the epoll thread shrinks the output while the lock is released.
+    size_t output_size = session->output.size();
+
+    // The game is only touched by the worker that owns the session, so the
+    // moves are applied without holding the lock. Creating the game here
+    // rather than when the client connects keeps the epoll thread free.
+    // It's made from the session's own seed, since rand() isn't safe to
+    // call from several workers at once.
+    lock.unlock();
+    if (!session->started) {
+      Game_init_seeded(&session->game, session->seed, server->width, server->height,
+                       server->num_treasures, server->num_traps);
+      if (server->index_openings) {
+        Game_index_openings(&session->game);
+      }
+      session->started = true;
+      if (!server->spectate_prefix.empty() &&
+          Spectator_open(&session->spectator,
+                         server->spectate_prefix + "-" + std::to_string(session->id),
+                         &session->game)) {
+        session->ui.spectator = &session->spectator;
+      }
+    }
+    bool quit = false;
+    size_t start = 0;
+    while (!quit && start < lines.size() &&
+           output_size + response.size() < SERVER_HIGH_WATER) {
+      size_t line_end = lines.find('\n', start);
+      std::string line = lines.substr(start, line_end - start);
+      start = line_end + 1;
+      if (line.find_first_not_of(" \t\r") != std::string::npos) {
+        STATS_TIME(STAT_SERVER_REQUEST);
+        quit = !JsonUI_handle(&session->ui, line, response);
+      }
+    }
+    lock.lock();
+
+    if (!quit && start < lines.size()) {
+      // Put back the lines left for after the responses are written.
+      session->input.insert(0, lines, start, std::string::npos);
+      session->has_line = true;
+    }
+    session->output += response;
+    response.clear();
+    session->quit = quit;
+  }
+  if (session->too_long && !session->has_line && !session->quit) {
+    session->output += "{\"ok\":false,\"error\":\"request line too long\"}\n";
+    session->quit = true;
+  }
+  session->scheduled = false;
+  Server_write(server, session);
+}
+
+// REQUIRES: the caller holds session->mutex
+// EFFECTS: Writes as much pending output as the socket accepts, and asks
+//          epoll to report when the rest can be written. After a quit, or
+//          once the client has stopped sending, the connection is shut down
+//          when every response has been written.
+void Server_write(Server *server, ServerSession *session) {
+  if (session->closed) {
+    return;
+  }
+  bool finished = session->quit || session->ended;
+  size_t written = 0;
+  while (written < session->output.size()) {
+    ssize_t n = send(session->fd, session->output.data() + written,
+                     session->output.size() - written, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        // The epoll thread will see the error and close the session.
+        session->output.clear();
+      }
+      break;
+    }
+    written += n;
+  }
+  session->output.erase(0, written);
+
+  if (!session->output.empty()) {
+    Server_watch(server, session, EPOLLOUT);
+  }
+  else if (!finished) {
+    Server_watch(server, session, EPOLLIN);
+  }
+  else if (session->scheduled) {
+    Server_watch(server, session, 0);
+  }
+  else {
+    // Watching the socket once it's shut down reports the hangup, so the
+    // epoll thread drops the session.
+    shutdown(session->fd, SHUT_RDWR);
+    Server_watch(server, session, EPOLLIN);
+  }
+}
+
+// REQUIRES: the caller holds session->mutex
+// EFFECTS: Sets the events epoll reports for the session's socket. A
+//          session isn't read while responses are waiting, so a client that
+//          never reads can't make the server buffer an unbounded amount of
+//          output. With no events, the socket is removed from epoll, which
+//          would otherwise keep reporting a hangup while a worker finishes
+//          the session.
+void Server_watch(Server *server, ServerSession *session, uint32_t events) {
+  if (session->closed) {
+    return;
+  }
+  if (events == 0) {
+    if (session->watched) {
+      epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, session->fd, nullptr);
+      session->watched = false;
+    }
+    return;
+  }
+  epoll_event event = {};
+  event.events = events;
+  event.data.fd = session->fd;
+  epoll_ctl(server->epoll_fd, session->watched ? EPOLL_CTL_MOD : EPOLL_CTL_ADD,
+            session->fd, &event);
+  session->watched = true;
+}
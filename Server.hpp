@@ -0,0 +1,105 @@
+#ifndef SERVER_HPP
+#define SERVER_HPP
+
+#include "Game.hpp"
+#include "JsonUI.hpp"
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <unordered_map>
+#include <atomic>
+#include <random>
+
+// Hosts many games in one process. Each connection to the server is a
+// session with its own game, and speaks the line-delimited JSON protocol
+// from JsonUI.hpp (so moves are answered with only the cells they changed).
+//
+// One thread runs an epoll loop that accepts connections and reads
+// requests. Sessions with complete request lines are queued for a pool of
+// worker threads, which apply the moves and write the responses. A session
+// is handled by at most one worker at a time, so its game needs no lock.
+
+struct ServerSession {
+  int fd;
+  Game game;
+  bool started; // the game is created by the first worker to handle the session
+  unsigned seed; // for the game, drawn when the client connects
+  JsonUI ui;
+  int id;
+  Spectator spectator; // published only if the server was given a prefix
+
+  // Guards everything below, which is shared by the epoll thread and the
+  // worker handling the session
+  std::mutex mutex;
+  std::string input;   // received, but not yet handled
+  std::string output;  // responses not yet written to the socket
+  bool has_line;       // input holds a complete request line
+  size_t line_length;  // bytes of input after its last '\n'
+  bool too_long;       // a request line was longer than SERVER_MAX_LINE
+  bool scheduled;      // queued for or being handled by a worker
+  bool quit;           // a quit request was handled
+  bool ended;          // the client will send nothing more
+  bool closed;         // the epoll thread has dropped the session
+  bool watched;        // the socket is registered with epoll
+
+  ~ServerSession();
+};
+
+struct Server {
+  int listen_fd;
+  int epoll_fd;
+  std::string unix_path; // removed on exit, if listening on a Unix socket
+
+  // Parameters for the game created for each session
+  int width;
+  int height;
+  int num_treasures;
+  int num_traps;
+  std::string save_dir;
+  bool index_openings;
+  std::string spectate_prefix; // empty unless spectating is enabled
+
+  // Only touched by the epoll thread
+  std::unordered_map<int, std::shared_ptr<ServerSession>> sessions;
+  int next_session_id;
+  std::mt19937 seeds; // seeds for the sessions' games
+
+  std::mutex queue_mutex;
+  std::condition_variable queue_ready;
+  std::deque<std::shared_ptr<ServerSession>> queue;
+  std::vector<std::thread> workers;
+  bool stopping; // guarded by queue_mutex
+};
+
+// REQUIRES: the parameters are valid for Game_init
+// EFFECTS: Initializes a server whose sessions each get a new game with the
+//          given parameters. Saves are written to save_dir.
+void Server_init(Server *server, int width, int height, int num_treasures, int num_traps,
+                 const std::string &save_dir);
+
+// EFFECTS: Listens on a Unix domain socket at path, replacing any stale
+//          socket file. Returns false (with a message on cerr) on failure.
+bool Server_listen_unix(Server *server, const std::string &path);
+
+// EFFECTS: Listens on the given TCP port on the loopback interface only.
+//          Returns false (with a message on cerr) on failure.
+bool Server_listen_tcp(Server *server, int port);
+
+// EFFECTS: Indexes the openings of each session's game when it's created.
+void Server_enable_index(Server *server);
+
+// EFFECTS: Publishes each session's game as a spectator feed named
+//          <prefix>-<id>, where id counts sessions from 1 in the order
+//          they connect.
+void Server_enable_spectate(Server *server, const std::string &prefix);
+
+// REQUIRES: Server_listen_unix() or Server_listen_tcp() succeeded
+// EFFECTS: Serves sessions with num_workers worker threads until the
+//          process receives SIGINT or SIGTERM, then closes every session.
+void Server_run(Server *server, int num_workers);
+
+#endif
@@ -0,0 +1,143 @@
+#include "Spectator.hpp"
+#include <iostream>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+// "Private" function declarations
+void Spectator_write_totals(SpectatorHeader *header, const Game *game);
+
+size_t Spectator_size(int width, int height) {
+  return sizeof(SpectatorHeader) + SPECTATOR_RING_SIZE * sizeof(SpectatorSlot)
+         + static_cast<size_t>(width) * height;
+}
+
+SpectatorSlot * Spectator_ring(SpectatorHeader *header) {
+  return reinterpret_cast<SpectatorSlot *>(header + 1);
+}
+
+std::atomic<uint8_t> * Spectator_cells(SpectatorHeader *header) {
+  return reinterpret_cast<std::atomic<uint8_t> *>(Spectator_ring(header) + header->ring_size);
+}
+
+uint8_t Spectator_cell_byte(const Cell *cell) {
+  uint8_t byte = cell->state << 6;
+  if (cell->state == REVEALED) {
+    byte |= cell->item << 4 | cell->num_adjacent_traps;
+  }
+  return byte;
+}
+
+uint64_t Spectator_pack_change(int x, int y, uint8_t cell) {
+  return static_cast<uint64_t>(x) << 36 | static_cast<uint64_t>(y) << 8 | cell;
+}
+
+bool Spectator_open(Spectator *spectator, const std::string &name, const Game *game) {
+  spectator->name = "/" + name;
+  spectator->header = nullptr;
+  spectator->size = Spectator_size(Game_width(game), Game_height(game));
+
+  // A fresh segment, so viewers of an earlier run keep their own copy
+  shm_unlink(spectator->name.c_str());
+  int fd = shm_open(spectator->name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (fd < 0 || ftruncate(fd, spectator->size) != 0) {
+    std::cerr << "Could not create spectator feed " << spectator->name << ": "
+              << std::strerror(errno) << std::endl;
+    if (fd >= 0) {
+      close(fd);
+      shm_unlink(spectator->name.c_str());
+    }
+    return false;
+  }
+  void *memory = mmap(nullptr, spectator->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (memory == MAP_FAILED) {
+    std::cerr << "Could not map spectator feed " << spectator->name << ": "
+              << std::strerror(errno) << std::endl;
+    shm_unlink(spectator->name.c_str());
+    return false;
+  }
+
+  // The new memory is zero-filled, which is a valid state for every atomic.
+  SpectatorHeader *header = new (memory) SpectatorHeader;
+  header->version = SPECTATOR_VERSION;
+  header->width = Game_width(game);
+  header->height = Game_height(game);
+  header->ring_size = SPECTATOR_RING_SIZE;
+  header->num_treasures.store(Game_num_treasures(game), std::memory_order_relaxed);
+  header->num_traps.store(Game_num_traps(game), std::memory_order_relaxed);
+  Spectator_write_totals(header, game);
+
+  std::atomic<uint8_t> *cells = Spectator_cells(header);
+  GameView view = Game_view(game, 0, 0, header->width, header->height);
+  for(int x = 0; x < view.width; ++x) {
+    const Cell *cell = GameView_cell(&view, x, 0);
+    for(int y = 0; y < view.height; ++y, cell += view.y_stride) {
+      cells[static_cast<size_t>(y) * header->width + x].store(
+        Spectator_cell_byte(cell), std::memory_order_relaxed);
+    }
+  }
+  header->magic.store(SPECTATOR_MAGIC, std::memory_order_release);
+  spectator->header = header;
+  return true;
+}
+
+void Spectator_publish(Spectator *spectator, const Game *game) {
+  SpectatorHeader *header = spectator->header;
+  if (!header) {
+    return;
+  }
+  const std::vector<std::pair<int, int>> &changes = Game_changes(game);
+  SpectatorSlot *ring = Spectator_ring(header);
+  std::atomic<uint8_t> *cells = Spectator_cells(header);
+
+  // Only this process writes, so relaxed loads of our own values are fine.
+  uint64_t seq = header->seq.load(std::memory_order_relaxed);
+  uint64_t head = header->head.load(std::memory_order_relaxed);
+  header->seq.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  for(const std::pair<int, int> &pos : changes) {
+    uint8_t byte = Spectator_cell_byte(Game_cell(game, pos.first, pos.second));
+    cells[static_cast<size_t>(pos.second) * header->width + pos.first].store(
+      byte, std::memory_order_relaxed);
+
+    SpectatorSlot &slot = ring[head % header->ring_size];
+    slot.seq.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.change.store(Spectator_pack_change(pos.first, pos.second, byte),
+                      std::memory_order_relaxed);
+    slot.seq.store(head + 1, std::memory_order_release);
+    ++head;
+  }
+  Spectator_write_totals(header, game);
+  // Readers that see the new head also see the totals and the ring slots.
+  header->head.store(head, std::memory_order_release);
+  header->seq.store(seq + 2, std::memory_order_release);
+}
+
+void Spectator_close(Spectator *spectator) {
+  if (!spectator->header) {
+    return;
+  }
+  spectator->header->state.store(SPECTATOR_CLOSED, std::memory_order_release);
+  munmap(spectator->header, spectator->size);
+  shm_unlink(spectator->name.c_str());
+  spectator->header = nullptr;
+}
+
+// EFFECTS: Stores the totals that change as the game is played.
+void Spectator_write_totals(SpectatorHeader *header, const Game *game) {
+  header->num_treasures_found.store(Game_num_treasures_found(game), std::memory_order_relaxed);
+  header->num_traps_found.store(Game_num_traps_found(game), std::memory_order_relaxed);
+  header->num_revealed.store(Game_num_revealed(game), std::memory_order_relaxed);
+  header->num_flags.store(Game_num_flags(game), std::memory_order_relaxed);
+  int state = SPECTATOR_PLAYING;
+  if (Game_is_over(game)) {
+    state = Game_num_traps_found(game) > 0 ? SPECTATOR_LOST : SPECTATOR_WON;
+  }
+  header->state.store(state, std::memory_order_relaxed);
+}
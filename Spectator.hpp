@@ -0,0 +1,109 @@
+#ifndef SPECTATOR_HPP
+#define SPECTATOR_HPP
+
+#include "Game.hpp"
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+// A live feed of a game for spectators, published in POSIX shared memory
+// (shm_open) so that any number of local viewer processes can map it and
+// read it directly, without locks and without slowing down the game.
+//
+// The feed holds what the player can see: a byte per cell (see
+// Spectator_cell_byte) and the game's totals, plus a ring buffer of the
+// cells changed by each move. There is a single writer (the game), so
+// readers synchronize with sequence numbers instead of locks:
+//
+// - The cells and totals are covered by a seqlock. The writer makes seq odd
+//   before changing them and even again afterwards. A reader that sees the
+//   same even seq before and after reading got a consistent snapshot, and
+//   otherwise tries again.
+// - head counts the changes published so far. Change n is kept in ring slot
+//   n % ring_size, whose own seq is n + 1 once the change is complete. A
+//   reader that has fallen more than ring_size changes behind (or finds a
+//   slot already overwritten) reads a fresh snapshot instead.
+
+const uint32_t SPECTATOR_MAGIC = 0x50495254; // "PIRT"
+const uint32_t SPECTATOR_VERSION = 1;
+const uint32_t SPECTATOR_RING_SIZE = 4096;
+
+// Values of SpectatorHeader::state
+enum SpectatorState {
+  SPECTATOR_PLAYING = 0,
+  SPECTATOR_WON = 1,
+  SPECTATOR_LOST = 2,
+  SPECTATOR_CLOSED = 3, // the game has exited
+};
+
+struct SpectatorSlot {
+  std::atomic<uint64_t> seq;
+  std::atomic<uint64_t> change; // see Spectator_pack_change
+};
+
+// The shared memory starts with this header, followed by ring_size
+// SpectatorSlots and then width * height cell bytes in row-major order.
+// Everything is fixed-size and lock-free, so it means the same thing in
+// every process that maps it.
+struct SpectatorHeader {
+  std::atomic<uint32_t> magic; // set last, once the feed is ready
+  uint32_t version;
+  int32_t width;
+  int32_t height;
+  uint32_t ring_size;
+  uint32_t padding;
+  std::atomic<uint64_t> seq;
+  std::atomic<uint64_t> head;
+  std::atomic<int32_t> num_treasures;
+  std::atomic<int32_t> num_traps;
+  std::atomic<int32_t> num_treasures_found;
+  std::atomic<int32_t> num_traps_found;
+  std::atomic<int32_t> num_revealed;
+  std::atomic<int32_t> num_flags;
+  std::atomic<int32_t> state;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free &&
+              std::atomic<uint8_t>::is_always_lock_free,
+              "the spectator feed needs lock-free atomics to work across processes");
+
+struct Spectator {
+  std::string name;
+  SpectatorHeader *header; // nullptr if the feed couldn't be created
+  size_t size;
+};
+
+// EFFECTS: Returns the size in bytes of the feed for a width x height board.
+size_t Spectator_size(int width, int height);
+
+// EFFECTS: Returns the ring slots of the feed.
+SpectatorSlot * Spectator_ring(SpectatorHeader *header);
+
+// EFFECTS: Returns the cell bytes of the feed.
+std::atomic<uint8_t> * Spectator_cells(SpectatorHeader *header);
+
+// EFFECTS: Returns the byte describing what the player can see of the
+//          cell: its state in bits 6-7 and, for REVEALED cells only, its
+//          item in bits 4-5 and number of adjacent traps in bits 0-3.
+uint8_t Spectator_cell_byte(const Cell *cell);
+
+// EFFECTS: Packs a change to the cell at (x, y) into 64 bits, with x and y
+//          in 28 bits each and the cell byte in the lowest 8 bits.
+uint64_t Spectator_pack_change(int x, int y, uint8_t cell);
+
+// EFFECTS: Creates the shared memory feed /<name> (replacing any left
+//          over from an earlier run) and publishes the whole game to it.
+//          Returns false (with a message on cerr) if it couldn't be created.
+bool Spectator_open(Spectator *spectator, const std::string &name, const Game *game);
+
+// REQUIRES: Spectator_open() has been called
+// EFFECTS: Publishes the cells changed by the last move (Game_changes())
+//          and the new totals. Does nothing if the feed wasn't created.
+void Spectator_publish(Spectator *spectator, const Game *game);
+
+// EFFECTS: Marks the feed closed and removes its name. Viewers that have it
+//          mapped can still read the final board.
+void Spectator_close(Spectator *spectator);
+
+#endif
@@ -0,0 +1,138 @@
+#include "Stats.hpp"
+#include <iomanip>
+#include <string>
+#include <algorithm>
+
+// Static storage, so every counter starts at zero
+StatsHistogram stats_histograms[NUM_STATS];
+
+const char *const stats_names[NUM_STATS] = {
+  "game_init",
+  "game_load",
+  "game_save",
+  "game_reveal",
+  "game_toggle_flag",
+  "ui_render",
+  "ui_output",
+  "journal_record",
+  "server_request",
+};
+
+// "Private" function declarations
+int bucket_of(uint64_t ns);
+uint64_t bucket_low_ns(int bucket);
+
+bool Stats_enabled() {
+#ifdef PIRATE_STATS
+  return true;
+#else
+  return false;
+#endif
+}
+
+const StatsHistogram * Stats_histogram(StatId id) {
+  return &stats_histograms[id];
+}
+
+const char * Stats_name(StatId id) {
+  return stats_names[id];
+}
+
+void Stats_record(StatId id, uint64_t ns) {
+  StatsHistogram &histogram = stats_histograms[id];
+  histogram.count.fetch_add(1, std::memory_order_relaxed);
+  histogram.total_ns.fetch_add(ns, std::memory_order_relaxed);
+  histogram.buckets[bucket_of(ns)].fetch_add(1, std::memory_order_relaxed);
+  uint64_t max_ns = histogram.max_ns.load(std::memory_order_relaxed);
+  while (ns > max_ns &&
+         !histogram.max_ns.compare_exchange_weak(max_ns, ns, std::memory_order_relaxed)) {
+  }
+}
+
+uint64_t Stats_percentile(const StatsHistogram *histogram, double fraction) {
+  uint64_t count = histogram->count.load(std::memory_order_relaxed);
+  if (count == 0) {
+    return 0;
+  }
+  uint64_t max_ns = histogram->max_ns.load(std::memory_order_relaxed);
+  uint64_t wanted = static_cast<uint64_t>(fraction * count);
+  uint64_t seen = 0;
+  for(int b = 0; b < STATS_NUM_BUCKETS - 1; ++b) {
+    seen += histogram->buckets[b].load(std::memory_order_relaxed);
+    if (seen > wanted) {
+      // No operation took longer than the slowest one
+      return std::min(bucket_low_ns(b + 1), max_ns);
+    }
+  }
+  return max_ns;
+}
+
+void Stats_print(std::ostream &out) {
+  if (!Stats_enabled()) {
+    out << "Statistics are not collected in this build (see Stats.hpp)." << std::endl;
+    return;
+  }
+  out << std::left << std::setw(18) << "operation" << std::right
+      << std::setw(10) << "count"
+      << std::setw(12) << "mean us"
+      << std::setw(12) << "p50 us"
+      << std::setw(12) << "p99 us"
+      << std::setw(12) << "max us" << std::endl;
+  for(int id = 0; id < NUM_STATS; ++id) {
+    const StatsHistogram *histogram = Stats_histogram(static_cast<StatId>(id));
+    uint64_t count = histogram->count.load(std::memory_order_relaxed);
+    if (count == 0) {
+      continue;
+    }
+    double total_us = histogram->total_ns.load(std::memory_order_relaxed) / 1000.0;
+    out << std::left << std::setw(18) << Stats_name(static_cast<StatId>(id)) << std::right
+        << std::setw(10) << count
+        << std::fixed << std::setprecision(1)
+        << std::setw(12) << total_us / count
+        << std::setw(12) << Stats_percentile(histogram, 0.50) / 1000.0
+        << std::setw(12) << Stats_percentile(histogram, 0.99) / 1000.0
+        << std::setw(12) << histogram->max_ns.load(std::memory_order_relaxed) / 1000.0
+        << std::defaultfloat << std::endl;
+  }
+}
+
+void Stats_write_json(std::ostream &out) {
+  out << "{\"enabled\":" << (Stats_enabled() ? "true" : "false") << ",\"operations\":{";
+  bool first = true;
+  for(int id = 0; id < NUM_STATS; ++id) {
+    const StatsHistogram *histogram = Stats_histogram(static_cast<StatId>(id));
+    uint64_t count = histogram->count.load(std::memory_order_relaxed);
+    if (count == 0) {
+      continue;
+    }
+    out << (first ? "" : ",") << "\n  \"" << Stats_name(static_cast<StatId>(id)) << "\":{"
+        << "\"count\":" << count
+        << ",\"total_ns\":" << histogram->total_ns.load(std::memory_order_relaxed)
+        << ",\"max_ns\":" << histogram->max_ns.load(std::memory_order_relaxed)
+        << ",\"p50_ns\":" << Stats_percentile(histogram, 0.50)
+        << ",\"p99_ns\":" << Stats_percentile(histogram, 0.99)
+        << ",\"buckets\":[";
+    // Only the buckets in use, as [lowest latency in ns, count]
+    bool first_bucket = true;
+    for(int b = 0; b < STATS_NUM_BUCKETS; ++b) {
+      uint64_t n = histogram->buckets[b].load(std::memory_order_relaxed);
+      if (n > 0) {
+        out << (first_bucket ? "" : ",") << "[" << bucket_low_ns(b) << "," << n << "]";
+        first_bucket = false;
+      }
+    }
+    out << "]}";
+    first = false;
+  }
+  out << "\n}}\n";
+}
+
+// EFFECTS: Returns the histogram bucket that counts a latency of ns.
+int bucket_of(uint64_t ns) {
+  return 63 - __builtin_clzll(ns | 1);
+}
+
+// EFFECTS: Returns the lowest latency counted by the bucket.
+uint64_t bucket_low_ns(int bucket) {
+  return bucket == 0 ? 0 : uint64_t(1) << bucket;
+}
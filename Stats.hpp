@@ -0,0 +1,91 @@
+#ifndef STATS_HPP
+#define STATS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+
+// Per-operation latency statistics: a counter and a histogram of latencies
+// for each of the operations below, to tell where the time in a slow turn
+// goes.
+//
+// Collecting them costs two clock reads and a few atomic additions per
+// operation, so they are compiled out unless the program is built with
+// -DPIRATE_STATS (e.g. `make pirate.exe STATS=1`). Without it, STATS_TIME()
+// expands to nothing, and the reporting functions just say so.
+//
+// Histogram bucket b counts latencies from 2^b up to 2^(b+1) nanoseconds
+// (bucket 0 also counts 0 ns), so percentiles are only known to within a
+// factor of two. Updates are atomic, so any thread may record.
+
+enum StatId {
+  STAT_GAME_INIT,        // Game_init() of a new game
+  STAT_GAME_LOAD,        // Game_init() from a stream
+  STAT_GAME_SAVE,
+  STAT_GAME_REVEAL,
+  STAT_GAME_TOGGLE_FLAG,
+  STAT_UI_RENDER,        // drawing the board
+  STAT_UI_OUTPUT,        // writing it out
+  STAT_JOURNAL_RECORD,
+  STAT_SERVER_REQUEST,   // handling one request on a server worker
+  NUM_STATS
+};
+
+const int STATS_NUM_BUCKETS = 64;
+
+struct StatsHistogram {
+  std::atomic<uint64_t> count;
+  std::atomic<uint64_t> total_ns;
+  std::atomic<uint64_t> max_ns;
+  std::atomic<uint64_t> buckets[STATS_NUM_BUCKETS];
+};
+
+// EFFECTS: Returns whether statistics are collected in this build.
+bool Stats_enabled();
+
+// EFFECTS: Returns the histogram for the operation.
+const StatsHistogram * Stats_histogram(StatId id);
+
+// EFFECTS: Returns the name of the operation, e.g. "game_reveal".
+const char * Stats_name(StatId id);
+
+// EFFECTS: Records one operation that took ns nanoseconds.
+void Stats_record(StatId id, uint64_t ns);
+
+// EFFECTS: Returns an upper bound on the latency (in nanoseconds) that the
+//          given fraction of the operations took at most, or 0 if there
+//          were none.
+uint64_t Stats_percentile(const StatsHistogram *histogram, double fraction);
+
+// EFFECTS: Prints a table of the operations recorded so far.
+void Stats_print(std::ostream &out);
+
+// EFFECTS: Writes everything recorded so far as a JSON object.
+void Stats_write_json(std::ostream &out);
+
+// Records the time from its creation to the end of its scope. Use it
+// through STATS_TIME().
+struct StatsTimer {
+  StatId id;
+  std::chrono::steady_clock::time_point start;
+
+  explicit StatsTimer(StatId id)
+    : id(id), start(std::chrono::steady_clock::now()) { }
+
+  ~StatsTimer() {
+    Stats_record(id, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::steady_clock::now() - start).count());
+  }
+};
+
+#ifdef PIRATE_STATS
+  #define STATS_CONCAT_(a, b) a##b
+  #define STATS_CONCAT(a, b) STATS_CONCAT_(a, b)
+  // Times the rest of the enclosing scope as one operation with the given id
+  #define STATS_TIME(id) StatsTimer STATS_CONCAT(stats_timer_, __LINE__)(id)
+#else
+  #define STATS_TIME(id) static_cast<void>(0)
+#endif
+
+#endif
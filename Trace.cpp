@@ -0,0 +1,164 @@
+#include "Trace.hpp"
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <cstdio>
+#include <unistd.h>
+
+// Spans beyond this many on one thread are counted, but not kept, so a
+// runaway trace can't use up all the memory.
+const size_t TRACE_MAX_EVENTS_PER_THREAD = 1 << 21;
+
+// A finished span
+struct TraceEvent {
+  const char *name;
+  uint64_t start_ns;
+  uint64_t duration_ns;
+  const char *arg_name;
+  long long arg;
+};
+
+// The spans recorded by one thread. Only that thread appends to events.
+struct TraceBuffer {
+  int tid;
+  const char *thread_name;
+  std::vector<TraceEvent> events;
+  uint64_t num_dropped;
+};
+
+std::atomic<bool> trace_enabled(false);
+std::string trace_filename;
+std::chrono::steady_clock::time_point trace_origin;
+
+// Every thread's buffer. The lock is only taken the first time a thread
+// records a span, and by Trace_stop().
+std::mutex trace_buffers_mutex;
+std::vector<std::unique_ptr<TraceBuffer>> trace_buffers;
+
+// The calling thread's buffer, once it has one. Buffers are owned by
+// trace_buffers, so they outlive their threads and can be written out
+// after the threads have exited.
+thread_local TraceBuffer *trace_buffer = nullptr;
+
+// "Private" function declarations
+uint64_t trace_now_ns();
+TraceBuffer * trace_thread_buffer();
+void write_microseconds(std::ostream &out, uint64_t ns);
+
+TraceSpan::TraceSpan(const char *name)
+  : name(nullptr), start_ns(0), arg_name(nullptr), arg(0) {
+  if (trace_enabled.load(std::memory_order_relaxed)) {
+    this->name = name;
+    start_ns = trace_now_ns();
+  }
+}
+
+TraceSpan::~TraceSpan() {
+  if (!name || !trace_enabled.load(std::memory_order_relaxed)) {
+    return;
+  }
+  uint64_t end_ns = trace_now_ns();
+  TraceBuffer *buffer = trace_thread_buffer();
+  if (buffer->events.size() >= TRACE_MAX_EVENTS_PER_THREAD) {
+    ++buffer->num_dropped;
+    return;
+  }
+  buffer->events.push_back({name, start_ns, end_ns - start_ns, arg_name, arg});
+}
+
+bool Trace_start(const std::string &filename) {
+  // Create the file now, so a bad name is reported before the game starts
+  // rather than lost at the end.
+  std::ofstream out(filename);
+  if (!out) {
+    std::cerr << "Could not create trace file " << filename << std::endl;
+    return false;
+  }
+  trace_filename = filename;
+  trace_origin = std::chrono::steady_clock::now();
+  trace_enabled.store(true, std::memory_order_release);
+  return true;
+}
+
+void Trace_stop() {
+  if (!trace_enabled.exchange(false)) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(trace_buffers_mutex);
+  std::ofstream out(trace_filename);
+  int pid = getpid();
+  uint64_t num_dropped = 0;
+  out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+  out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << pid
+      << ",\"args\":{\"name\":\"pirate\"}}";
+  for(const std::unique_ptr<TraceBuffer> &buffer : trace_buffers) {
+    if (buffer->thread_name) {
+      out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid
+          << ",\"tid\":" << buffer->tid
+          << ",\"args\":{\"name\":\"" << buffer->thread_name << "\"}}";
+    }
+    // Complete ("X") events, with times in microseconds
+    for(const TraceEvent &event : buffer->events) {
+      out << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":" << pid
+          << ",\"tid\":" << buffer->tid << ",\"ts\":";
+      write_microseconds(out, event.start_ns);
+      out << ",\"dur\":";
+      write_microseconds(out, event.duration_ns);
+      if (event.arg_name) {
+        out << ",\"args\":{\"" << event.arg_name << "\":" << event.arg << "}";
+      }
+      out << "}";
+    }
+    num_dropped += buffer->num_dropped;
+    std::vector<TraceEvent>().swap(buffer->events);
+    buffer->num_dropped = 0;
+  }
+  out << "\n],\"otherData\":{\"dropped_events\":" << num_dropped << "}}\n";
+  if (!out) {
+    std::cerr << "Could not write trace file " << trace_filename << std::endl;
+  }
+  else if (num_dropped > 0) {
+    std::cerr << "The trace was too long: " << num_dropped << " spans were dropped" << std::endl;
+  }
+}
+
+void Trace_name_thread(const char *name) {
+  if (trace_enabled.load(std::memory_order_relaxed)) {
+    trace_thread_buffer()->thread_name = name;
+  }
+}
+
+void Trace_arg(TraceSpan *span, const char *name, long long value) {
+  span->arg_name = name;
+  span->arg = value;
+}
+
+// EFFECTS: Returns the time since tracing started.
+uint64_t trace_now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now() - trace_origin).count();
+}
+
+// EFFECTS: Returns the calling thread's buffer, creating it the first time.
+TraceBuffer * trace_thread_buffer() {
+  if (!trace_buffer) {
+    std::lock_guard<std::mutex> lock(trace_buffers_mutex);
+    trace_buffers.emplace_back(new TraceBuffer{
+      static_cast<int>(trace_buffers.size()) + 1, nullptr, {}, 0
+    });
+    trace_buffer = trace_buffers.back().get();
+  }
+  return trace_buffer;
+}
+
+// EFFECTS: Writes ns as microseconds, keeping nanosecond precision.
+void write_microseconds(std::ostream &out, uint64_t ns) {
+  char str[32];
+  snprintf(str, sizeof(str), "%llu.%03llu",
+           static_cast<unsigned long long>(ns / 1000),
+           static_cast<unsigned long long>(ns % 1000));
+  out << str;
+}
@@ -0,0 +1,57 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// An optional tracer that records spans of time (a turn, a reveal, a
+// render, a save...) and writes them as Chrome trace-event JSON, which can
+// be opened in Perfetto (ui.perfetto.dev) or chrome://tracing to see where
+// the time went in any single turn of a long session.
+//
+// Tracing is off until Trace_start() is called. While it's off, a span
+// costs one relaxed atomic load. While it's on, each thread appends its
+// spans to a buffer of its own, without locks, and the buffers are only
+// written out by Trace_stop() when the program exits.
+
+// A span being timed. Create one with TRACE_SPAN(), or declare one to add
+// an argument with Trace_arg() before it ends.
+struct TraceSpan {
+  const char *name; // nullptr if tracing was off when the span started
+  uint64_t start_ns;
+  const char *arg_name; // nullptr if there is no argument
+  long long arg;
+
+  explicit TraceSpan(const char *name);
+  ~TraceSpan();
+};
+
+// Set while tracing, so that spans can check it cheaply
+extern std::atomic<bool> trace_enabled;
+
+// EFFECTS: Starts recording spans from every thread, to be written to
+//          filename by Trace_stop(). Returns false (with a message on cerr)
+//          if the file can't be written.
+bool Trace_start(const std::string &filename);
+
+// REQUIRES: no other thread is recording spans
+// EFFECTS: Stops tracing and writes every span recorded to the file given
+//          to Trace_start(). Does nothing if tracing wasn't started.
+void Trace_stop();
+
+// EFFECTS: Names the calling thread in the trace, if tracing.
+void Trace_name_thread(const char *name);
+
+// EFFECTS: Adds an argument to the span, shown with it in the trace viewer.
+//          name must be a string literal (or otherwise outlive the trace).
+void Trace_arg(TraceSpan *span, const char *name, long long value);
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+// Records the rest of the enclosing scope as a span with the given name,
+// which must be a string literal.
+#define TRACE_SPAN(name) TraceSpan TRACE_CONCAT(trace_span_, __LINE__)(name)
+
+#endif
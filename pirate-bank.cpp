@@ -0,0 +1,104 @@
+#include "Bank.hpp"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+// Makes and fills a bank of pre-generated boards for pirate.exe --bank (see
+// Bank.hpp).
+//
+// Usage: pirate-bank.exe create <file> <capacity> <kind>...
+//   Creates an empty bank with a shelf of <capacity> boards for each kind,
+//   written as <width>x<height>/<treasures>/<traps>[/<topology>][/<min>-<max>]
+//   (e.g. 30x16/10/99 or 30x16/10/99/hex/100-150, where min-max is a range
+//   of 3BV).
+// Usage: pirate-bank.exe fill [--threads <n>] <file>
+//   Fills every shelf of the bank, on n threads (default: one per core).
+// Usage: pirate-bank.exe list <file>
+//   Prints each shelf's kind and how many boards it has ready.
+
+void print_usage(const char *program) {
+  std::cerr << "Usage: " << program << " create file capacity kind..." << std::endl;
+  std::cerr << "Usage: " << program << " fill [--threads n] file" << std::endl;
+  std::cerr << "Usage: " << program << " list file" << std::endl;
+  std::cerr << "A kind is widthxheight/treasures/traps[/rect|torus|hex][/min-max]" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+  std::string command = argc > 1 ? argv[1] : "";
+  if (command == "create" && argc >= 5) {
+    int capacity = std::stoi(argv[3]);
+    if (capacity <= 0) {
+      std::cerr << "Invalid capacity: " << argv[3] << std::endl;
+      return 1;
+    }
+    std::vector<BankKind> kinds;
+    for(int arg = 4; arg < argc; ++arg) {
+      BankKind kind;
+      if (!Bank_parse_kind(argv[arg], kind)) {
+        std::cerr << "Invalid kind: " << argv[arg] << std::endl;
+        print_usage(argv[0]);
+        return 1;
+      }
+      kinds.push_back(kind);
+    }
+    return Bank_create(argv[2], kinds, capacity) ? 0 : 1;
+  }
+  else if (command == "fill" && argc >= 3) {
+    int num_threads = std::max(1u, std::thread::hardware_concurrency());
+    int arg = 2;
+    if (std::string(argv[arg]) == "--threads" && argc == 5) {
+      num_threads = std::max(1, std::stoi(argv[arg + 1]));
+      arg += 2;
+    }
+    if (arg != argc - 1) {
+      print_usage(argv[0]);
+      return 1;
+    }
+    Bank bank;
+    if (!Bank_open(&bank, argv[arg])) {
+      return 1;
+    }
+    // Every thread fills every shelf, so no thread sits idle while a shelf
+    // of big boards is still filling.
+    auto start = std::chrono::steady_clock::now();
+    std::vector<int> num_added(num_threads);
+    std::vector<std::thread> threads;
+    for(int t = 0; t < num_threads; ++t) {
+      threads.emplace_back([&bank, &num_added, t] {
+        for(int shelf = 0; shelf < Bank_num_shelves(&bank); ++shelf) {
+          num_added[t] += Bank_fill(&bank, shelf, Bank_shelf(&bank, shelf)->capacity);
+        }
+      });
+    }
+    for(std::thread &thread : threads) {
+      thread.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    int total = 0;
+    for(int n : num_added) {
+      total += n;
+    }
+    std::cout << "Added " << total << " boards in " << seconds << " s on " << num_threads
+              << " threads" << std::endl;
+    Bank_close(&bank);
+    return 0;
+  }
+  else if (command == "list" && argc == 3) {
+    Bank bank;
+    if (!Bank_open(&bank, argv[2])) {
+      return 1;
+    }
+    for(int shelf = 0; shelf < Bank_num_shelves(&bank); ++shelf) {
+      const BankShelf *info = Bank_shelf(&bank, shelf);
+      std::cout << Bank_kind_name(info->kind) << " " << info->tail - info->head << "/"
+                << info->capacity << std::endl;
+    }
+    Bank_close(&bank);
+    return 0;
+  }
+  print_usage(argv[0]);
+  return 1;
+}
@@ -0,0 +1,187 @@
+#include "BigBoard.hpp"
+#include <iostream>
+#include <string>
+#include <sstream>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+
+// Makes and plays boards too big to fit in memory (see BigBoard.hpp).
+//
+// Usage: pirate-big.exe generate [options] file width height num_treasures num_traps
+//   Writes a new big board to file.
+//   Options:
+//     --seed <n>         Seed the board's generator (default: 1).
+//     --topology <name>  Make a rect (the default), torus or hex board.
+// Usage: pirate-big.exe play file
+//   Applies moves from stdin to the board in file, which keeps the game
+//   between runs. Moves are one per line: R/F <x> <y> as in HeadlessUI.hpp, P <x> <y>
+//   <width> <height> to print the part of that rectangle on the board, and Q. One line is
+//   written per R or F move, as HeadlessUI does:
+//
+//     <move> <x> <y> <result> <found>/<treasures> <traps_found> <revealed> <state>
+
+void print_usage(const char *program) {
+  std::cerr << "Usage: " << program
+            << " generate [--seed n] [--topology rect|torus|hex] file width height num_treasures num_traps"
+            << std::endl;
+  std::cerr << "Usage: " << program << " play file" << std::endl;
+}
+
+// EFFECTS: Returns how the cell looks to the player.
+char cell_glyph(const Cell &cell) {
+  if (cell.state == HIDDEN) {
+    return '#';
+  }
+  else if (cell.state == FLAG) {
+    return 'F';
+  }
+  else if (cell.item == TREASURE) {
+    return '$';
+  }
+  else if (cell.item == TRAP) {
+    return 'X';
+  }
+  return cell.num_adjacent_traps == 0 ? '.' : '0' + cell.num_adjacent_traps;
+}
+
+// EFFECTS: Parses str as a whole int into n. Returns false, leaving n
+//          unchanged, if it isn't one.
+bool parse_int(const std::string &str, int &n) {
+  char *end = nullptr;
+  errno = 0;
+  long value = std::strtol(str.c_str(), &end, 10);
+  if (str.empty() || *end != '\0' || errno == ERANGE || value < INT_MIN || INT_MAX < value) {
+    return false;
+  }
+  n = value;
+  return true;
+}
+
+int generate(int argc, char *argv[]) {
+  unsigned seed = 1;
+  Topology topology = TOPOLOGY_RECT;
+  int arg = 2;
+  while (arg < argc && std::string(argv[arg]).rfind("--", 0) == 0) {
+    std::string option = argv[arg++];
+    if (option == "--seed" && arg < argc) {
+      seed = std::stoul(argv[arg++]);
+    }
+    else if (option == "--topology" && arg < argc && Game_parse_topology(argv[arg], topology)) {
+      ++arg;
+    }
+    else {
+      std::cerr << "Invalid option: " << option << std::endl;
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+  if (argc - arg != 5) {
+    print_usage(argv[0]);
+    return 1;
+  }
+  std::string filename = argv[arg];
+  int width = std::stoi(argv[arg + 1]);
+  int height = std::stoi(argv[arg + 2]);
+  int64_t num_treasures = std::stoll(argv[arg + 3]);
+  int64_t num_traps = std::stoll(argv[arg + 4]);
+  if (width <= 0 || height <= 0 || num_treasures <= 0 || num_traps < 0 ||
+      num_treasures + num_traps >= static_cast<int64_t>(width) * height / 2 ||
+      (topology == TOPOLOGY_TORUS && (width < 3 || height < 3))) {
+    std::cerr << "Invalid board." << std::endl;
+    return 1;
+  }
+  auto start = std::chrono::steady_clock::now();
+  if (!BigBoard_generate(filename, seed, width, height, num_treasures, num_traps, topology)) {
+    return 1;
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cerr << "Generated " << static_cast<int64_t>(width) * height << " cells in " << seconds
+            << " s" << std::endl;
+  return 0;
+}
+
+int play(const std::string &filename) {
+  BigBoard board;
+  if (!BigBoard_open(&board, filename)) {
+    return 1;
+  }
+  std::string line;
+  while (!BigBoard_is_over(&board) && std::getline(std::cin, line)) {
+    // Each move is read from its own line, and its numbers as words first,
+    // so a bad one doesn't leave the stream failed or a position unset.
+    std::istringstream words(line);
+    std::string move;
+    std::string x_str;
+    std::string y_str;
+    if (!(words >> move)) {
+      continue;
+    }
+    if (move == "Q") {
+      break;
+    }
+    words >> x_str >> y_str;
+    int x = 0;
+    int y = 0;
+    bool valid = parse_int(x_str, x) && parse_int(y_str, y);
+    if (move == "P") {
+      std::string width_str;
+      std::string height_str;
+      words >> width_str >> height_str;
+      int width = 0;
+      int height = 0;
+      if (valid && parse_int(width_str, width) && parse_int(height_str, height)) {
+        // Only the part of the rectangle on the board is printed, with its
+        // far edges worked out in 64 bits so they can't overflow.
+        int left = std::max(x, 0);
+        int bottom = std::max(y, 0);
+        int right = std::min<int64_t>(static_cast<int64_t>(x) + width, BigBoard_width(&board));
+        int top = std::min<int64_t>(static_cast<int64_t>(y) + height, BigBoard_height(&board));
+        for(int row = bottom; left < right && row < top; ++row) {
+          std::string cells;
+          for(int column = left; column < right; ++column) {
+            cells += cell_glyph(BigBoard_cell(&board, column, row));
+          }
+          std::cout << cells << "\n";
+        }
+        continue;
+      }
+      valid = false;
+    }
+    std::string result = "ok";
+    if (!valid || (move != "R" && move != "F")) {
+      result = "invalid";
+    }
+    else if (!BigBoard_in_bounds(&board, x, y)) {
+      result = "oob";
+    }
+    else if (move == "R") {
+      BigBoard_reveal(&board, x, y);
+    }
+    else {
+      BigBoard_toggle_flag(&board, x, y);
+    }
+    std::cout << move << " " << x_str << " " << y_str << " " << result << " "
+              << BigBoard_num_treasures_found(&board) << "/" << BigBoard_num_treasures(&board)
+              << " " << BigBoard_num_traps_found(&board) << " " << BigBoard_num_revealed(&board)
+              << (!BigBoard_is_over(&board) ? " playing"
+                  : BigBoard_num_traps_found(&board) > 0 ? " lost" : " won") << "\n";
+  }
+  BigBoard_close(&board);
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  std::string command = argc > 1 ? argv[1] : "";
+  if (command == "generate") {
+    return generate(argc, argv);
+  }
+  else if (command == "play" && argc == 3) {
+    return play(argv[2]);
+  }
+  print_usage(argv[0]);
+  return 1;
+}
@@ -0,0 +1,307 @@
+#include <iostream>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+// A load generator for pirate-server.exe. Many clients each play random
+// moves, waiting for every response before sending the next move, and the
+// time from sending a move to receiving its response is recorded.
+//
+// Usage: pirate-loadgen.exe [options]
+//
+// Options:
+//   --unix <path>    Connect to a Unix domain socket (the default, at
+//                    pirate-server.sock).
+//   --port <port>    Connect to a TCP port on the loopback interface instead.
+//   --clients <n>    Number of concurrent clients (default 100).
+//   --moves <n>      Number of moves each client makes (default 1000). When a
+//                    client's game ends, it reconnects to start a new one.
+//   --threads <n>    Number of threads driving the clients (default 1).
+
+using Clock = std::chrono::steady_clock;
+
+struct LoadgenOptions {
+  std::string unix_path;
+  int port;
+  int num_clients;
+  int num_moves;
+  int num_threads;
+};
+
+struct LoadgenClient {
+  int fd;
+  int width;  // 0 until the status response has arrived
+  int height;
+  int moves_left;
+  std::string buffer; // received, but not yet a complete line
+  Clock::time_point sent;
+};
+
+// Results from one thread
+struct LoadgenResults {
+  std::vector<long long> latencies; // in microseconds
+  int num_errors = 0;
+  int num_games = 0;
+  bool failed = false;
+};
+
+// EFFECTS: Opens a connection to the server, or returns -1.
+int loadgen_connect(const LoadgenOptions &options) {
+  int fd;
+  int result;
+  if (options.port > 0) {
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(options.port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    result = connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+    int nodelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+  }
+  else {
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, options.unix_path.c_str(), sizeof(addr.sun_path) - 1);
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    result = connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+  }
+  if (result != 0) {
+    std::cerr << "Could not connect: " << std::strerror(errno) << std::endl;
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// EFFECTS: Sends a whole request line. Returns false on failure.
+bool loadgen_send(LoadgenClient &client, const std::string &request) {
+  size_t written = 0;
+  while (written < request.size()) {
+    ssize_t n = send(client.fd, request.data() + written, request.size() - written, MSG_NOSIGNAL);
+    if (n < 0 && errno != EINTR) {
+      return false;
+    }
+    written += std::max<ssize_t>(n, 0);
+  }
+  return true;
+}
+
+// EFFECTS: Returns the integer following "key": in the response, or 0.
+int loadgen_field(const std::string &response, const std::string &key) {
+  size_t pos = response.find("\"" + key + "\":");
+  return pos == std::string::npos ? 0 : std::atoi(response.c_str() + pos + key.size() + 3);
+}
+
+// EFFECTS: Connects the client to a new game and asks for its size.
+bool loadgen_start_game(const LoadgenOptions &options, LoadgenClient &client, int epoll_fd,
+                        LoadgenResults &results) {
+  client.fd = loadgen_connect(options);
+  if (client.fd < 0) {
+    return false;
+  }
+  client.width = 0;
+  client.height = 0;
+  client.buffer.clear();
+  ++results.num_games;
+
+  epoll_event event = {};
+  event.events = EPOLLIN;
+  event.data.ptr = &client;
+  epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client.fd, &event);
+  return loadgen_send(client, "{\"cmd\":\"status\"}\n");
+}
+
+// EFFECTS: Sends the client's next move: usually a reveal, sometimes a flag.
+bool loadgen_send_move(LoadgenClient &client, std::mt19937 &rng) {
+  int x = rng() % client.width;
+  int y = rng() % client.height;
+  const char *cmd = rng() % 8 == 0 ? "flag" : "reveal";
+  std::string request = std::string("{\"cmd\":\"") + cmd + "\",\"x\":" + std::to_string(x)
+                      + ",\"y\":" + std::to_string(y) + "}\n";
+  client.sent = Clock::now();
+  return loadgen_send(client, request);
+}
+
+// EFFECTS: Handles one response line for the client. Returns false on failure.
+bool loadgen_respond(const LoadgenOptions &options, LoadgenClient &client, int epoll_fd,
+                     const std::string &response, std::mt19937 &rng, LoadgenResults &results) {
+  if (client.width == 0) {
+    // The response to the status request
+    client.width = loadgen_field(response, "width");
+    client.height = loadgen_field(response, "height");
+    if (client.width <= 0 || client.height <= 0) {
+      std::cerr << "Unexpected response: " << response << std::endl;
+      return false;
+    }
+    return loadgen_send_move(client, rng);
+  }
+
+  long long latency =
+    std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - client.sent).count();
+  results.latencies.push_back(latency);
+  if (response.find("\"ok\":true") == std::string::npos) {
+    ++results.num_errors;
+  }
+  if (--client.moves_left == 0) {
+    close(client.fd); // also removes it from epoll
+    client.fd = -1;
+    return true;
+  }
+  if (response.find("\"state\":\"playing\"") == std::string::npos) {
+    close(client.fd);
+    return loadgen_start_game(options, client, epoll_fd, results);
+  }
+  return loadgen_send_move(client, rng);
+}
+
+void loadgen_thread(const LoadgenOptions &options, int num_clients, unsigned seed,
+                    LoadgenResults &results) {
+  std::mt19937 rng(seed);
+  int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  std::vector<LoadgenClient> clients(num_clients);
+  results.latencies.reserve(static_cast<size_t>(num_clients) * options.num_moves);
+  int active = 0;
+  for(LoadgenClient &client : clients) {
+    client.moves_left = options.num_moves;
+    if (!loadgen_start_game(options, client, epoll_fd, results)) {
+      results.failed = true;
+      break;
+    }
+    ++active;
+  }
+
+  const int MAX_EVENTS = 64;
+  epoll_event events[MAX_EVENTS];
+  char buffer[1 << 16];
+  while (active > 0 && !results.failed) {
+    int num_events = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+    for(int i = 0; i < num_events && !results.failed; ++i) {
+      LoadgenClient &client = *static_cast<LoadgenClient *>(events[i].data.ptr);
+      ssize_t n = recv(client.fd, buffer, sizeof(buffer), 0);
+      if (n <= 0) {
+        std::cerr << "Connection closed by the server" << std::endl;
+        results.failed = true;
+        break;
+      }
+      client.buffer.append(buffer, n);
+      size_t end;
+      while (client.fd >= 0 && (end = client.buffer.find('\n')) != std::string::npos) {
+        std::string response = client.buffer.substr(0, end);
+        client.buffer.erase(0, end + 1);
+        if (!loadgen_respond(options, client, epoll_fd, response, rng, results)) {
+          results.failed = true;
+          break;
+        }
+      }
+      if (client.fd < 0) {
+        --active;
+      }
+    }
+  }
+  for(LoadgenClient &client : clients) {
+    if (client.fd >= 0) {
+      close(client.fd);
+    }
+  }
+  close(epoll_fd);
+}
+
+void print_usage(const char *program) {
+  std::cerr << "Usage: " << program << " [options]" << std::endl;
+  std::cerr << "Options: --unix path, --port port, --clients n, --moves n, --threads n" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+  LoadgenOptions options = {"pirate-server.sock", 0, 100, 1000, 1};
+  int arg = 1;
+  while (arg < argc) {
+    std::string option = argv[arg++];
+    if (arg >= argc) {
+      std::cerr << "Invalid option: " << option << std::endl;
+      print_usage(argv[0]);
+      return 1;
+    }
+    std::string value = argv[arg++];
+    if (option == "--unix") {
+      options.unix_path = value;
+      options.port = 0;
+    }
+    else if (option == "--port") {
+      options.port = std::stoi(value);
+    }
+    else if (option == "--clients") {
+      options.num_clients = std::max(1, std::stoi(value));
+    }
+    else if (option == "--moves") {
+      options.num_moves = std::max(1, std::stoi(value));
+    }
+    else if (option == "--threads") {
+      options.num_threads = std::max(1, std::stoi(value));
+    }
+    else {
+      std::cerr << "Invalid option: " << option << std::endl;
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+  options.num_threads = std::min(options.num_threads, options.num_clients);
+
+  std::vector<LoadgenResults> results(options.num_threads);
+  std::vector<std::thread> threads;
+  Clock::time_point start = Clock::now();
+  for(int i = 0; i < options.num_threads; ++i) {
+    // Spread the clients as evenly as possible over the threads
+    int num_clients = options.num_clients / options.num_threads
+                    + (i < options.num_clients % options.num_threads ? 1 : 0);
+    threads.emplace_back(loadgen_thread, std::cref(options), num_clients, i + 1,
+                         std::ref(results[i]));
+  }
+  for(std::thread &thread : threads) {
+    thread.join();
+  }
+  double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+  std::vector<long long> latencies;
+  int num_errors = 0;
+  int num_games = 0;
+  bool failed = false;
+  for(const LoadgenResults &result : results) {
+    latencies.insert(latencies.end(), result.latencies.begin(), result.latencies.end());
+    num_errors += result.num_errors;
+    num_games += result.num_games;
+    failed = failed || result.failed;
+  }
+  if (latencies.empty()) {
+    std::cerr << "No moves were made." << std::endl;
+    return 1;
+  }
+  std::sort(latencies.begin(), latencies.end());
+  auto percentile = [&latencies](double p) {
+    return latencies[std::min(latencies.size() - 1, static_cast<size_t>(p * latencies.size()))];
+  };
+
+  std::cout << "clients " << options.num_clients
+            << "  moves " << latencies.size()
+            << "  errors " << num_errors
+            << "  games " << num_games
+            << "  seconds " << seconds
+            << "  moves/s " << static_cast<long long>(latencies.size() / seconds) << std::endl;
+  std::cout << "latency us  p50 " << percentile(0.50)
+            << "  p99 " << percentile(0.99)
+            << "  max " << latencies.back() << std::endl;
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,106 @@
+#include "Game.hpp"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+// Rates the boards made from a range of seeds by their difficulty (see
+// Game_difficulty()), to sort boards into buckets for matchmaking. The
+// board for a seed can then be played with pirate.exe --seed.
+//
+// Usage: pirate-rate.exe [options] first_seed num_seeds width height num_treasures num_traps
+//
+// Prints one line per board:
+//   <seed> <3bv> <openings> <isolated_numbers>
+//
+// Options:
+//   --topology <name>  Rate rect (the default), torus or hex boards.
+//   --threads <n>      Number of threads (default: one per core).
+//   --summary          Print only the number of boards rated, how long it
+//                      took, and the range and mean of their 3BV.
+
+void print_usage(const char *program) {
+  std::cerr << "Usage: " << program
+            << " [options] first_seed num_seeds width height num_treasures num_traps" << std::endl;
+  std::cerr << "Options: --topology rect|torus|hex, --threads n, --summary" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+  Topology topology = TOPOLOGY_RECT;
+  int num_threads = std::max(1u, std::thread::hardware_concurrency());
+  bool summary_only = false;
+  int arg = 1;
+  while (arg < argc && std::string(argv[arg]).rfind("--", 0) == 0) {
+    std::string option = argv[arg++];
+    if (option == "--topology" && arg < argc) {
+      std::string name = argv[arg++];
+      if (!Game_parse_topology(name, topology)) {
+        std::cerr << "Invalid topology: " << name << std::endl;
+        print_usage(argv[0]);
+        return 1;
+      }
+    }
+    else if (option == "--threads" && arg < argc) {
+      num_threads = std::max(1, std::stoi(argv[arg++]));
+    }
+    else if (option == "--summary") {
+      summary_only = true;
+    }
+    else {
+      std::cerr << "Invalid option: " << option << std::endl;
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+  if (argc - arg != 6) {
+    std::cerr << "Invalid number of arguments." << std::endl;
+    print_usage(argv[0]);
+    return 1;
+  }
+  unsigned first_seed = std::stoul(argv[arg]);
+  int num_seeds = std::stoi(argv[arg + 1]);
+  int width = std::stoi(argv[arg + 2]);
+  int height = std::stoi(argv[arg + 3]);
+  int num_treasures = std::stoi(argv[arg + 4]);
+  int num_traps = std::stoi(argv[arg + 5]);
+  if (width <= 0 || height <= 0 || num_treasures <= 0 || num_traps < 0 ||
+      num_treasures + num_traps >= width * height / 2 ||
+      (topology == TOPOLOGY_TORUS && (width < 3 || height < 3))) {
+    std::cerr << "Invalid board." << std::endl;
+    return 1;
+  }
+
+  std::vector<unsigned> seeds(std::max(0, num_seeds));
+  for(int i = 0; i < seeds.size(); ++i) {
+    seeds[i] = first_seed + i;
+  }
+  auto start = std::chrono::steady_clock::now();
+  std::vector<GameDifficulty> ratings = Game_rate_seeds(seeds, width, height, num_treasures,
+                                                        num_traps, topology, num_threads);
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  if (!summary_only) {
+    std::ios::sync_with_stdio(false);
+    for(int i = 0; i < seeds.size(); ++i) {
+      std::cout << seeds[i] << " " << ratings[i].bbbv << " " << ratings[i].num_openings << " "
+                << ratings[i].num_isolated_numbers << "\n";
+    }
+    return 0;
+  }
+  long long total = 0;
+  int min_bbbv = ratings.empty() ? 0 : ratings[0].bbbv;
+  int max_bbbv = min_bbbv;
+  for(const GameDifficulty &rating : ratings) {
+    total += rating.bbbv;
+    min_bbbv = std::min(min_bbbv, rating.bbbv);
+    max_bbbv = std::max(max_bbbv, rating.bbbv);
+  }
+  std::cout << "Rated " << ratings.size() << " boards in " << seconds << " s ("
+            << ratings.size() / seconds << " boards/s) on " << num_threads << " threads"
+            << std::endl;
+  std::cout << "3BV: min " << min_bbbv << ", max " << max_bbbv << ", mean "
+            << (ratings.empty() ? 0.0 : static_cast<double>(total) / ratings.size()) << std::endl;
+  return 0;
+}
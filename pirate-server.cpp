@@ -0,0 +1,132 @@
+#include "Server.hpp"
+#include "Stats.hpp"
+#include "Trace.hpp"
+#include <iostream>
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <fstream>
+
+// Usage: pirate-server.exe [options] width height num_treasures num_traps
+//   Every client that connects gets a new game with the given parameters,
+//   and plays it with the JSON protocol described in JsonUI.hpp.
+//
+// Options:
+//   --unix <path>      Listen on a Unix domain socket (the default, at
+//                      pirate-server.sock).
+//   --port <port>      Listen on a TCP port on the loopback interface instead.
+//   --workers <n>      Number of worker threads handling moves (defaults to
+//                      the number of CPUs).
+//   --save-dir <dir>   Directory that "save" requests write to (defaults to
+//                      the current directory). Clients may only give file
+//                      names, not paths.
+//   --index            Index each game's openings when it's created (see
+//                      Game_index_openings()).
+//   --spectate <prefix>  Publish each session's game for pirate-spectate.exe
+//                      as <prefix>-1, <prefix>-2, ... in connection order.
+//   --stats-dump <file>  On shutdown, write the latency statistics to <file>
+//                      as JSON (see Stats.hpp).
+//   --trace <file>     Record a trace of every request, and write it to
+//                      <file> on shutdown as Chrome trace-event JSON (see
+//                      Trace.hpp).
+
+void print_usage(const char *program) {
+  std::cerr << "Usage: " << program << " [options] width height num_treasures num_traps" << std::endl;
+  std::cerr << "Options: --unix path, --port port, --workers n, --save-dir dir, --index, --spectate prefix, --stats-dump file, --trace file" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+  std::string unix_path = "pirate-server.sock";
+  int port = 0;
+  int num_workers = std::max(1u, std::thread::hardware_concurrency());
+  std::string save_dir = ".";
+  bool index = false;
+  std::string spectate_prefix;
+  std::string stats_filename;
+  std::string trace_filename;
+  int arg = 1;
+  while (arg < argc && std::string(argv[arg]).rfind("--", 0) == 0) {
+    std::string option = argv[arg++];
+    if (option == "--unix" && arg < argc) {
+      unix_path = argv[arg++];
+      port = 0;
+    }
+    else if (option == "--port" && arg < argc) {
+      port = std::stoi(argv[arg++]);
+    }
+    else if (option == "--workers" && arg < argc) {
+      num_workers = std::max(1, std::stoi(argv[arg++]));
+    }
+    else if (option == "--save-dir" && arg < argc) {
+      save_dir = argv[arg++];
+    }
+    else if (option == "--index") {
+      index = true;
+    }
+    else if (option == "--spectate" && arg < argc) {
+      spectate_prefix = argv[arg++];
+    }
+    else if (option == "--stats-dump" && arg < argc) {
+      stats_filename = argv[arg++];
+    }
+    else if (option == "--trace" && arg < argc) {
+      trace_filename = argv[arg++];
+    }
+    else {
+      std::cerr << "Invalid option: " << option << std::endl;
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+  if (argc - arg != 4) {
+    std::cerr << "Invalid number of arguments." << std::endl;
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  int width = std::stoi(argv[arg]);
+  int height = std::stoi(argv[arg + 1]);
+  int num_treasures = std::stoi(argv[arg + 2]);
+  int num_traps = std::stoi(argv[arg + 3]);
+  // Every session's game is made on a worker, so a board Game_init() can't
+  // make has to be turned away before any session starts.
+  if (width <= 0 || height <= 0 || num_treasures <= 0 || num_traps < 0 ||
+      num_treasures + num_traps >= width * height / 2) {
+    std::cerr << "Invalid board." << std::endl;
+    return 1;
+  }
+
+  Server server;
+  Server_init(&server, width, height, num_treasures, num_traps, save_dir);
+  if (index) {
+    Server_enable_index(&server);
+  }
+  if (!spectate_prefix.empty()) {
+    Server_enable_spectate(&server, spectate_prefix);
+  }
+  if (port > 0 ? !Server_listen_tcp(&server, port) : !Server_listen_unix(&server, unix_path)) {
+    return 1;
+  }
+  if (port > 0) {
+    std::cerr << "Listening on 127.0.0.1:" << port;
+  }
+  else {
+    std::cerr << "Listening on " << unix_path;
+  }
+  std::cerr << " with " << num_workers << " workers" << std::endl;
+
+  if (!trace_filename.empty()) {
+    if (!Trace_start(trace_filename)) {
+      return 1;
+    }
+    Trace_name_thread("epoll");
+  }
+
+  Server_run(&server, num_workers);
+
+  if (!stats_filename.empty()) {
+    std::ofstream stats_out(stats_filename);
+    Stats_write_json(stats_out);
+  }
+  Trace_stop();
+}
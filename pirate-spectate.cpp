@@ -0,0 +1,211 @@
+#include "Spectator.hpp"
+#include <iostream>
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <csignal>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+
+// Usage: pirate-spectate.exe name
+//   Watches the game published with --spectate name. The part of the board
+//   that fits in the terminal is shown, and updated as moves are made.
+//
+// The viewer only reads the shared memory, so it never slows the game
+// down, and any number of viewers can watch the same game.
+
+// How often the feed is checked for new moves
+const std::chrono::milliseconds SPECTATE_POLL(20);
+
+// Set by SIGINT and SIGTERM
+volatile std::sig_atomic_t spectate_stop_requested = 0;
+
+// What's drawn on the terminal, so that moves only redraw the cells they
+// changed
+struct SpectateView {
+  SpectatorHeader *header;
+  int width;  // number of columns shown
+  int height; // number of rows shown
+  uint64_t head; // changes drawn so far
+  std::string frame;
+};
+
+// EFFECTS: Appends the glyph for a cell byte (see Spectator_cell_byte).
+void append_glyph(std::string &frame, uint8_t byte) {
+  static const char *const colors[] = {
+    "\033[0m", "\033[34m", "\033[36m", "\033[32m", "\033[33m",
+    "\033[31m", "\033[31m", "\033[35m", "\033[35m",
+  };
+  int state = byte >> 6;
+  int item = (byte >> 4) & 3;
+  int count = byte & 15;
+  if (state == HIDDEN) {
+    frame += "\033[0m.";
+  }
+  else if (state == FLAG) {
+    frame += "\033[31mF";
+  }
+  else if (item == TREASURE) {
+    frame += "\033[33m$";
+  }
+  else if (item == TRAP) {
+    frame += "\033[31mX";
+  }
+  else if (count == 0) {
+    frame += "\033[0m ";
+  }
+  else {
+    frame += colors[count];
+    frame += static_cast<char>('0' + count);
+  }
+}
+
+// EFFECTS: Moves the cursor to where the cell at (x, y) is drawn. The top
+//          row of the board is drawn on the first row of the terminal.
+void append_move(SpectateView *view, int x, int y) {
+  int row = view->header->height - 1 - y + 1;
+  view->frame += "\033[" + std::to_string(row) + ";" + std::to_string(x + 1) + "H";
+}
+
+void append_status(SpectateView *view) {
+  SpectatorHeader *header = view->header;
+  view->frame += "\033[0m\033[" + std::to_string(view->height + 1) + ";1H\033[K";
+  view->frame += "Found " + std::to_string(header->num_treasures_found.load(std::memory_order_relaxed))
+               + "/" + std::to_string(header->num_treasures.load(std::memory_order_relaxed))
+               + " treasures, " + std::to_string(header->num_revealed.load(std::memory_order_relaxed))
+               + " cells revealed, " + std::to_string(header->num_flags.load(std::memory_order_relaxed))
+               + " flags. ";
+  int state = header->state.load(std::memory_order_relaxed);
+  if (state == SPECTATOR_WON) {
+    view->frame += "The player won!";
+  }
+  else if (state == SPECTATOR_LOST) {
+    view->frame += "The player hit a trap!";
+  }
+  else if (state == SPECTATOR_CLOSED) {
+    view->frame += "The game has ended.";
+  }
+}
+
+// EFFECTS: Redraws everything from a consistent snapshot of the feed.
+void redraw(SpectateView *view) {
+  SpectatorHeader *header = view->header;
+  std::atomic<uint8_t> *cells = Spectator_cells(header);
+  int bottom = header->height - view->height;
+  while (true) {
+    uint64_t seq = header->seq.load(std::memory_order_acquire);
+    if (seq % 2 == 1) {
+      std::this_thread::yield(); // a move is being published
+      continue;
+    }
+    view->head = header->head.load(std::memory_order_relaxed);
+    view->frame = "\033[H\033[2J";
+    for(int y = header->height - 1; y >= bottom; --y) {
+      append_move(view, 0, y);
+      for(int x = 0; x < view->width; ++x) {
+        append_glyph(view->frame, cells[static_cast<size_t>(y) * header->width + x]
+                                    .load(std::memory_order_relaxed));
+      }
+    }
+    append_status(view);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (header->seq.load(std::memory_order_relaxed) == seq) {
+      return;
+    }
+  }
+}
+
+// EFFECTS: Draws the changes published since the last frame. Returns false
+//          if some were overwritten before they could be read, in which
+//          case the caller should redraw everything.
+bool draw_changes(SpectateView *view, uint64_t head) {
+  SpectatorHeader *header = view->header;
+  if (head - view->head > header->ring_size) {
+    return false;
+  }
+  SpectatorSlot *ring = Spectator_ring(header);
+  int bottom = header->height - view->height;
+  for(uint64_t n = view->head; n < head; ++n) {
+    SpectatorSlot &slot = ring[n % header->ring_size];
+    uint64_t seq = slot.seq.load(std::memory_order_acquire);
+    uint64_t change = slot.change.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (seq != n + 1 || slot.seq.load(std::memory_order_relaxed) != seq) {
+      return false;
+    }
+    int x = change >> 36;
+    int y = (change >> 8) & ((1 << 28) - 1);
+    if (x < view->width && y >= bottom) {
+      append_move(view, x, y);
+      append_glyph(view->frame, change & 255);
+    }
+  }
+  view->head = head;
+  append_status(view);
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 2) {
+    std::cerr << "Usage: " << argv[0] << " name" << std::endl;
+    return 1;
+  }
+  std::string name = std::string("/") + argv[1];
+  int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  struct stat info;
+  if (fd < 0 || fstat(fd, &info) != 0) {
+    std::cerr << "Could not open spectator feed " << name << ": " << std::strerror(errno) << std::endl;
+    return 1;
+  }
+  void *memory = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  SpectatorHeader *header = static_cast<SpectatorHeader *>(memory);
+  if (memory == MAP_FAILED || static_cast<size_t>(info.st_size) < sizeof(SpectatorHeader) ||
+      header->magic.load(std::memory_order_acquire) != SPECTATOR_MAGIC ||
+      header->version != SPECTATOR_VERSION ||
+      static_cast<size_t>(info.st_size) < Spectator_size(header->width, header->height)) {
+    std::cerr << "Not a spectator feed (or not ready yet): " << name << std::endl;
+    return 1;
+  }
+
+  struct sigaction action = {};
+  action.sa_handler = [](int) { spectate_stop_requested = 1; };
+  sigaction(SIGINT, &action, nullptr);
+  sigaction(SIGTERM, &action, nullptr);
+
+  // Show as much of the board as fits, leaving a row for the status line.
+  winsize size = {};
+  int rows = 24;
+  int cols = 80;
+  if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_row > 1 && size.ws_col > 0) {
+    rows = size.ws_row;
+    cols = size.ws_col;
+  }
+  SpectateView view = {header, std::min(header->width, cols), std::min(header->height, rows - 1), 0, ""};
+
+  redraw(&view);
+  bool closed = false;
+  while (!closed && !spectate_stop_requested) {
+    std::cout << view.frame << std::flush;
+    view.frame.clear();
+    std::this_thread::sleep_for(SPECTATE_POLL);
+
+    closed = header->state.load(std::memory_order_acquire) == SPECTATOR_CLOSED;
+    uint64_t head = header->head.load(std::memory_order_acquire);
+    if (head != view.head && !draw_changes(&view, head)) {
+      // Fell too far behind to catch up move by move
+      redraw(&view);
+    }
+    else if (closed) {
+      append_status(&view);
+    }
+  }
+  std::cout << view.frame << "\033[0m\n" << std::flush;
+  munmap(memory, info.st_size);
+}
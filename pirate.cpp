@@ -1,46 +1,335 @@
 #include "Game.hpp"
+#include "Bank.hpp"
+#include "Journal.hpp"
+#include "Spectator.hpp"
 #include "KeyboardUI.hpp"
 #include "CommandUI.hpp"
+#include "HeadlessUI.hpp"
+#include "JsonUI.hpp"
+#include "Stats.hpp"
+#include "Trace.hpp"
 #include <thread>
 #include <chrono>
 #include <fstream>
 #include <string>
+#include <sstream>
 
-// Usage: pirate.exe width height num_treasures num_traps
+// Usage: pirate.exe [options] width height num_treasures num_traps
 //   If four arguments are provided, a new game is created with the given parameters.
-// Usage: pirate.exe filename
+// Usage: pirate.exe [options] filename
 //   If filename is provided, the game state is loaded from the file.
+//
+// Options:
+//   --topology <name>  Make a new game on a rect (the default), torus or hex
+//                      board (see Topology in Game.hpp). Saved games keep
+//                      their own topology.
+//   --seed <n>         Make the new game's board from a seed, so the same
+//                      seed always deals the same board (see
+//                      pirate-rate.exe). Not with --lazy or --bank, which
+//                      make or take their boards without one.
+//   --lazy             Number the new game's cells as they're needed instead
+//                      of all at once, so that a big board starts quickly
+//                      (see Game_init_lazy()).
+//   --index            Index the game's openings when it starts, so that
+//                      revealing one doesn't search for its cells (see
+//                      Game_index_openings()). Not with --lazy, since the
+//                      index needs every cell numbered, or with --bank,
+//                      since indexing takes longer than making a board.
+//   --bank <file>      Take the new game's board from a bank of boards made
+//                      ahead of time (see Bank.hpp and pirate-bank.exe),
+//                      and refill the bank in the background while playing.
+//                      If the bank has no board of the right kind, one is
+//                      made as usual.
+//   --difficulty <min>-<max>  With --bank, take a board whose 3BV is in
+//                      the given range (see Game_difficulty()).
+//   --autosave <base>  Journal every move to <base>.ckpt and <base>.log. If
+//                      those files hold an unfinished game, it is resumed
+//                      instead of starting the game given by the arguments.
+//   --ansi             Keep the board in place on the terminal and redraw
+//                      only the cells that change (command interface only).
+//   --headless         Apply moves from stdin without drawing anything, and
+//                      print one result line per move (see HeadlessUI.hpp).
+//   --script <file>    Like --headless, but read the moves from <file>.
+//   --summary          With --headless or --script, print only one summary
+//                      line at the end instead of a line per move.
+//   --json             Serve line-delimited JSON requests on stdin and
+//                      stdout (see JsonUI.hpp).
+//   --spectate <name>  Publish the game in shared memory as <name>, so it
+//                      can be watched live with pirate-spectate.exe.
+//   --stats-dump <file>  On exit, write the latency statistics to <file> as
+//                      JSON (see Stats.hpp).
+//   --trace <file>     Record a trace of every turn, reveal, render, save and
+//                      load, and write it to <file> on exit as Chrome
+//                      trace-event JSON (see Trace.hpp).
+
+// Number of moves between autosave checkpoints
+const int AUTOSAVE_CHECKPOINT_INTERVAL = 50;
+
+void print_usage(const char *program) {
+  std::cerr << "Usage: " << program << " [options] width height num_treasures num_traps" << std::endl;
+  std::cerr << "Usage: " << program << " [options] filename" << std::endl;
+  std::cerr << "Usage: " << program << " --autosave base [options]" << std::endl;
+  std::cerr << "Options: --topology rect|torus|hex, --seed n, --lazy, --index, --bank file, --difficulty min-max, --autosave base, --ansi, --headless, --script file, --summary, --json, --spectate name, --stats-dump file, --trace file" << std::endl;
+}
 
 int main(int argc, char *argv[]) {
 
+  Topology topology = TOPOLOGY_RECT;
+  bool seeded = false;
+  unsigned seed = 0;
+  bool lazy = false;
+  bool index = false;
+  std::string bank_filename;
+  int min_bbbv = -1;
+  int max_bbbv = -1;
+  std::string autosave_base;
+  bool headless = false;
+  std::string script_filename;
+  bool summary_only = false;
+  bool json = false;
+  std::string spectate_name;
+  std::string stats_filename;
+  std::string trace_filename;
+  #ifndef USE_KEYBOARD_UI
+    bool ansi = false;
+  #endif
+  int arg = 1;
+  while (arg < argc && std::string(argv[arg]).rfind("--", 0) == 0) {
+    std::string option = argv[arg++];
+    if (option == "--topology" && arg < argc) {
+      std::string name = argv[arg++];
+      if (!Game_parse_topology(name, topology)) {
+        std::cerr << "Invalid topology: " << name << std::endl;
+        print_usage(argv[0]);
+        return 1;
+      }
+    }
+    else if (option == "--seed" && arg < argc) {
+      seeded = true;
+      seed = std::stoul(argv[arg++]);
+    }
+    else if (option == "--lazy") {
+      lazy = true;
+    }
+    else if (option == "--index") {
+      index = true;
+    }
+    else if (option == "--bank" && arg < argc) {
+      bank_filename = argv[arg++];
+    }
+    else if (option == "--difficulty" && arg < argc) {
+      std::istringstream range(argv[arg++]);
+      char dash;
+      if (!(range >> min_bbbv >> dash >> max_bbbv) || dash != '-' || min_bbbv < 0 ||
+          min_bbbv > max_bbbv) {
+        std::cerr << "Invalid difficulty: " << range.str() << std::endl;
+        print_usage(argv[0]);
+        return 1;
+      }
+    }
+    else if (option == "--autosave" && arg < argc) {
+      autosave_base = argv[arg++];
+    }
+    else if (option == "--headless") {
+      headless = true;
+    }
+    else if (option == "--script" && arg < argc) {
+      headless = true;
+      script_filename = argv[arg++];
+    }
+    else if (option == "--summary") {
+      summary_only = true;
+    }
+    else if (option == "--json") {
+      json = true;
+    }
+    else if (option == "--spectate" && arg < argc) {
+      spectate_name = argv[arg++];
+    }
+    else if (option == "--stats-dump" && arg < argc) {
+      stats_filename = argv[arg++];
+    }
+    else if (option == "--trace" && arg < argc) {
+      trace_filename = argv[arg++];
+    }
+    #ifndef USE_KEYBOARD_UI
+      else if (option == "--ansi") {
+        ansi = true;
+      }
+    #endif
+    else {
+      std::cerr << "Invalid option: " << option << std::endl;
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+  if (seeded && (lazy || !bank_filename.empty())) {
+    std::cerr << "--seed can't be used with --lazy or --bank." << std::endl;
+    print_usage(argv[0]);
+    return 1;
+  }
+  if (index && (lazy || !bank_filename.empty())) {
+    std::cerr << "--index can't be used with --lazy or --bank." << std::endl;
+    print_usage(argv[0]);
+    return 1;
+  }
+  int num_args = argc - arg;
+  if (headless || json) {
+    // Input is read and results are written in bulk.
+    std::ios::sync_with_stdio(false);
+  }
+
+  if (!trace_filename.empty()) {
+    if (!Trace_start(trace_filename)) {
+      return 1;
+    }
+    Trace_name_thread("main");
+  }
+
   Game game;
+  Bank bank;
+  bool banked = false;
+  Journal journal;
+  bool resumed = false;
+  if (!autosave_base.empty()) {
+    Journal_init(&journal, autosave_base, AUTOSAVE_CHECKPOINT_INTERVAL);
+    resumed = Journal_recover(&journal, &game) && !Game_is_over(&game);
+  }
 
-  if (argc == 5) {
-    Game_init(&game,
-      std::stoi(argv[1]), std::stoi(argv[2]),
-      std::stoi(argv[3]), std::stoi(argv[4])
-    );
+  if (resumed) {
+    std::cerr << "Resuming autosaved game from " << autosave_base << std::endl;
+  }
+  else if (num_args == 4) {
+    int width = std::stoi(argv[arg]);
+    int height = std::stoi(argv[arg + 1]);
+    if (topology == TOPOLOGY_TORUS && (width < 3 || height < 3)) {
+      std::cerr << "A torus must be at least 3x3." << std::endl;
+      return 1;
+    }
+    int num_treasures = std::stoi(argv[arg + 2]);
+    int num_traps = std::stoi(argv[arg + 3]);
+    if (seeded) {
+      Game_init_seeded(&game, seed, width, height, num_treasures, num_traps, topology);
+    }
+    else if (!bank_filename.empty() && Bank_open(&bank, bank_filename)) {
+      banked = true;
+      BankKind kind = {width, height, num_treasures, num_traps, topology, min_bbbv, max_bbbv};
+      int bank_shelf = Bank_find(&bank, kind);
+      if (bank_shelf < 0 || !Bank_take(&bank, bank_shelf, &game)) {
+        std::cerr << "No " << Bank_kind_name(kind) << " board in bank " << bank_filename
+                  << ", making one instead" << std::endl;
+        Game_init(&game, width, height, num_treasures, num_traps, topology);
+      }
+      if (bank_shelf >= 0) {
+        Bank_refill_async(&bank, bank_shelf);
+      }
+    }
+    else if (lazy) {
+      Game_init_lazy(&game, width, height, num_treasures, num_traps, topology);
+    }
+    else {
+      Game_init(&game, width, height, num_treasures, num_traps, topology);
+    }
   }
-  else if (argc == 2) {
-    std::ifstream fin(argv[1]);
+  else if (num_args == 1) {
+    std::ifstream fin(argv[arg]);
     Game_init(&game, fin);
   }
   else {
     // If the user provides the wrong number of arguments, print a usage message.
     std::cerr << "Invalid number of arguments." << std::endl;
-    std::cerr << "Usage: " << argv[0] << " width height num_treasures num_traps" << std::endl;
-    std::cerr << "Usage: " << argv[0] << " filename" << std::endl;
+    print_usage(argv[0]);
     return 1;
   }
+  if (index) {
+    Game_index_openings(&game);
+  }
 
-  #ifdef USE_KEYBOARD_UI
-    KeyboardUI keyboard_ui;
-    KeyboardUI_init(&keyboard_ui, &game);
-    KeyboardUI_play(&keyboard_ui);
-  #else
-    CommandUI command_ui;
-    CommandUI_init(&command_ui, &game);
-    CommandUI_play(&command_ui);
-  #endif
-  
-}
\ No newline at end of file
+  if (!autosave_base.empty()) {
+    Journal_begin(&journal, &game);
+  }
+  Spectator spectator;
+  if (!spectate_name.empty() && !Spectator_open(&spectator, spectate_name, &game)) {
+    if (banked) {
+      Bank_close(&bank);
+    }
+    return 1;
+  }
+
+  if (json) {
+    JsonUI json_ui;
+    JsonUI_init(&json_ui, &game, std::cin, std::cout);
+    if (!autosave_base.empty()) {
+      JsonUI_enable_autosave(&json_ui, &journal);
+    }
+    if (!spectate_name.empty()) {
+      JsonUI_enable_spectate(&json_ui, &spectator);
+    }
+    JsonUI_play(&json_ui);
+  }
+  else if (headless) {
+    std::ifstream script;
+    if (!script_filename.empty()) {
+      script.open(script_filename);
+      if (!script) {
+        std::cerr << "Could not open script " << script_filename << std::endl;
+        if (banked) {
+          Bank_close(&bank);
+        }
+        return 1;
+      }
+    }
+    HeadlessUI headless_ui;
+    HeadlessUI_init(&headless_ui, &game,
+                    script_filename.empty() ? std::cin : script, std::cout,
+                    summary_only);
+    if (!autosave_base.empty()) {
+      HeadlessUI_enable_autosave(&headless_ui, &journal);
+    }
+    if (!spectate_name.empty()) {
+      HeadlessUI_enable_spectate(&headless_ui, &spectator);
+    }
+    HeadlessUI_play(&headless_ui);
+  }
+  else {
+    #ifdef USE_KEYBOARD_UI
+      KeyboardUI keyboard_ui;
+      KeyboardUI_init(&keyboard_ui, &game);
+      if (!autosave_base.empty()) {
+        KeyboardUI_enable_autosave(&keyboard_ui, &journal);
+      }
+      if (!spectate_name.empty()) {
+        KeyboardUI_enable_spectate(&keyboard_ui, &spectator);
+      }
+      KeyboardUI_play(&keyboard_ui);
+    #else
+      CommandUI command_ui;
+      CommandUI_init(&command_ui, &game);
+      if (!autosave_base.empty()) {
+        CommandUI_enable_autosave(&command_ui, &journal);
+      }
+      if (!spectate_name.empty()) {
+        CommandUI_enable_spectate(&command_ui, &spectator);
+      }
+      if (ansi) {
+        CommandUI_enable_ansi(&command_ui);
+      }
+      CommandUI_play(&command_ui);
+    #endif
+  }
+
+  if (!autosave_base.empty()) {
+    Journal_close(&journal);
+  }
+  if (banked) {
+    Bank_close(&bank);
+  }
+  if (!spectate_name.empty()) {
+    Spectator_close(&spectator);
+  }
+  if (!stats_filename.empty()) {
+    std::ofstream stats_out(stats_filename);
+    Stats_write_json(stats_out);
+  }
+  Trace_stop();
+}